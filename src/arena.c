@@ -0,0 +1,166 @@
+/*
+ * arena.c - per-run bump allocator
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "arena.h"
+
+
+struct arena_chunk {
+   struct arena_chunk* prev;
+   size_t              size;
+   size_t              used;
+   unsigned char       data[] __attribute__ (( aligned ( ARENA_ALIGN ) ));
+};
+
+static void* arena_default_alloc ( void* const ctx, const size_t size ) {
+   (void) ctx;
+   return malloc ( size );
+}
+
+static void arena_default_free ( void* const ctx, void* const ptr ) {
+   (void) ctx;
+   free ( ptr );
+}
+
+static struct arena_chunk* arena_new_chunk (
+   const struct arena* const a,
+   struct arena_chunk* const prev, const size_t size
+) {
+   struct arena_chunk* chunk;
+
+   if ( size > SIZE_MAX - sizeof *chunk ) {
+      return NULL;
+   }
+
+   chunk = a->alloc_func ( a->alloc_ctx, sizeof *chunk + size );
+
+   if ( chunk != NULL ) {
+      chunk->prev = prev;
+      chunk->size = size;
+      chunk->used = 0;
+   }
+   return chunk;
+}
+
+static void arena_free_chunks (
+   const struct arena* const a, struct arena_chunk* chunk
+) {
+   struct arena_chunk* prev;
+
+   while ( chunk != NULL ) {
+      prev = chunk->prev;
+      a->free_func ( a->alloc_ctx, chunk );
+      chunk = prev;
+   }
+}
+
+
+int arena_init ( struct arena* const a, const size_t chunk_size ) {
+   return arena_init_alloc ( a, chunk_size, NULL, NULL, NULL );
+}
+
+int arena_init_alloc (
+   struct arena* const a, const size_t chunk_size,
+   arena_alloc_func alloc_func, arena_free_func free_func, void* const ctx
+) {
+   if ( alloc_func == NULL || free_func == NULL ) {
+      alloc_func = arena_default_alloc;
+      free_func  = arena_default_free;
+   }
+   a->alloc_func = alloc_func;
+   a->free_func  = free_func;
+   a->alloc_ctx  = ctx;
+
+   a->chunk_size = ( chunk_size > 0 ) ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+   a->chunk      = arena_new_chunk ( a, NULL, a->chunk_size );
+   if ( a->chunk == NULL ) {
+      return -1;
+   }
+
+   pthread_mutex_init ( &(a->lock), NULL );
+   return 0;
+}
+
+void arena_free ( struct arena* const a ) {
+   if ( a->chunk != NULL ) {
+      arena_free_chunks ( a, a->chunk );
+      a->chunk = NULL;
+      pthread_mutex_destroy ( &(a->lock) );
+   }
+}
+
+void arena_reset ( struct arena* const a ) {
+   struct arena_chunk* chunk;
+   size_t total;
+
+   pthread_mutex_lock ( &(a->lock) );
+
+   if ( a->chunk->prev != NULL ) {
+      /* replace the chunks by a single one that fits all of them */
+      total = 0;
+      for ( chunk = a->chunk; chunk != NULL; chunk = chunk->prev ) {
+         total += chunk->size;
+      }
+
+      chunk = arena_new_chunk ( a, NULL, total );
+      if ( chunk != NULL ) {
+         arena_free_chunks ( a, a->chunk );
+         a->chunk      = chunk;
+         a->chunk_size = total;
+      } else {
+         arena_free_chunks ( a, a->chunk->prev );
+         a->chunk->prev = NULL;
+      }
+   }
+   a->chunk->used = 0;
+
+   pthread_mutex_unlock ( &(a->lock) );
+}
+
+void* arena_alloc ( struct arena* const a, const size_t size ) {
+   const size_t asize = ( size + (ARENA_ALIGN - 1) ) & ~((size_t)ARENA_ALIGN - 1);
+   struct arena_chunk* chunk;
+   void* p;
+
+   if ( asize < size ) { return NULL; }
+
+   pthread_mutex_lock ( &(a->lock) );
+
+   chunk = a->chunk;
+   if ( chunk->size - chunk->used < asize ) {
+      /* oversized requests get a chunk of their own */
+      chunk = arena_new_chunk (
+         a, chunk, ( asize > a->chunk_size ) ? asize : a->chunk_size
+      );
+      if ( chunk == NULL ) {
+         pthread_mutex_unlock ( &(a->lock) );
+         return NULL;
+      }
+      a->chunk = chunk;
+   }
+
+   p            = chunk->data + chunk->used;
+   chunk->used += asize;
+
+   pthread_mutex_unlock ( &(a->lock) );
+   return p;
+}
@@ -0,0 +1,133 @@
+/*
+ * arena.h - per-run bump allocator
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_ARENA_
+#define _DISKID_ARENA_
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+/* rough upper bound of what probing one device allocates */
+#define ARENA_DEVICE_SIZE        4096
+#define ARENA_ALIGN              16
+
+struct arena_chunk;
+
+/* allocates / frees the arena's chunks, ctx is passed through */
+typedef void* (*arena_alloc_func) ( void* const ctx, const size_t size );
+typedef void  (*arena_free_func)  ( void* const ctx, void* const ptr );
+
+/*
+ * Bump allocator for everything that lives as long as a device's probe
+ * result (disk_info, backend info, var_name, disk_id).
+ * Memory is never freed individually, only all at once by arena_reset()
+ * or arena_free(). Allocating is thread-safe.
+ */
+struct arena {
+   struct arena_chunk* chunk;
+   size_t              chunk_size;
+   pthread_mutex_t     lock;
+   arena_alloc_func    alloc_func;
+   arena_free_func     free_func;
+   void*               alloc_ctx;
+};
+
+/*
+ * Allocates the first chunk of (at least) chunk_size bytes,
+ * 0 means ARENA_DEFAULT_CHUNK_SIZE. Returns 0 on success.
+ */
+int   arena_init  ( struct arena* const a, const size_t chunk_size );
+/*
+ * Same as arena_init(), but chunks are allocated with alloc_func() and
+ * freed with free_func() instead of malloc() and free().
+ * Both have to be given, or none of them.
+ */
+int   arena_init_alloc (
+   struct arena* const a, const size_t chunk_size,
+   arena_alloc_func alloc_func, arena_free_func free_func, void* const ctx
+);
+/* frees all memory, a may be zero-initialized and not inited */
+void  arena_free  ( struct arena* const a );
+/*
+ * Releases all allocations. If the arena had to grow, its chunks are
+ * replaced by a single one of the combined size, so that a repeated
+ * workload of the same size needs no further malloc() calls.
+ */
+void  arena_reset ( struct arena* const a );
+/* Returns ARENA_ALIGN-aligned memory, or NULL. */
+void* arena_alloc ( struct arena* const a, const size_t size );
+
+
+static inline char* arena_strdup (
+   struct arena* const a, const char* const str
+) {
+   const size_t len = strlen ( str );
+   char* const s    = arena_alloc ( a, len + 1 );
+
+   if ( s != NULL ) {
+      memcpy ( s, str, len + 1 );
+   }
+   return s;
+}
+
+static inline char* arena_strdup_upper (
+   struct arena* const a, const char* const str
+) {
+   const size_t len = strlen ( str );
+   char* const s    = arena_alloc ( a, len + 1 );
+
+   if ( s != NULL ) {
+      memcpy ( s, str, len + 1 );
+      convert_to_uppercase ( s, 0, len );
+   }
+   return s;
+}
+
+/* "<left><middle><right>" */
+static inline char* arena_join3 (
+   struct arena* const a,
+   const char* const left, const char* const middle, const char* const right
+) {
+   const size_t llen = strlen ( left );
+   const size_t mlen = strlen ( middle );
+   const size_t rlen = strlen ( right );
+   char* const s     = arena_alloc ( a, llen + mlen + rlen + 1 );
+
+   if ( s != NULL ) {
+      memcpy ( s, left, llen );
+      memcpy ( s + llen, middle, mlen );
+      memcpy ( s + llen + mlen, right, rlen + 1 );
+   }
+   return s;
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
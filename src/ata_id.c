@@ -62,11 +62,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <string.h>
 #include <errno.h>
+#include <endian.h>
 #include <getopt.h>
 #include <scsi/scsi.h>
 #include <scsi/sg.h>
@@ -77,522 +79,654 @@
 #include <linux/types.h>
 #include <linux/hdreg.h>
 #include <linux/fs.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include <linux/cdrom.h>
 #include <linux/bsg.h>
 #include <arpa/inet.h>
 
 #include "udev_util.h"
 #include "disk_type.h"
+#include "id_cache.h"
+#include "ata_sysfs.h"
+#include "out_buf.h"
 #include "ata_id.h"
 
-#define COMMAND_TIMEOUT_MSEC (30 * 1000)
-
-
-static inline int print_mdev_ata_id_vars (
-   const struct disk_info* const node,
-   const struct ata_disk_info* const pinfo,
-   unsigned const int mdev_export,
-   const char* const prefix
-);
 
 static inline int has_wwn ( const uint8_t* const identify );
 static uint64_t   get_wwn ( const uint8_t* const identify );
 
 
-#if ENABLE_MINIMAL
+/*
+ * The variables printed by --export/--mdev are described by a table of
+ * IDENTIFY word/bit mask descriptors, so that only the variables selected
+ * with --fields get decoded. Words are read from pinfo->id, which is either
+ * the fixed-up IDENTIFY data or the result of HDIO_GET_IDENTITY.
+ */
+
+struct ata_field;
 
-int print_ata_id_vars (
-   const struct disk_info* const node,
+typedef void (*ata_field_func) (
+   const struct ata_field* const f,
    const struct ata_disk_info* const pinfo,
-   unsigned const int mdev_export,
-   const char* const prefix
-) {
-   return print_mdev_ata_id_vars ( node, pinfo, mdev_export, prefix );
-}
+   struct out_buf* const out
+);
 
-#else
+enum ata_field_type {
+   ATA_FIELD_CONST, /* value is a fixed string */
+   ATA_FIELD_BOOL,  /* "1" if (word[val_word] & val_mask) != 0, else "0" */
+   ATA_FIELD_UINT,  /* ((word[val_word] >> val_shift) & val_mask) * val_mul */
+   ATA_FIELD_STR,   /* string member of struct ata_disk_info */
+   ATA_FIELD_FUNC,  /* anything else */
+};
+
+/* printed in --mdev mode (and the only variables in minimal builds) */
+#define ATA_FIELD_MDEV 0x1
+/* can be printed without full IDENTIFY data, see ata_sysfs_identify() */
+#define ATA_FIELD_VPD  0x2
+
+struct ata_field {
+   const char*         name;
+   enum ata_field_type type;
+   unsigned int        flags;
+   /*
+    * the variable is printed only if all bits of cond_mask are set
+    * in cond_word, same for cond2 (a zero mask is always true)
+    */
+   uint8_t             cond_word;
+   uint16_t            cond_mask;
+   uint8_t             cond2_word;
+   uint16_t            cond2_mask;
+   uint8_t             val_word;
+   uint8_t             val_shift;
+   uint16_t            val_mask;
+   uint8_t             val_mul;
+   const char*         value;
+   size_t              str_offset;
+   ata_field_func      func;
+};
+
+#define ATA_IDENTIFY_BIT(_word, _bit) \
+   .cond_word = (_word), .cond_mask = (1 << (_bit))
 
-static inline int print_ata_id_vars__extended (
-   const struct disk_info* const node,
-   const struct ata_disk_info* const pinfo,
-   const char* const prefix
-) {
-   const struct hd_driveid* const id    = &(pinfo->id);
-   const uint8_t*  const identify       = pinfo->identify;
-   const uint16_t* const identify_words = pinfo->identify_words;
-   uint16_t word;
+/*
+ * "<name>=1" if the feature set is supported (bit of word),
+ * "<name>_ENABLED=0|1" from the same bit of enabled_word
+ */
+#define ATA_FEATURE_SET(_name, _word, _bit, _enabled_word) \
+   { \
+      .name = _name, .type = ATA_FIELD_CONST, .value = "1", \
+      ATA_IDENTIFY_BIT ( _word, _bit ), \
+   }, \
+   { \
+      .name = _name "_ENABLED", .type = ATA_FIELD_BOOL, \
+      ATA_IDENTIFY_BIT ( _word, _bit ), \
+      .val_word = (_enabled_word), .val_mask = (1 << (_bit)), \
+   }
 
+#define ATA_FIELD_FN(_name, _flags, _func) \
+   { .name = _name, .type = ATA_FIELD_FUNC, .flags = (_flags), .func = _func }
 
-   /* Set this to convey the disk speaks the ATA protocol */
-   printf("%sID_ATA=1\n", prefix);
+
+#if !(ENABLE_MINIMAL)
+static void ata_field_type (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   const struct hd_driveid* const id = &(pinfo->id);
 
    if ((id->config >> 8) & 0x80) {
       /* This is an ATAPI device */
       switch ((id->config >> 8) & 0x1f) {
          case 0:
-            printf("%sID_TYPE=cd\n", prefix);
+         case 5:
+            out_var_str ( out, f->name, "cd" );
             break;
          case 1:
-            printf("%sID_TYPE=tape\n", prefix);
-            break;
-         case 5:
-            printf("%sID_TYPE=cd\n", prefix);
+            out_var_str ( out, f->name, "tape" );
             break;
          case 7:
-            printf("%sID_TYPE=optical\n", prefix);
+            out_var_str ( out, f->name, "optical" );
             break;
          default:
-            printf("%sID_TYPE=generic\n", prefix);
+            out_var_str ( out, f->name, "generic" );
             break;
       }
    } else {
-      printf("%sID_TYPE=disk\n", prefix);
+      out_var_str ( out, f->name, "disk" );
    }
+}
 
-   printf("%sID_BUS=ata\n", prefix);
-   printf("%sID_MODEL=%s\n", prefix, pinfo->model);
-   printf("%sID_MODEL_ENC=%s\n", prefix, pinfo->model_enc);
-   printf("%sID_REVISION=%s\n", prefix, pinfo->revision);
-   if (pinfo->serial[0] != '\0') {
-      printf("%sID_SERIAL=%s_%s\n", prefix, pinfo->model, pinfo->serial);
-      printf("%sID_SERIAL_SHORT=%s\n", prefix, pinfo->serial);
-   } else {
-      printf("%sID_SERIAL=%s\n", prefix, pinfo->model);
+static void ata_field_serial_short (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   if ( pinfo->serial[0] != '\0' ) {
+      out_var_str ( out, f->name, pinfo->serial );
    }
+}
 
-   if (id->command_set_1 & (1<<5)) {
-      printf ("%sID_ATA_WRITE_CACHE=1\n", prefix);
-      printf ("%sID_ATA_WRITE_CACHE_ENABLED=%d\n",
-         prefix, (id->cfs_enable_1 & (1<<5)) ? 1 : 0
-      );
-   }
+static void ata_field_security_level (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   out_var_str (
+      out, f->name, ( pinfo->id.dlf & (1<<8) ) ? "maximum" : "high"
+   );
+}
 
-   if (id->command_set_1 & (1<<10)) {
-      printf("%sID_ATA_FEATURE_SET_HPA=1\n", prefix);
-      printf("%sID_ATA_FEATURE_SET_HPA_ENABLED=%d\n",
-         prefix, (id->cfs_enable_1 & (1<<10)) ? 1 : 0
-      );
+/*
+ * Word 76 indicates the capabilities of a SATA device. A PATA device shall set
+ * word 76 to 0000h or FFFFh. If word 76 is set to 0000h or FFFFh, then
+ * the device does not claim compliance with the Serial ATA specification and words
+ * 76 through 79 are not valid and shall be ignored.
+ *
+ * If bit 2 of word 76 is set to one, then the device supports the Gen2
+ * signaling rate of 3.0 Gb/s (see SATA 2.6).
+ *
+ * If bit 1 of word 76 is set to one, then the device supports the Gen1
+ * signaling rate of 1.5 Gb/s (see SATA 2.6).
+ */
+static inline uint16_t ata_sata_caps ( const struct ata_disk_info* const pinfo ) {
+   const uint16_t word = *((const uint16_t *) pinfo->identify + 76);
+   return ( word != 0xffff ) ? word : 0;
+}
 
-      /*
-       * TODO: use the READ NATIVE MAX ADDRESS command to get the native max address
-       * so it is easy to check whether the protected area is in use.
-       */
+static void ata_field_sata (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   if ( ata_sata_caps ( pinfo ) != 0 ) {
+      out_var_str ( out, f->name, "1" );
    }
+}
 
-   if (id->command_set_1 & (1<<3)) {
-      printf("%sID_ATA_FEATURE_SET_PM=1\n", prefix);
-      printf("%sID_ATA_FEATURE_SET_PM_ENABLED=%d\n",
-         prefix, (id->cfs_enable_1 & (1<<3)) ? 1 : 0
-      );
+static void ata_field_sata_gen2 (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   if ( ata_sata_caps ( pinfo ) & (1<<2) ) {
+      out_var_str ( out, f->name, "1" );
    }
+}
 
-   if (id->command_set_1 & (1<<1)) {
-      printf("%sID_ATA_FEATURE_SET_SECURITY=1\n", prefix);
-      printf("%sID_ATA_FEATURE_SET_SECURITY_ENABLED=%d\n",
-         prefix, (id->cfs_enable_1 & (1<<1)) ? 1 : 0
-      );
-      printf("%sID_ATA_FEATURE_SET_SECURITY_ERASE_UNIT_MIN=%d\n",
-         prefix, id->trseuc * 2
-      );
+static void ata_field_sata_gen1 (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   if ( ata_sata_caps ( pinfo ) & (1<<1) ) {
+      out_var_str ( out, f->name, "1" );
+   }
+}
 
-      if ((id->cfs_enable_1 & (1<<1))) /* enabled */ {
-         if (id->dlf & (1<<8)) {
-            printf("%sID_ATA_FEATURE_SET_SECURITY_LEVEL=maximum\n", prefix);
-         } else {
-            printf("%sID_ATA_FEATURE_SET_SECURITY_LEVEL=high\n", prefix);
-         }
-      }
+/* Word 217 indicates the nominal media rotation rate of the device */
+static void ata_field_rotation_rate (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   const uint16_t word = *((const uint16_t *) pinfo->identify + 217);
 
-      if (id->dlf & (1<<5)) {
-         printf("%sID_ATA_FEATURE_SET_SECURITY_ENHANCED_ERASE_UNIT_MIN=%d\n",
-            prefix, id->trsEuc * 2);
-      }
-      if (id->dlf & (1<<4)) {
-         printf("%sID_ATA_FEATURE_SET_SECURITY_EXPIRE=1\n", prefix);
-      }
-      if (id->dlf & (1<<3)) {
-         printf("%sID_ATA_FEATURE_SET_SECURITY_FROZEN=1\n", prefix);
-      }
-      if (id->dlf & (1<<2)) {
-         printf("%sID_ATA_FEATURE_SET_SECURITY_LOCKED=1\n", prefix);
-      }
+   if (word == 0x0001) {
+      /* non-rotating e.g. SSD */
+      out_var_str ( out, f->name, "0" );
+   } else if (word >= 0x0401 && word <= 0xfffe) {
+      out_var_uint ( out, f->name, word );
    }
+}
 
-   if (id->command_set_1 & (1<<0)) {
-      printf("%sID_ATA_FEATURE_SET_SMART=1\n", prefix);
-      printf("%sID_ATA_FEATURE_SET_SMART_ENABLED=%d\n",
-         prefix, (id->cfs_enable_1 & (1<<0)) ? 1 : 0
-      );
-   }
-   if (id->command_set_2 & (1<<9)) {
-      printf("%sID_ATA_FEATURE_SET_AAM=1\n", prefix);
-      printf("%sID_ATA_FEATURE_SET_AAM_ENABLED=%d\n",
-         prefix, (id->cfs_enable_2 & (1<<9)) ? 1 : 0
-      );
-      printf("%sID_ATA_FEATURE_SET_AAM_VENDOR_RECOMMENDED_VALUE=%d\n",
-         prefix, id->acoustic >> 8
-      );
-      printf("%sID_ATA_FEATURE_SET_AAM_CURRENT_VALUE=%d\n",
-         prefix, id->acoustic & 0xff
-      );
-   }
+/* from Linux's include/linux/ata.h */
+static void ata_field_cfa (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   const uint16_t* const identify_words = pinfo->identify_words;
 
-   if (id->command_set_2 & (1<<5)) {
-      printf("%sID_ATA_FEATURE_SET_PUIS=1\n", prefix);
-      printf("%sID_ATA_FEATURE_SET_PUIS_ENABLED=%d\n", prefix, (id->cfs_enable_2 & (1<<5)) ? 1 : 0);
+   if (
+      identify_words[0] == 0x848a || identify_words[0] == 0x844a ||
+      (identify_words[83] & 0xc004) == 0x4004
+   ) {
+      out_var_str ( out, f->name, "1" );
    }
+}
+#endif /* !ENABLE_MINIMAL */
 
-   if (id->command_set_2 & (1<<3)) {
-      printf("%sID_ATA_FEATURE_SET_APM=1\n", prefix);
-      printf("%sID_ATA_FEATURE_SET_APM_ENABLED=%d\n", prefix, (id->cfs_enable_2 & (1<<3)) ? 1 : 0);
-      if ((id->cfs_enable_2 & (1<<3))) {
-         printf("%sID_ATA_FEATURE_SET_APM_CURRENT_VALUE=%d\n", prefix, id->CurAPMvalues & 0xff);
+static void ata_field_serial (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   if ( out_var_begin ( out, f->name ) ) {
+      out_val_puts ( out, pinfo->model );
+      if ( pinfo->serial[0] != '\0' ) {
+         out_val_putc ( out, '_' );
+         out_val_puts ( out, pinfo->serial );
       }
+      out_var_end ( out );
    }
+}
 
-   if (id->command_set_2 & (1<<0)) {
-      printf("%sID_ATA_DOWNLOAD_MICROCODE=1\n", prefix);
+/* ATA devices have no vendor extension, ID_WWN == ID_WWN_WITH_EXTENSION */
+static void ata_field_wwn (
+   const struct ata_field* const f,
+   const struct ata_disk_info* const pinfo,
+   struct out_buf* const out
+) {
+   if ( has_wwn ( pinfo->identify ) != 0 ) {
+      out_var_hex ( out, f->name, get_wwn ( pinfo->identify ) );
    }
+}
 
-   /*
-    * Word 76 indicates the capabilities of a SATA device. A PATA device shall set
-    * word 76 to 0000h or FFFFh. If word 76 is set to 0000h or FFFFh, then
-    * the device does not claim compliance with the Serial ATA specification and words
-    * 76 through 79 are not valid and shall be ignored.
-    */
-   word = *((uint16_t *) identify + 76);
-   if (word != 0x0000 && word != 0xffff) {
-      printf("%sID_ATA_SATA=1\n", prefix);
-      /*
-       * If bit 2 of word 76 is set to one, then the device supports the Gen2
-       * signaling rate of 3.0 Gb/s (see SATA 2.6).
-       *
-       * If bit 1 of word 76 is set to one, then the device supports the Gen1
-       * signaling rate of 1.5 Gb/s (see SATA 2.6).
-       */
-      if (word & (1<<2)) {
-         printf("%sID_ATA_SATA_SIGNAL_RATE_GEN2=1\n", prefix);
-      }
-      if (word & (1<<1)) {
-         printf("%sID_ATA_SATA_SIGNAL_RATE_GEN1=1\n", prefix);
-      }
-   }
 
-   /* Word 217 indicates the nominal media rotation rate of the device */
-   word = *((uint16_t *) identify + 217);
-   if (word != 0x0000) {
-      if (word == 0x0001) {
-         printf ("%sID_ATA_ROTATION_RATE_RPM=0\n", prefix); /* non-rotating e.g. SSD */
-      } else if (word >= 0x0401 && word <= 0xfffe) {
-         printf ("%sID_ATA_ROTATION_RATE_RPM=%d\n", prefix, word);
-      }
-   }
+/* in output order */
+static const struct ata_field ata_fields[] = {
+#if !(ENABLE_MINIMAL)
+   /* Set this to convey the disk speaks the ATA protocol */
+   {
+      .name = "ID_ATA", .type = ATA_FIELD_CONST, .flags = ATA_FIELD_VPD,
+      .value = "1",
+   },
+   ATA_FIELD_FN ( "ID_TYPE", 0, ata_field_type ),
+#endif
+   {
+      .name = "ID_BUS", .type = ATA_FIELD_CONST,
+      .flags = ATA_FIELD_MDEV | ATA_FIELD_VPD, .value = "ata",
+   },
+#if !(ENABLE_MINIMAL)
+   {
+      .name = "ID_MODEL", .type = ATA_FIELD_STR, .flags = ATA_FIELD_VPD,
+      .str_offset = offsetof ( struct ata_disk_info, model ),
+   },
+   {
+      .name = "ID_MODEL_ENC", .type = ATA_FIELD_STR, .flags = ATA_FIELD_VPD,
+      .str_offset = offsetof ( struct ata_disk_info, model_enc ),
+   },
+   {
+      .name = "ID_REVISION", .type = ATA_FIELD_STR, .flags = ATA_FIELD_VPD,
+      .str_offset = offsetof ( struct ata_disk_info, revision ),
+   },
+#endif
+   ATA_FIELD_FN (
+      "ID_SERIAL", ATA_FIELD_MDEV | ATA_FIELD_VPD, ata_field_serial
+   ),
+#if !(ENABLE_MINIMAL)
+   ATA_FIELD_FN ( "ID_SERIAL_SHORT", ATA_FIELD_VPD, ata_field_serial_short ),
 
-   if ( has_wwn ( pinfo->identify ) != 0 ) {
-      uint64_t wwn = get_wwn ( pinfo->identify );
+   ATA_FEATURE_SET ( "ID_ATA_WRITE_CACHE", 82, 5, 85 ),
+   /*
+    * TODO: use the READ NATIVE MAX ADDRESS command to get the native max address
+    * so it is easy to check whether the protected area is in use.
+    */
+   ATA_FEATURE_SET ( "ID_ATA_FEATURE_SET_HPA", 82, 10, 85 ),
+   ATA_FEATURE_SET ( "ID_ATA_FEATURE_SET_PM", 82, 3, 85 ),
+
+   ATA_FEATURE_SET ( "ID_ATA_FEATURE_SET_SECURITY", 82, 1, 85 ),
+   /* word 89: time required for SECURITY ERASE UNIT */
+   {
+      .name = "ID_ATA_FEATURE_SET_SECURITY_ERASE_UNIT_MIN",
+      .type = ATA_FIELD_UINT, ATA_IDENTIFY_BIT ( 82, 1 ),
+      .val_word = 89, .val_mask = 0xffff, .val_mul = 2,
+   },
+   /* word 128: device lock function */
+   {
+      .name = "ID_ATA_FEATURE_SET_SECURITY_LEVEL",
+      .type = ATA_FIELD_FUNC, ATA_IDENTIFY_BIT ( 82, 1 ),
+      .cond2_word = 85, .cond2_mask = (1<<1),
+      .func = ata_field_security_level,
+   },
+   {
+      .name = "ID_ATA_FEATURE_SET_SECURITY_ENHANCED_ERASE_UNIT_MIN",
+      .type = ATA_FIELD_UINT, ATA_IDENTIFY_BIT ( 82, 1 ),
+      .cond2_word = 128, .cond2_mask = (1<<5),
+      .val_word = 90, .val_mask = 0xffff, .val_mul = 2,
+   },
+   {
+      .name = "ID_ATA_FEATURE_SET_SECURITY_EXPIRE",
+      .type = ATA_FIELD_CONST, .value = "1", ATA_IDENTIFY_BIT ( 82, 1 ),
+      .cond2_word = 128, .cond2_mask = (1<<4),
+   },
+   {
+      .name = "ID_ATA_FEATURE_SET_SECURITY_FROZEN",
+      .type = ATA_FIELD_CONST, .value = "1", ATA_IDENTIFY_BIT ( 82, 1 ),
+      .cond2_word = 128, .cond2_mask = (1<<3),
+   },
+   {
+      .name = "ID_ATA_FEATURE_SET_SECURITY_LOCKED",
+      .type = ATA_FIELD_CONST, .value = "1", ATA_IDENTIFY_BIT ( 82, 1 ),
+      .cond2_word = 128, .cond2_mask = (1<<2),
+   },
+
+   ATA_FEATURE_SET ( "ID_ATA_FEATURE_SET_SMART", 82, 0, 85 ),
+
+   ATA_FEATURE_SET ( "ID_ATA_FEATURE_SET_AAM", 83, 9, 86 ),
+   /* word 94: current AAM value */
+   {
+      .name = "ID_ATA_FEATURE_SET_AAM_VENDOR_RECOMMENDED_VALUE",
+      .type = ATA_FIELD_UINT, ATA_IDENTIFY_BIT ( 83, 9 ),
+      .val_word = 94, .val_shift = 8, .val_mask = 0xff, .val_mul = 1,
+   },
+   {
+      .name = "ID_ATA_FEATURE_SET_AAM_CURRENT_VALUE",
+      .type = ATA_FIELD_UINT, ATA_IDENTIFY_BIT ( 83, 9 ),
+      .val_word = 94, .val_mask = 0xff, .val_mul = 1,
+   },
+
+   ATA_FEATURE_SET ( "ID_ATA_FEATURE_SET_PUIS", 83, 5, 86 ),
+
+   ATA_FEATURE_SET ( "ID_ATA_FEATURE_SET_APM", 83, 3, 86 ),
+   /* word 91: current APM values */
+   {
+      .name = "ID_ATA_FEATURE_SET_APM_CURRENT_VALUE",
+      .type = ATA_FIELD_UINT, ATA_IDENTIFY_BIT ( 83, 3 ),
+      .cond2_word = 86, .cond2_mask = (1<<3),
+      .val_word = 91, .val_mask = 0xff, .val_mul = 1,
+   },
+
+   {
+      .name = "ID_ATA_DOWNLOAD_MICROCODE",
+      .type = ATA_FIELD_CONST, .value = "1", ATA_IDENTIFY_BIT ( 83, 0 ),
+   },
+
+   ATA_FIELD_FN ( "ID_ATA_SATA", 0, ata_field_sata ),
+   ATA_FIELD_FN ( "ID_ATA_SATA_SIGNAL_RATE_GEN2", 0, ata_field_sata_gen2 ),
+   ATA_FIELD_FN ( "ID_ATA_SATA_SIGNAL_RATE_GEN1", 0, ata_field_sata_gen1 ),
+   ATA_FIELD_FN ( "ID_ATA_ROTATION_RATE_RPM", 0, ata_field_rotation_rate ),
+   ATA_FIELD_FN ( "ID_WWN", ATA_FIELD_VPD, ata_field_wwn ),
+#endif
+   ATA_FIELD_FN (
+      "ID_WWN_WITH_EXTENSION", ATA_FIELD_MDEV | ATA_FIELD_VPD, ata_field_wwn
+   ),
+#if !(ENABLE_MINIMAL)
+   ATA_FIELD_FN ( "ID_ATA_CFA", 0, ata_field_cfa ),
+#endif
+};
 
-      printf("%sID_WWN=0x%llx\n", prefix, (unsigned long long int) wwn);
-      /* ATA devices have no vendor extension */
-      printf("%sID_WWN_WITH_EXTENSION=0x%llx\n", prefix, (unsigned long long int) wwn);
-   }
+#define ATA_FIELD_COUNT ( sizeof ata_fields / sizeof *ata_fields )
 
-   /* from Linux's include/linux/ata.h */
-   if (identify_words[0] == 0x848a || identify_words[0] == 0x844a) {
-      printf("%sID_ATA_CFA=1\n", prefix);
-   } else if ((identify_words[83] & 0xc004) == 0x4004) {
-      printf("%sID_ATA_CFA=1\n", prefix);
-   }
 
-   return 0;
+static inline int ata_field_cond (
+   const struct ata_field* const f, const uint16_t* const words
+) {
+   return (
+      ( words[f->cond_word]  & f->cond_mask )  == f->cond_mask &&
+      ( words[f->cond2_word] & f->cond2_mask ) == f->cond2_mask
+   );
 }
 
 int print_ata_id_vars (
    const struct disk_info* const node,
    const struct ata_disk_info* const pinfo,
    unsigned const int mdev_export,
-   const char* const prefix
+   struct out_buf* const out
 ) {
-   if ( mdev_export == 0 ) {
-      return print_ata_id_vars__extended ( node, pinfo, prefix );
-   } else {
-      return print_mdev_ata_id_vars ( node, pinfo, mdev_export, prefix );
+   const uint16_t* const words = (const uint16_t*) &(pinfo->id);
+   const unsigned int flags    = ( mdev_export ) ? ATA_FIELD_MDEV : 0;
+   const struct ata_field* f;
+   size_t k;
+
+   for ( k = 0; k < ATA_FIELD_COUNT; k++ ) {
+      f = &ata_fields[k];
+
+      if (
+         (f->flags & flags) != flags ||
+         !out_var_wanted ( out, f->name ) ||
+         !ata_field_cond ( f, words )
+      ) {
+         continue;
+      }
+
+      switch ( f->type ) {
+         case ATA_FIELD_CONST:
+            out_var_str ( out, f->name, f->value );
+            break;
+
+         case ATA_FIELD_BOOL:
+            out_var_str (
+               out, f->name, ( words[f->val_word] & f->val_mask ) ? "1" : "0"
+            );
+            break;
+
+         case ATA_FIELD_UINT:
+            out_var_uint (
+               out, f->name,
+               (uint64_t)(
+                  ( words[f->val_word] >> f->val_shift ) & f->val_mask
+               ) * f->val_mul
+            );
+            break;
+
+         case ATA_FIELD_STR:
+            out_var_str (
+               out, f->name, (const char*) pinfo + f->str_offset
+            );
+            break;
+
+         case ATA_FIELD_FUNC:
+            f->func ( f, pinfo, out );
+            break;
+      }
    }
+
+   return 0;
 }
-#endif
 
+int ata_id_fields_need_identify ( const struct out_fields* const fields ) {
+   size_t k;
 
-static void disk_identify_get_string (
-   uint8_t const identify[512],
-   unsigned int offset_words,
-   char* dest, size_t dest_len
-) {
-   unsigned int c1;
-   unsigned int c2;
-
-   while (dest_len > 0) {
-      c1 = identify[offset_words * 2 + 1];
-      c2 = identify[offset_words * 2];
-      *dest = (char)c1;
-      dest++;
-      *dest = (char)c2;
-      dest++;
-      offset_words++;
-      dest_len -= 2;
+   for ( k = 0; k < ATA_FIELD_COUNT; k++ ) {
+      if (
+         !(ata_fields[k].flags & ATA_FIELD_VPD) &&
+         out_fields_has ( fields, ata_fields[k].name )
+      ) {
+         return 1;
+      }
    }
+   return 0;
 }
 
-static void disk_identify_fixup_string (
-   uint8_t const identify[512], unsigned int offset_words, const size_t len
-) {
-   disk_identify_get_string (
-      identify, offset_words,
-      (char *) identify + offset_words * 2, len
-   );
-}
 
-static void disk_identify_fixup_uint16 (
-   uint8_t const identify[512], const unsigned int offset_words
+size_t ata_id_init_cdb (
+   const enum ata_id_command cmd, uint8_t cdb[16], const size_t buf_len
 ) {
-   uint16_t *p;
+   memzero ( cdb, 16 );
+
+   switch ( cmd ) {
+      case ATA_ID_CMD_INQUIRY:
+         /*
+          * INQUIRY, see SPC-4 section 6.4
+          */
+         cdb[0] = 0x12;                /* OPERATION CODE: INQUIRY */
+         cdb[3] = (buf_len >> 8);      /* ALLOCATION LENGTH */
+         cdb[4] = (buf_len & 0xff);
+         return 6;
+
+      case ATA_ID_CMD_IDENTIFY:
+         /*
+          * ATA Pass-Through 12 byte command, as described in
+          *
+          *  T10 04-262r8 ATA Command Pass-Through
+          *
+          * from http://www.t10.org/ftp/t10/document.04/04-262r8.pdf
+          */
+         cdb[0] = 0xa1;     /* OPERATION CODE: 12 byte pass through */
+         cdb[1] = 4 << 1;   /* PROTOCOL: PIO Data-in */
+         cdb[2] = 0x2e;     /* OFF_LINE=0, CK_COND=1, T_DIR=1, BYT_BLOK=1, T_LENGTH=2 */
+         cdb[3] = 0;        /* FEATURES */
+         cdb[4] = 1;        /* SECTORS */
+         cdb[5] = 0;        /* LBA LOW */
+         cdb[6] = 0;        /* LBA MID */
+         cdb[7] = 0;        /* LBA HIGH */
+         cdb[8] = 0 & 0x4F; /* SELECT */
+         cdb[9] = 0xEC;     /* Command: ATA IDENTIFY DEVICE */
+         return 12;
+
+      case ATA_ID_CMD_IDENTIFY_PACKET:
+         /*
+          * ATA Pass-Through 16 byte command, as described in
+          *
+          *  T10 04-262r8 ATA Command Pass-Through
+          *
+          * from http://www.t10.org/ftp/t10/document.04/04-262r8.pdf
+          */
+         cdb[0]  = 0x85;    /* OPERATION CODE: 16 byte pass through */
+         cdb[1]  = 4 << 1;  /* PROTOCOL: PIO Data-in */
+         cdb[2]  = 0x2e;    /* OFF_LINE=0, CK_COND=1, T_DIR=1, BYT_BLOK=1, T_LENGTH=2 */
+         cdb[3]  = 0;       /* FEATURES */
+         cdb[4]  = 0;       /* FEATURES */
+         cdb[5]  = 0;       /* SECTORS */
+         cdb[6]  = 1;       /* SECTORS */
+         cdb[7]  = 0;       /* LBA LOW */
+         cdb[8]  = 0;       /* LBA LOW */
+         cdb[9]  = 0;       /* LBA MID */
+         cdb[10] = 0;       /* LBA MID */
+         cdb[11] = 0;       /* LBA HIGH */
+         cdb[12] = 0;       /* LBA HIGH */
+         cdb[13] = 0;       /* DEVICE */
+         cdb[14] = 0xA1;    /* Command: ATA IDENTIFY PACKET DEVICE */
+         cdb[15] = 0;       /* CONTROL */
+         return 16;
+   }
 
-   p = (uint16_t *) identify;
-   p[offset_words] = le16toh (p[offset_words]);
+   return 0;
 }
 
-static int disk_identify_command (
-   const int fd, void* const buf, const size_t buf_len
-) {
-   uint8_t cdb[12] = {
-      /*
-       * ATA Pass-Through 12 byte command, as described in
-       *
-       *  T10 04-262r8 ATA Command Pass-Through
-       *
-       * from http://www.t10.org/ftp/t10/document.04/04-262r8.pdf
-      */
-      [0] = 0xa1,     /* OPERATION CODE: 12 byte pass through */
-      [1] = 4 << 1,   /* PROTOCOL: PIO Data-in */
-      [2] = 0x2e,     /* OFF_LINE=0, CK_COND=1, T_DIR=1, BYT_BLOK=1, T_LENGTH=2 */
-      [3] = 0,        /* FEATURES */
-      [4] = 1,        /* SECTORS */
-      [5] = 0,        /* LBA LOW */
-      [6] = 0,        /* LBA MID */
-      [7] = 0,        /* LBA HIGH */
-      [8] = 0 & 0x4F, /* SELECT */
-      [9] = 0xEC,     /* Command: ATA IDENTIFY DEVICE */
-   };
-
-   uint8_t sense[32] = {0};
-   uint8_t *desc = sense + 8;
-   struct sg_io_v4 io_v4 = {
-      .guard = 'Q',
-      .protocol = BSG_PROTOCOL_SCSI,
-      .subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD,
-      .request_len = sizeof(cdb),
-      .request = (uintptr_t) cdb,
-      .max_response_len = sizeof(sense),
-      .response = (uintptr_t) sense,
-      .din_xfer_len = buf_len,
-      .din_xferp = (uintptr_t) buf,
-      .timeout = COMMAND_TIMEOUT_MSEC,
-   };
-   int ret;
+int ata_id_sense_ok ( const uint8_t* const sense ) {
+   /* descriptor format sense data with an ATA Status Return descriptor */
+   const uint8_t* const desc = sense + 8;
 
-   ret = ioctl(fd, SG_IO, &io_v4);
-   if (ret != 0) {
-      /* could be that the driver doesn't do version 4, try version 3 */
-      if (errno == EINVAL) {
-         struct sg_io_hdr io_hdr = {
-            .interface_id = 'S',
-            .cmdp = (unsigned char*) cdb,
-            .cmd_len = sizeof (cdb),
-            .dxferp = buf,
-            .dxfer_len = buf_len,
-            .sbp = sense,
-            .mx_sb_len = sizeof (sense),
-            .dxfer_direction = SG_DXFER_FROM_DEV,
-            .timeout = COMMAND_TIMEOUT_MSEC,
-         };
-
-         ret = ioctl(fd, SG_IO, &io_hdr);
-         if (ret != 0) {
-            return ret;
-         }
-      } else {
-         return ret;
-      }
-  }
+   return (sense[0] == 0x72 && desc[0] == 0x9 && desc[1] == 0x0c) ? 1 : 0;
+}
 
-   if (!(sense[0] == 0x72 && desc[0] == 0x9 && desc[1] == 0x0c)) {
-      errno = EIO;
-      return -1;
-   }
+int ata_identify_is_empty ( const uint8_t identify[512] ) {
+   uint64_t acc;
+   uint64_t word;
+   size_t k;
 
-   return 0;
+   acc = 0;
+   for ( k = 0; k < 512; k += sizeof word ) {
+      memcpy ( &word, identify + k, sizeof word );
+      acc |= word;
+   }
+   return ( acc == 0 ) ? 1 : 0;
 }
 
-
-static int disk_scsi_inquiry_command (
-   const int fd, void* const buf, const size_t buf_len
+/*
+ * IDENTIFY words that hold ATA strings (two chars per word, the first one
+ * in the high byte), sorted
+ */
+static const struct {
+   uint8_t first;
+   uint8_t count;
+} ata_identify_strings[] = {
+   {  10, 10 }, /* serial number */
+   {  23, 24 }, /* firmware revision (23-26) and model number (27-46) */
+};
+
+#define ATA_IDENTIFY_STRING_COUNT \
+   ( sizeof ata_identify_strings / sizeof *ata_identify_strings )
+
+/* swaps the two bytes of each of the words [first, first + count) */
+static inline void ata_identify_swap16 (
+   uint8_t* const identify, const unsigned int first, const unsigned int count
 ) {
-   uint8_t cdb[6] = {
-      /*
-      * INQUIRY, see SPC-4 section 6.4
-      */
-      [0] = 0x12,                /* OPERATION CODE: INQUIRY */
-      [3] = (buf_len >> 8),      /* ALLOCATION LENGTH */
-      [4] = (buf_len & 0xff),
-   };
-   uint8_t sense[32] = {0};
-   struct sg_io_v4 io_v4 = {
-      .guard = 'Q',
-      .protocol = BSG_PROTOCOL_SCSI,
-      .subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD,
-      .request_len = sizeof(cdb),
-      .request = (uintptr_t) cdb,
-      .max_response_len = sizeof(sense),
-      .response = (uintptr_t) sense,
-      .din_xfer_len = buf_len,
-      .din_xferp = (uintptr_t) buf,
-      .timeout = COMMAND_TIMEOUT_MSEC,
-   };
-   int ret;
+   uint8_t* p             = identify + 2 * first;
+   uint8_t* const end     = p + 2 * count;
+   uint8_t tmp;
+#if defined(__SSE2__)
+   __m128i v;
+
+   for ( ; p + 16 <= end; p += 16 ) {
+      v = _mm_loadu_si128 ( (const __m128i*) p );
+      v = _mm_or_si128 ( _mm_slli_epi16 ( v, 8 ), _mm_srli_epi16 ( v, 8 ) );
+      _mm_storeu_si128 ( (__m128i*) p, v );
+   }
+#endif
 
-   ret = ioctl(fd, SG_IO, &io_v4);
-   if (ret != 0) {
-      /* could be that the driver doesn't do version 4, try version 3 */
-      if (errno == EINVAL) {
-         struct sg_io_hdr io_hdr = {
-            .interface_id = 'S',
-            .cmdp = (unsigned char*) cdb,
-            .cmd_len = sizeof (cdb),
-            .dxferp = buf,
-            .dxfer_len = buf_len,
-            .sbp = sense,
-            .mx_sb_len = sizeof(sense),
-            .dxfer_direction = SG_DXFER_FROM_DEV,
-            .timeout = COMMAND_TIMEOUT_MSEC,
-         };
-
-         ret = ioctl(fd, SG_IO, &io_hdr);
-         if (ret != 0) {
-            return ret;
-         }
-
-         /* even if the ioctl succeeds, we need to check the return value */
-         if ( !(
-               io_hdr.status        == 0 &&
-               io_hdr.host_status   == 0 &&
-               io_hdr.driver_status == 0
-         ) ) {
-            errno = EIO;
-            return -1;
-         }
-      } else {
-         return ret;
-      }
+   for ( ; p < end; p += 2 ) {
+      tmp  = p[0];
+      p[0] = p[1];
+      p[1] = tmp;
    }
+}
 
-   /* even if the ioctl succeeds, we need to check the return value */
-   if ( !(
-      io_v4.device_status    == 0 &&
-      io_v4.transport_status == 0 &&
-      io_v4.driver_status    == 0
-   ) ) {
-      errno = EIO;
-      return -1;
+/*
+ * The disk sends little endian words. Its strings have the first char of
+ * each pair in the high byte of a word, so they need to be swapped on any
+ * host. On little endian hosts, the other words are fine as they are,
+ * whereas on big endian hosts, all words get swapped.
+ */
+void ata_identify_fixup_byte_order ( uint8_t identify[512] ) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+   size_t k;
+
+   for ( k = 0; k < ATA_IDENTIFY_STRING_COUNT; k++ ) {
+      ata_identify_swap16 (
+         identify, ata_identify_strings[k].first, ata_identify_strings[k].count
+      );
    }
+#else
+   ata_identify_swap16 ( identify, 0, 256 );
+#endif
+}
 
-   return 0;
+void ata_disk_info_fixup_identify ( struct ata_disk_info* const pinfo ) {
+   ata_identify_fixup_byte_order ( pinfo->identify );
+
+   /* copy it into the hd_driveid struct for convenience */
+   memcpy(&(pinfo->id), pinfo->identify, sizeof pinfo->id);
+   pinfo->has_identify = 1;
 }
 
-static int disk_identify_packet_device_command (
-   const int fd, void* const buf, const size_t buf_len
+void ata_disk_info_get_raw_identify (
+   const struct ata_disk_info* const pinfo, uint8_t identify[512]
 ) {
-   uint8_t cdb[16] = {
-      /*
-      * ATA Pass-Through 16 byte command, as described in
-      *
-      *  T10 04-262r8 ATA Command Pass-Through
-      *
-      * from http://www.t10.org/ftp/t10/document.04/04-262r8.pdf
-      */
-      [0] = 0x85,   /* OPERATION CODE: 16 byte pass through */
-      [1] = 4 << 1, /* PROTOCOL: PIO Data-in */
-      [2] = 0x2e,   /* OFF_LINE=0, CK_COND=1, T_DIR=1, BYT_BLOK=1, T_LENGTH=2 */
-      [3] = 0,      /* FEATURES */
-      [4] = 0,      /* FEATURES */
-      [5] = 0,      /* SECTORS */
-      [6] = 1,      /* SECTORS */
-      [7] = 0,      /* LBA LOW */
-      [8] = 0,      /* LBA LOW */
-      [9] = 0,      /* LBA MID */
-      [10] = 0,     /* LBA MID */
-      [11] = 0,     /* LBA HIGH */
-      [12] = 0,     /* LBA HIGH */
-      [13] = 0,     /* DEVICE */
-      [14] = 0xA1,  /* Command: ATA IDENTIFY PACKET DEVICE */
-      [15] = 0,     /* CONTROL */
-   };
-   uint8_t sense[32] = {0};
-   uint8_t *desc = sense + 8;
-   struct sg_io_v4 io_v4 = {
-      .guard = 'Q',
-      .protocol = BSG_PROTOCOL_SCSI,
-      .subprotocol = BSG_SUB_PROTOCOL_SCSI_CMD,
-      .request_len = sizeof (cdb),
-      .request = (uintptr_t) cdb,
-      .max_response_len = sizeof (sense),
-      .response = (uintptr_t) sense,
-      .din_xfer_len = buf_len,
-      .din_xferp = (uintptr_t) buf,
-      .timeout = COMMAND_TIMEOUT_MSEC,
-   };
-   int ret;
+   memcpy ( identify, pinfo->identify, 512 );
+   ata_identify_fixup_byte_order ( identify );
+}
 
-   ret = ioctl(fd, SG_IO, &io_v4);
-
-   if (ret != 0) {
-      /* could be that the driver doesn't do version 4, try version 3 */
-      if (errno == EINVAL) {
-         struct sg_io_hdr io_hdr = {
-            .interface_id = 'S',
-            .cmdp = (unsigned char*) cdb,
-            .cmd_len = sizeof (cdb),
-            .dxferp = buf,
-            .dxfer_len = buf_len,
-            .sbp = sense,
-            .mx_sb_len = sizeof (sense),
-            .dxfer_direction = SG_DXFER_FROM_DEV,
-            .timeout = COMMAND_TIMEOUT_MSEC,
-         };
-
-         ret = ioctl(fd, SG_IO, &io_hdr);
-         if (ret != 0) {
-            return ret;
-         }
-      } else {
-         return ret;
-      }
-   }
+void ata_disk_info_from_identify (
+   struct ata_disk_info* const pinfo, const uint8_t identify[512]
+) {
+   *pinfo = (struct ata_disk_info){ .is_packet_device = 0 };
+   memcpy ( pinfo->identify, identify, 512 );
 
-   if (!(sense[0] == 0x72 && desc[0] == 0x9 && desc[1] == 0x0c)) {
-          errno = EIO;
-          return -1;
-   }
+   /* word 0, bits 15:14 = 10b: IDENTIFY PACKET DEVICE data */
+   pinfo->is_packet_device = ( ( identify[1] & 0xc0 ) == 0x80 ) ? 1 : 0;
 
-   return 0;
+   ata_disk_info_fixup_identify ( pinfo );
+   ata_disk_info_set_strings ( pinfo );
+}
+
+void ata_disk_info_set_strings ( struct ata_disk_info* const pinfo ) {
+   pinfo->identify_words = (uint16_t*) pinfo->identify;
+
+   /* ID_MODEL_ENC is the model as sent by the disk, whitespace included */
+   util_normalize_string (
+      (const char*)(pinfo->id.model), 40,
+      pinfo->model, pinfo->model_enc, sizeof pinfo->model_enc
+   );
+   util_normalize_string (
+      (const char*)(pinfo->id.serial_no), 20, pinfo->serial, NULL, 0
+   );
+   util_normalize_string (
+      (const char*)(pinfo->id.fw_rev), 8, pinfo->revision, NULL, 0
+   );
 }
 
 static int disk_identify (
-   const struct disk_info* const node,
+   struct disk_info* const node,
    struct ata_disk_info* const pinfo
 ) {
    int ret;
-   uint8_t inquiry_buf[36];
    int peripheral_device_type;
-   int all_nul_bytes;
-   int n;
    int is_packet_device = 0;
 
    /* init results */
@@ -619,24 +753,26 @@ static int disk_identify (
    * the original bug-fix and see http://bugs.debian.org/cgi-bin/bugreport.cgi?bug=556635
    * for the original bug-report.)
    */
-   ret = disk_scsi_inquiry_command (
-      node->fd, inquiry_buf, sizeof *inquiry_buf
-   );
-   if (ret != 0) {
-      goto out;
+   if ( node->inquiry_len == 0 ) {
+      ret = disk_cmd_inquiry (
+         node, -1, node->inquiry, sizeof node->inquiry
+      );
+      if (ret != 0) {
+         goto out;
+      }
+      /* remembered for the SCSI backend */
+      node->inquiry_len = sizeof node->inquiry;
    }
 
    /* SPC-4, section 6.4.2: Standard INQUIRY data */
-   peripheral_device_type = inquiry_buf[0] & 0x1f;
+   peripheral_device_type = node->inquiry[0] & 0x1f;
    if (peripheral_device_type == 0x05) {
       is_packet_device = 1;
-      ret = disk_identify_packet_device_command (
-         node->fd, pinfo->identify, 512
-      );
+      ret = disk_cmd_identify_packet ( node, pinfo->identify, 512 );
 
    } else if (peripheral_device_type == 0x00) {
       /* OK, now issue the IDENTIFY DEVICE command */
-      ret = disk_identify_command ( node->fd, pinfo->identify, 512 );
+      ret = disk_cmd_identify ( node, pinfo->identify, 512 );
       if (ret != 0) {
          goto out;
       }
@@ -648,15 +784,7 @@ static int disk_identify (
 
 
    /* Check if IDENTIFY data is all NUL bytes - if so, bail */
-   all_nul_bytes = 1;
-   for (n = 0; n < 512; n++) {
-      if (pinfo->identify[n] != '\0') {
-         all_nul_bytes = 0;
-         break;
-      }
-   }
-
-   if (all_nul_bytes) {
+   if (ata_identify_is_empty(pinfo->identify)) {
       ret = -1;
       errno = EIO;
       goto out;
@@ -667,76 +795,68 @@ out:
    return ret;
 }
 
-static inline void transfer_id_data (
-   const char* const str, char* const to, size_t len
-) {
-   util_replace_whitespace ( str, to, len );
-   util_replace_chars ( to, NULL );
-}
 
-
-int is_ata_disk (
+/*
+ * Copies a probed disk info to node's arena, so that failed probes of
+ * non-ATA devices do not use up arena space. Returns 1 on success.
+ */
+static int ata_disk_info_dup (
    const struct disk_info* const node,
+   const struct ata_disk_info* const info,
    struct ata_disk_info** const pinfo
 ) {
-   struct ata_disk_info* my_info = NULL;
-   my_info  = malloc ( sizeof *my_info );
+   struct ata_disk_info* const my_info = arena_alloc (
+      node->arena, sizeof *my_info
+   );
+
    if ( my_info == NULL ) {
       return 0;
    }
-   *my_info = (struct ata_disk_info){ .is_packet_device = 0 };
-
-
-   if ( disk_identify ( node, my_info ) == 0 ) {
-      /*
-       * fix up only the fields from the IDENTIFY data that we are going to
-       * use and copy it into the hd_driveid struct for convenience
-      */
-      disk_identify_fixup_string(my_info->identify,  10, 20); /* serial */
-      disk_identify_fixup_string(my_info->identify,  23,  8); /* fwrev */
-      disk_identify_fixup_string(my_info->identify,  27, 40); /* model */
-      disk_identify_fixup_uint16(my_info->identify,  0);      /* configuration */
-      disk_identify_fixup_uint16(my_info->identify,  75);     /* queue depth */
-      disk_identify_fixup_uint16(my_info->identify,  75);     /* SATA capabilities */
-      disk_identify_fixup_uint16(my_info->identify,  82);     /* command set supported */
-      disk_identify_fixup_uint16(my_info->identify,  83);     /* command set supported */
-      disk_identify_fixup_uint16(my_info->identify,  84);     /* command set supported */
-      disk_identify_fixup_uint16(my_info->identify,  85);     /* command set supported */
-      disk_identify_fixup_uint16(my_info->identify,  86);     /* command set supported */
-      disk_identify_fixup_uint16(my_info->identify,  87);     /* command set supported */
-      disk_identify_fixup_uint16(my_info->identify,  89);     /* time required for SECURITY ERASE UNIT */
-      disk_identify_fixup_uint16(my_info->identify,  90);     /* time required for enhanced SECURITY ERASE UNIT */
-      disk_identify_fixup_uint16(my_info->identify,  91);     /* current APM values */
-      disk_identify_fixup_uint16(my_info->identify,  94);     /* current AAM value */
-      disk_identify_fixup_uint16(my_info->identify, 128);     /* device lock function */
-      disk_identify_fixup_uint16(my_info->identify, 217);     /* nominal media rotation rate */
-      memcpy(&(my_info->id), my_info->identify, sizeof my_info->id);
+
+   *my_info = *info;
+   if ( info->identify_words != NULL ) {
+      my_info->identify_words = (uint16_t*) my_info->identify;
    }
-   /* If this fails, then try HDIO_GET_IDENTITY */
-   else if (ioctl(node->fd, HDIO_GET_IDENTITY, &(my_info->id)) != 0) {
-      free ( my_info );
-      return 0;
+
+   *pinfo = my_info;
+   return 1;
+}
+
+int is_ata_disk (
+   struct disk_info* const node,
+   struct ata_disk_info** const pinfo
+) {
+   struct ata_disk_info info;
+
+   info = (struct ata_disk_info){ .is_packet_device = 0 };
+
+   /* a cached disk identity does not require any command */
+   if ( id_cache_lookup ( node->cache, node->fd, &info ) == 0 ) {
+      return ata_disk_info_dup ( node, &info, pinfo );
    }
-   my_info->identify_words = (uint16_t*) my_info->identify;
 
-   memcpy ( my_info->model, my_info->id.model, 40 );
-   my_info->model[40] = '\0';
-   encode_devnode_name (
-      my_info->model, my_info->model_enc, sizeof my_info->model_enc
-   );
+   /* sysfs results are not cached, reading them is cheap anyway */
+   if ( ata_sysfs_probe ( node, &info ) == 0 ) {
+      return ata_disk_info_dup ( node, &info, pinfo );
 
-   transfer_id_data (
-      (const char* const)(my_info->id.model), my_info->model, 40
-   );
-   transfer_id_data (
-      (const char* const)(my_info->id.serial_no), my_info->serial, 20
-   );
-   transfer_id_data (
-      (const char* const)(my_info->id.fw_rev), my_info->revision, 8
-   );
+   } else if ( node->source == ID_SOURCE_SYSFS ) {
+      return 0;
+   }
 
-   *pinfo = my_info;
-   return 1;
+   if ( disk_identify ( node, &info ) == 0 ) {
+      ata_disk_info_fixup_identify ( &info );
+   }
+   /*
+    * If this fails, then try HDIO_GET_IDENTITY
+    * (unless the disk has not answered at all, see disk_cmd_run())
+    */
+   else if ( disk_cmd_hdio_identity ( node, &(info.id) ) != 0 ) {
+      return 0;
+   }
+   ata_disk_info_set_strings ( &info );
+   id_cache_store ( node->cache, node->fd, &info );
+
+   return ata_disk_info_dup ( node, &info, pinfo );
 }
 
 
@@ -766,32 +886,51 @@ static uint64_t get_wwn ( const uint8_t* const identify ) {
    return wwn;
 }
 
-static inline int print_mdev_ata_id_vars (
-   const struct disk_info* const node,
-   const struct ata_disk_info* const pinfo,
-   unsigned const int mdev_export,
-   const char* const prefix
+int ata_disk_info_get_serial (
+   const struct ata_disk_info* const pinfo, char* const buf, const size_t len
 ) {
-   /* in --mdev(1) mode, print only
-    * ID_BUS
-    * ID_SERIAL
-    * ID_WWN_WITH_EXTENSION
-    */
-   printf("%sID_BUS=ata\n", prefix);
+   int ret;
+
    if (pinfo->serial[0] != '\0') {
-      printf("%sID_SERIAL=%s_%s\n", prefix, pinfo->model, pinfo->serial);
+      ret = snprintf ( buf, len, "%s_%s", pinfo->model, pinfo->serial );
    } else {
-      printf("%sID_SERIAL=%s\n", prefix, pinfo->model);
+      ret = snprintf ( buf, len, "%s", pinfo->model );
    }
 
-   if ( has_wwn ( pinfo->identify ) != 0 ) {
-      uint64_t wwn = get_wwn ( pinfo->identify );
+   return ( ret >= 0 && (size_t)ret < len ) ? 0 : -1;
+}
 
-      /* ATA devices have no vendor extension */
-      printf (
-         "%sID_WWN_WITH_EXTENSION=0x%llx\n", prefix,
-         (unsigned long long int) wwn
-      );
+int ata_disk_info_get_wwn (
+   const struct ata_disk_info* const pinfo, uint64_t* const wwn
+) {
+   if ( has_wwn ( pinfo->identify ) == 0 ) {
+      return -1;
    }
+
+   *wwn = get_wwn ( pinfo->identify );
    return 0;
 }
+
+void ata_id_get_record (
+   const struct ata_disk_info* const pinfo, struct out_record* const rec
+) {
+   uint64_t wwn;
+
+   rec->type     = DISK_TYPE_ATA;
+   rec->flags    = 0;
+   rec->model    = pinfo->model;
+   rec->serial   = pinfo->serial;
+   rec->revision = pinfo->revision;
+   rec->wwn[0]   = '\0';
+
+   if ( ata_disk_info_get_wwn ( pinfo, &wwn ) == 0 ) {
+      snprintf (
+         rec->wwn, sizeof rec->wwn, "0x%llx", (unsigned long long int) wwn
+      );
+   }
+
+   if ( pinfo->has_identify ) {
+      ata_disk_info_get_raw_identify ( pinfo, rec->identify );
+      rec->flags |= OUT_BIN_FLAG_IDENTIFY;
+   }
+}
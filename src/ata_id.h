@@ -66,15 +66,26 @@
 #include <linux/hdreg.h>
 
 #include "disk_type.h"
+#include "out_buf.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define COMMAND_TIMEOUT_MSEC (30 * 1000)
+
+enum ata_id_command {
+   ATA_ID_CMD_INQUIRY,
+   ATA_ID_CMD_IDENTIFY,
+   ATA_ID_CMD_IDENTIFY_PACKET,
+};
+
 struct ata_disk_info {
    uint8_t     identify[512];
    uint16_t*   identify_words;
    int         is_packet_device;
+   /* identify holds (fixed up) IDENTIFY [PACKET] DEVICE data */
+   int         has_identify;
    char        model[41];
    char        model_enc[256];
    char        serial[21];
@@ -83,15 +94,64 @@ struct ata_disk_info {
 };
 
 int is_ata_disk (
-   const struct disk_info* const node,
+   struct disk_info* const node,
    struct ata_disk_info** const pinfo
 );
 
+/*
+ * building blocks of is_ata_disk(), for probing devices without
+ * the blocking SG_IO ioctl
+ */
+
+/* writes the cdb for cmd to cdb and returns its length */
+size_t ata_id_init_cdb (
+   const enum ata_id_command cmd, uint8_t cdb[16], const size_t buf_len
+);
+/* whether the sense data of an IDENTIFY [PACKET] DEVICE cmd is valid */
+int  ata_id_sense_ok              ( const uint8_t* const sense );
+int  ata_identify_is_empty        ( const uint8_t identify[512] );
+/*
+ * IDENTIFY data as sent by the disk to host byte order words and strings
+ * in char order, in place. Applying it twice restores the original data.
+ */
+void ata_identify_fixup_byte_order ( uint8_t identify[512] );
+void ata_disk_info_fixup_identify ( struct ata_disk_info* const pinfo );
+void ata_disk_info_set_strings    ( struct ata_disk_info* const pinfo );
+/* pinfo->identify as sent by the disk, i.e. before the fixup */
+void ata_disk_info_get_raw_identify (
+   const struct ata_disk_info* const pinfo, uint8_t identify[512]
+);
+/* decodes IDENTIFY data as sent by the disk, without any device */
+void ata_disk_info_from_identify (
+   struct ata_disk_info* const pinfo, const uint8_t identify[512]
+);
+
 int print_ata_id_vars (
    const struct disk_info* const node,
    const struct ata_disk_info* const pinfo,
    unsigned const int mdev_export,
-   const char* const prefix
+   struct out_buf* const out
+);
+
+/*
+ * Whether any of the selected variables (NULL: all) needs full
+ * IDENTIFY data, as opposed to what sysfs' vpd_pg83 provides.
+ */
+int ata_id_fields_need_identify ( const struct out_fields* const fields );
+
+/* ID_SERIAL, returns 0 on success */
+int ata_disk_info_get_serial (
+   const struct ata_disk_info* const pinfo, char* const buf, const size_t len
+);
+
+/* ID_WWN_WITH_EXTENSION, returns 0 if the disk has a WWN */
+int ata_disk_info_get_wwn (
+   const struct ata_disk_info* const pinfo, uint64_t* const wwn
+);
+
+/* fills a --format=bin record, except for its device */
+void ata_id_get_record (
+   const struct ata_disk_info* const pinfo, struct out_record* const rec
 );
 
 static inline int set_ata_id (
@@ -51,6 +51,7 @@
 #include <getopt.h>
 #include <string.h>
 #include <libgen.h>
+#include <unistd.h>
 
 
 #include "disk_type.h"
@@ -58,47 +59,37 @@
 #include "util.h"
 
 static int handle_device (
-   struct disk_info* const node, unsigned const int export
+   struct disk_info* const node, unsigned const int export,
+   struct out_buf* const out
 ) {
-   const char* const EMPTY_STR = "";
-
    int retcode;
-   struct ata_disk_info** ppinfo;
+   struct ata_disk_info* pinfo;
 
    retcode  = 1;
-   ppinfo   = malloc ( sizeof *ppinfo );
-   if ( ppinfo == NULL ) { return 2; }
-   *ppinfo  = NULL;
+   pinfo    = NULL;
 
 
-   if ( is_ata_disk ( node, ppinfo ) == 0 ) {
+   if ( is_ata_disk ( node, &pinfo ) == 0 ) {
       fprintf ( stderr, "'%s' is not an ATA device\n", node->device );
 
    } else {
       set_disk_type_ata ( node );
 
-      if ( (node->type != DISK_TYPE_ATA) || (*ppinfo == NULL) ) {
+      if ( (node->type != DISK_TYPE_ATA) || (pinfo == NULL) ) {
          fprintf ( stderr, "failed to get disk info!\n" );
 
       } else if ( export == 0 ) {
-         set_ata_id ( node, *ppinfo );
+         set_ata_id ( node, pinfo );
          if ( node->disk_id != NULL ) {
-            printf ( "%s\n", node->disk_id );
+            out_buf_puts ( out, node->disk_id );
+            out_buf_putc ( out, '\n' );
             retcode = 0;
          }
       } else {
-         retcode = print_ata_id_vars ( node, *ppinfo, 0, EMPTY_STR );
+         retcode = print_ata_id_vars ( node, pinfo, 0, out );
       }
    }
 
-
-   if ( ppinfo != NULL ) {
-      if ( *ppinfo != NULL ) {
-         free ( *ppinfo );
-         *ppinfo = NULL;
-      }
-      free ( ppinfo );
-   }
    return retcode;
 }
 
@@ -106,13 +97,15 @@ static int handle_device (
 int main ( const int argc, char* const* argv ) {
    int retcode            = EXIT_SUCCESS;
    struct disk_info* node = NULL;
+   struct out_buf out     = { .data = NULL };
+   struct arena arena     = { .chunk = NULL };
 
    int i;
    unsigned int exit_after_getopt;
    unsigned int want_export;
 
 
-   static const struct option const long_options[] = {
+   static const struct option long_options[] = {
       { "export", no_argument,       NULL, 'x' },
       { "help",   no_argument,       NULL, 'h' },
       {0}
@@ -146,11 +139,15 @@ int main ( const int argc, char* const* argv ) {
 
    if ( exit_after_getopt == 0 ) {
       if ( optind < argc ) {
-         node = init_disk_info ( argv[optind] );
+         if ( arena_init ( &arena, ARENA_DEVICE_SIZE ) == 0 ) {
+            node = init_disk_info ( argv[optind], &arena, NULL );
+         }
          if ( node == NULL ) {
-            fprintf ( stderr, "failed to open device '%s'\n", argv[i] );
+            fprintf ( stderr, "failed to open device '%s'\n", argv[optind] );
             retcode = EXIT_FAILURE;
-         } else if ( handle_device ( node, want_export ) != 0 ) {
+         } else if ( out_buf_init ( &out, STDOUT_FILENO, 4096 ) != 0 ) {
+            retcode = EXIT_FAILURE;
+         } else if ( handle_device ( node, want_export, &out ) != 0 ) {
             retcode = EXIT_FAILURE;
          }
       } else {
@@ -160,13 +157,20 @@ int main ( const int argc, char* const* argv ) {
    }
 
 
+   if ( out.data != NULL ) {
+      if ( out_buf_flush ( &out ) != 0 ) {
+         retcode = EXIT_FAILURE;
+      }
+      out_buf_free ( &out );
+   }
    fflush ( stdout );
    fflush ( stderr );
 
    if ( node != NULL ) {
-      close_disk_info ( node );
+      close_disk_info_fd ( node );
       node = NULL;
    }
+   arena_free ( &arena );
 
    return retcode;
 }
@@ -0,0 +1,349 @@
+/*
+ * ata_sysfs.c - read ATA disk identities from sysfs
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "udev_util.h"
+#include "sysfs.h"
+#include "ata_sysfs.h"
+
+/* a VPD page is at most 4 + 0xffff bytes, libata's page 0x83 is < 100 */
+#define ATA_SYSFS_VPD_MAX 512
+
+/*
+ * libata's T10 vendor ID designator:
+ * "ATA     " <model (40 chars)> <serial (20 chars)>
+ */
+#define ATA_SYSFS_T10_VENDOR     "ATA     "
+#define ATA_SYSFS_T10_VENDOR_LEN 8
+#define ATA_SYSFS_T10_LEN        (ATA_SYSFS_T10_VENDOR_LEN + 40 + 20)
+
+
+/* "%04x%c" per word */
+#define ATA_SYSFS_ID_TEXT_MAX (256 * 5 + 64)
+
+
+struct ata_sysfs_dev {
+   struct stat stat_info;
+   /* scsi_device dir relative to the device's sysfs dir */
+   const char* device_dir;
+};
+
+struct ata_sysfs_vpd_ids {
+   const uint8_t* t10;
+   uint64_t       wwn;
+   int            has_wwn;
+};
+
+
+static ssize_t ata_sysfs_read (
+   const struct ata_sysfs_dev* const dev, const char* const attr,
+   void* const buf, const size_t buf_len, const int raw
+) {
+   char attr_rel[64];
+   char path[SYSFS_PATH_MAX];
+
+   snprintf ( attr_rel, sizeof attr_rel, "%s/%s", dev->device_dir, attr );
+   if (
+      sysfs_dev_path ( path, sizeof path, &(dev->stat_info), attr_rel ) != 0
+   ) {
+      return -1;
+   }
+
+   return ( raw )
+      ? sysfs_read_file ( path, buf, buf_len )
+      : sysfs_read_attr ( path, (char*)buf, buf_len );
+}
+
+/*
+ * Locates the scsi_device of a disk ("device") or partition ("../device")
+ * and checks whether it is a direct access block device.
+ */
+static int ata_sysfs_dev_init (
+   struct ata_sysfs_dev* const dev, const int fd
+) {
+   static const char* const device_dirs[] = { "device", "../device", NULL };
+   char buf[8];
+   size_t k;
+
+   if ( fstat ( fd, &(dev->stat_info) ) != 0 ) {
+      return -1;
+   }
+
+   for ( k = 0; device_dirs[k] != NULL; k++ ) {
+      dev->device_dir = device_dirs[k];
+
+      if ( ata_sysfs_read ( dev, "type", buf, sizeof buf, 0 ) > 0 ) {
+         /* ATAPI (type 5) devices are not handled here */
+         return ( strcmp ( buf, "0" ) == 0 ) ? 0 : -1;
+      }
+   }
+
+   return -1;
+}
+
+/*
+ * Finds the ata_device of a libata scsi_device:
+ *
+ * .../ata<P>/host<H>/target<H>:<C>:<T>/<H>:<C>:<T>:<L>
+ *   -> /sys/class/ata_device/dev<P>.<T>    (no port multiplier, C == 0)
+ *   -> /sys/class/ata_device/dev<P>.<C>.0  (port multiplier link C, T == 0)
+ */
+static int ata_sysfs_ata_dev_path (
+   const struct ata_sysfs_dev* const dev, char* const buf, const size_t len
+) {
+   char link[SYSFS_PATH_MAX];
+   char real[PATH_MAX];
+   const char* p;
+   const char* name;
+   unsigned int port;
+   unsigned int host, channel, target, lun;
+   int ret;
+
+   if (
+      sysfs_dev_path ( link, sizeof link, &(dev->stat_info), dev->device_dir )
+         != 0 ||
+      realpath ( link, real ) == NULL
+   ) {
+      return -1;
+   }
+
+   name = strrchr ( real, '/' );
+   if (
+      name == NULL ||
+      sscanf ( name + 1, "%u:%u:%u:%u", &host, &channel, &target, &lun ) != 4
+   ) {
+      return -1;
+   }
+
+   /* the last ".../ata<P>/..." path component */
+   port = 0;
+   ret  = 0;
+   for ( p = strstr ( real, "/ata" ); p != NULL; p = strstr ( p + 1, "/ata" ) ) {
+      if ( sscanf ( p, "/ata%u/", &port ) == 1 ) {
+         ret = 1;
+      }
+   }
+   if ( ret == 0 || lun != 0 ) {
+      return -1;
+   }
+
+   snprintf ( link, sizeof link, "/sys/class/ata_link/link%u.%u", port, channel );
+   if ( access ( link, F_OK ) == 0 ) {
+      if ( target != 0 ) { return -1; }
+      ret = snprintf (
+         buf, len, "/sys/class/ata_device/dev%u.%u.0/id", port, channel
+      );
+   } else {
+      if ( channel != 0 ) { return -1; }
+      ret = snprintf (
+         buf, len, "/sys/class/ata_device/dev%u.%u/id", port, target
+      );
+   }
+
+   return ( ret > 0 && (size_t)ret < len ) ? 0 : -1;
+}
+
+/*
+ * Converts libata's hex dump of the IDENTIFY data (in host byte order)
+ * back to the raw (little endian) format the fixup functions expect.
+ */
+static int ata_sysfs_parse_id (
+   const char* const text, uint8_t identify[512]
+) {
+   const char* p;
+   char* endptr;
+   unsigned long int word;
+   int k;
+
+   p = text;
+   for ( k = 0; k < 256; k++ ) {
+      word = strtoul ( p, &endptr, 16 );
+      if ( endptr == p || word > 0xffff ) {
+         return -1;
+      }
+
+      identify[2*k]   = (uint8_t)( word & 0xff );
+      identify[2*k+1] = (uint8_t)( word >> 8 );
+      p = endptr;
+   }
+
+   return 0;
+}
+
+/* SPC-4, section 7.8.6: Device Identification VPD page */
+static int ata_sysfs_parse_vpd_pg83 (
+   const uint8_t* const vpd, const size_t vpd_len,
+   struct ata_sysfs_vpd_ids* const ids
+) {
+   size_t end;
+   size_t k;
+   size_t dlen;
+   const uint8_t* desc;
+   int i;
+
+   *ids = (struct ata_sysfs_vpd_ids) { .t10 = NULL, .has_wwn = 0 };
+
+   if ( vpd_len < 4 || vpd[1] != 0x83 ) {
+      return -1;
+   }
+
+   end = 4 + (size_t)( (vpd[2] << 8) | vpd[3] );
+   if ( end > vpd_len ) { end = vpd_len; }
+
+   for ( k = 4; k + 4 <= end; k += 4 + dlen ) {
+      dlen = vpd[k+3];
+      desc = vpd + k + 4;
+
+      if ( k + 4 + dlen > end ) { break; }
+
+      /* association: addressed logical unit */
+      if ( (vpd[k+1] & 0x30) != 0 ) { continue; }
+
+      switch ( vpd[k+1] & 0x0f ) {
+         case 0x1:
+            /* T10 vendor ID */
+            if (
+               dlen >= ATA_SYSFS_T10_LEN &&
+               memcmp (
+                  desc, ATA_SYSFS_T10_VENDOR, ATA_SYSFS_T10_VENDOR_LEN
+               ) == 0
+            ) {
+               ids->t10 = desc;
+            }
+            break;
+
+         case 0x3:
+            /* NAA, the WWN of ATA disks is "NAA IEEE Registered" (5h) */
+            if ( dlen == 8 && (desc[0] >> 4) == 0x5 ) {
+               ids->wwn = 0;
+               for ( i = 0; i < 8; i++ ) {
+                  ids->wwn = (ids->wwn << 8) | desc[i];
+               }
+               ids->has_wwn = 1;
+            }
+            break;
+
+         default:
+            break;
+      }
+   }
+
+   return ( ids->t10 != NULL ) ? 0 : -1;
+}
+
+
+int ata_sysfs_read_identify (
+   const struct disk_info* const node, struct ata_disk_info* const pinfo
+) {
+   struct ata_sysfs_dev dev;
+   char path[SYSFS_PATH_MAX];
+   char text[ATA_SYSFS_ID_TEXT_MAX];
+
+   if (
+      ata_sysfs_dev_init ( &dev, node->fd ) != 0 ||
+      ata_sysfs_ata_dev_path ( &dev, path, sizeof path ) != 0 ||
+      sysfs_read_attr ( path, text, sizeof text ) < 1 ||
+      ata_sysfs_parse_id ( text, pinfo->identify ) != 0 ||
+      ata_identify_is_empty ( pinfo->identify )
+   ) {
+      return -1;
+   }
+
+   pinfo->is_packet_device = 0;
+   return 0;
+}
+
+int ata_sysfs_identify (
+   const struct disk_info* const node, struct ata_disk_info* const pinfo
+) {
+   struct ata_sysfs_dev dev;
+   struct ata_sysfs_vpd_ids ids;
+   uint8_t vpd[ATA_SYSFS_VPD_MAX];
+   char rev[9];
+   ssize_t vpd_len;
+   ssize_t rev_len;
+   uint16_t* words;
+   int k;
+
+   if ( ata_sysfs_dev_init ( &dev, node->fd ) != 0 ) {
+      return -1;
+   }
+
+   vpd_len = ata_sysfs_read ( &dev, "vpd_pg83", vpd, sizeof vpd, 1 );
+   if (
+      vpd_len < 0 ||
+      ata_sysfs_parse_vpd_pg83 ( vpd, (size_t)vpd_len, &ids ) != 0
+   ) {
+      return -1;
+   }
+
+   memzero ( pinfo->identify, 512 );
+   pinfo->is_packet_device = 0;
+
+   /* same layout as the (fixed up) IDENTIFY DEVICE data */
+   memcpy (
+      pinfo->identify + 20, ids.t10 + ATA_SYSFS_T10_VENDOR_LEN + 40, 20
+   );
+   memcpy ( pinfo->identify + 54, ids.t10 + ATA_SYSFS_T10_VENDOR_LEN, 40 );
+
+   /* libata reports (at most) 4 chars of the firmware revision */
+   rev_len = ata_sysfs_read ( &dev, "rev", rev, sizeof rev, 0 );
+   memset ( pinfo->identify + 46, ' ', 8 );
+   if ( rev_len > 0 ) {
+      memcpy ( pinfo->identify + 46, rev, (size_t)rev_len );
+   }
+
+   if ( ids.has_wwn ) {
+      words = (uint16_t*) pinfo->identify;
+      for ( k = 0; k < 4; k++ ) {
+         words[108 + k] = (uint16_t)( ids.wwn >> (48 - 16*k) );
+      }
+   }
+
+   memcpy ( &(pinfo->id), pinfo->identify, sizeof pinfo->id );
+   return 0;
+}
+
+int ata_sysfs_probe (
+   const struct disk_info* const node, struct ata_disk_info* const pinfo
+) {
+   if ( node->source == ID_SOURCE_IOCTL ) {
+      return -1;
+
+   } else if ( ata_sysfs_read_identify ( node, pinfo ) == 0 ) {
+      ata_disk_info_fixup_identify ( pinfo );
+
+   } else if (
+      node->source == ID_SOURCE_IDENTIFY ||
+      ata_sysfs_identify ( node, pinfo ) != 0
+   ) {
+      return -1;
+   }
+
+   ata_disk_info_set_strings ( pinfo );
+   return 0;
+}
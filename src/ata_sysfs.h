@@ -0,0 +1,80 @@
+/*
+ * ata_sysfs.h - read ATA disk identities from sysfs
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_ATA_SYSFS_
+#define _DISKID_ATA_SYSFS_
+
+#include "disk_type.h"
+#include "ata_id.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reads the IDENTIFY DEVICE data of a libata disk (or one of its
+ * partitions) as cached by libata (/sys/class/ata_device/dev<X>/id),
+ * without sending any command to the disk.
+ *
+ * The data is in the same format as returned by the disk, so the caller
+ * has to call ata_disk_info_fixup_identify() and
+ * ata_disk_info_set_strings() afterwards.
+ *
+ * Returns 0 on success, else non-zero.
+ */
+int ata_sysfs_read_identify (
+   const struct disk_info* const node, struct ata_disk_info* const pinfo
+);
+
+/*
+ * Fills the IDENTIFY data of a libata disk (or one of its partitions)
+ * from the scsi_device's sysfs attributes (type, rev, vpd_pg83),
+ * without sending any command to the disk.
+ *
+ * Only the model, serial number, firmware revision and WWN words are set,
+ * all other words are zero. The caller has to call
+ * ata_disk_info_set_strings() afterwards.
+ *
+ * Returns 0 on success, else non-zero (not a libata disk, old kernel).
+ */
+int ata_sysfs_identify (
+   const struct disk_info* const node, struct ata_disk_info* const pinfo
+);
+
+/*
+ * Reads the identity of a disk from sysfs, as far as node->source permits:
+ *
+ *  ID_SOURCE_IOCTL:           nothing
+ *  ID_SOURCE_IDENTIFY:        ata_sysfs_read_identify()
+ *  ID_SOURCE_SYSFS, _AUTO:    ata_sysfs_read_identify(), ata_sysfs_identify()
+ *
+ * pinfo is ready for use on success (strings set).
+ *
+ * Returns 0 on success, else non-zero.
+ */
+int ata_sysfs_probe (
+   const struct disk_info* const node, struct ata_disk_info* const pinfo
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,505 @@
+/*
+ * bench.c - diskid_bench, probes simulated disks and reports timings
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "disk_type.h"
+#include "arena.h"
+#include "probe.h"
+#include "fake_disk.h"
+
+#define BENCH_DEFAULT_DEVICES 4096
+#define BENCH_MAX_DEVICES     (1024 * 1024)
+#define BENCH_DEVICE_NAME_MAX 32
+
+
+/* arena chunk allocations of a run, counted under the arena's lock */
+struct bench_alloc_stats {
+   size_t count;
+   size_t bytes;
+};
+
+/* --cmd-timeout and --deadline (per run), 0: diskid's defaults */
+struct bench_timeouts {
+   unsigned int cmd_timeout_msec;
+   unsigned int deadline_msec;
+};
+
+struct bench_run {
+   struct probe_ctx   ctx;
+   struct probe_job*  jobs;
+   /* probe time of each job, in ns */
+   uint64_t*          latency;
+};
+
+
+static void* bench_alloc ( void* const ctx, const size_t size ) {
+   struct bench_alloc_stats* const stats = ctx;
+
+   stats->count++;
+   stats->bytes += size;
+   return malloc ( size );
+}
+
+static void bench_free ( void* const ctx, void* const ptr ) {
+   (void) ctx;
+   free ( ptr );
+}
+
+static inline uint64_t bench_now ( void ) {
+   struct timespec ts;
+
+   clock_gettime ( CLOCK_MONOTONIC, &ts );
+   return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_probe_job ( struct probe_job* const job, void* const data ) {
+   struct bench_run* const run = data;
+   const uint64_t start        = bench_now();
+
+   probe_job_run ( job, &(run->ctx) );
+   run->latency[job - run->jobs] = bench_now() - start;
+}
+
+static int bench_cmp_u64 ( const void* const a, const void* const b ) {
+   const uint64_t x = *(const uint64_t*)a;
+   const uint64_t y = *(const uint64_t*)b;
+
+   return ( x < y ) ? -1 : ( x > y );
+}
+
+static long bench_maxrss_kb ( void ) {
+   struct rusage usage;
+
+   return ( getrusage ( RUSAGE_SELF, &usage ) == 0 ) ? usage.ru_maxrss : -1;
+}
+
+/*
+ * Probes devices[0..count) the way diskid does (one arena and disk_caps
+ * per run), the probe time of each device is written to latency and
+ * the calls saved by the disk_caps are added to skipped.
+ * Returns the number of devices that could not be identified,
+ * or -1 if the run could not be set up.
+ */
+static long bench_run_once (
+   const struct fake_disk* const fake, const struct probe_limits* const limits,
+   const struct bench_timeouts* const timeouts,
+   char* const* const devices, const size_t count,
+   uint64_t* const latency, struct bench_alloc_stats* const stats,
+   unsigned long* const skipped
+) {
+   struct arena arena = { .chunk = NULL };
+   struct disk_caps caps;
+   struct bench_run run;
+   long failed;
+   size_t k;
+
+   if (
+      arena_init_alloc (
+         &arena, count * ( sizeof *(run.jobs) + ARENA_DEVICE_SIZE ),
+         bench_alloc, bench_free, stats
+      ) != 0
+   ) {
+      return -1;
+   }
+
+   disk_caps_init ( &caps );
+   run.ctx = (struct probe_ctx) {
+      .disk_types = DISK_TYPE_ATA,
+      .cache      = NULL,
+      .source     = ID_SOURCE_IOCTL,
+      .arena      = &arena,
+      .nvme_ctrls = NULL,
+      .caps       = &caps,
+      .ops        = &(fake->ops),
+      .timeout_msec = timeouts->cmd_timeout_msec,
+      .deadline     = ( timeouts->deadline_msec > 0 )
+         ? bench_now() + (uint64_t)timeouts->deadline_msec * 1000000 : 0,
+   };
+   run.latency = latency;
+   run.jobs    = arena_alloc ( &arena, count * sizeof *(run.jobs) );
+   if ( run.jobs == NULL ) {
+      arena_free ( &arena );
+      return -1;
+   }
+   for ( k = 0; k < count; k++ ) {
+      run.jobs[k] = (struct probe_job) {
+         .device = devices[k],
+         /* fake:<k> is attached to host k % hosts */
+         .host   = ( fake->config.hosts > 0 )
+            ? (unsigned int)( k % fake->config.hosts ) + 1 : 0,
+      };
+   }
+
+   if ( limits->max_workers > 1 ) {
+      probe_run_hosts ( run.jobs, count, limits, bench_probe_job, &run );
+   }
+
+   failed = 0;
+   for ( k = 0; k < count; k++ ) {
+      if ( run.jobs[k].status == PROBE_PENDING ) {
+         bench_probe_job ( &(run.jobs[k]), &run );
+      }
+      if ( run.jobs[k].status != PROBE_OK ) {
+         failed++;
+      }
+      probe_job_release ( &(run.jobs[k]) );
+   }
+
+   *skipped += caps.skipped;
+   arena_free ( &arena );
+   return failed;
+}
+
+/*
+ * Probes count devices in rounds until about max_devices have been probed
+ * and prints one line of results.
+ */
+static int bench_size (
+   const struct fake_disk* const fake, const struct probe_limits* const limits,
+   const struct bench_timeouts* const timeouts, char* const* const devices, const size_t count, const size_t max_devices,
+   uint64_t* const latency
+) {
+   struct bench_alloc_stats stats = { 0, 0 };
+   const size_t rounds = ( max_devices / count > 0 ) ? max_devices / count : 1;
+   const size_t total  = rounds * count;
+   uint64_t start;
+   uint64_t elapsed;
+   unsigned long skipped;
+   unsigned long rejected;
+   long failed;
+   long ret;
+   size_t r;
+
+   failed   = 0;
+   skipped  = 0;
+   rejected = __atomic_load_n ( &(fake->rejected), __ATOMIC_RELAXED );
+   start    = bench_now();
+   for ( r = 0; r < rounds; r++ ) {
+      ret = bench_run_once (
+         fake, limits, timeouts, devices, count, latency + r * count,
+         &stats, &skipped
+      );
+      if ( ret < 0 ) {
+         fprintf ( stderr, "failed to set up a run of %zu devices\n", count );
+         return -1;
+      }
+      failed += ret;
+   }
+   elapsed  = bench_now() - start;
+   rejected = __atomic_load_n ( &(fake->rejected), __ATOMIC_RELAXED ) - rejected;
+
+   qsort ( latency, total, sizeof *latency, bench_cmp_u64 );
+
+   fprintf ( stdout,
+      "%8zu %7zu %12.1f %9.1f %9.1f %7ld %8lu %8lu %7zu %8zu %9ld\n",
+      count, rounds,
+      ( elapsed > 0 ) ? (double)total * 1e9 / (double)elapsed : 0.0,
+      (double)latency[( total - 1 ) / 2] / 1000.0,
+      (double)latency[( total - 1 ) * 99 / 100] / 1000.0,
+      failed, skipped / rounds, rejected / rounds,
+      stats.count / rounds, stats.bytes / rounds / 1024,
+      bench_maxrss_kb()
+   );
+   fflush ( stdout );
+   return 0;
+}
+
+static int bench_read_identify (
+   const char* const path, uint8_t identify[512]
+) {
+   ssize_t ret;
+   int fd;
+
+   fd = open ( path, O_RDONLY|O_CLOEXEC );
+   if ( fd < 0 ) {
+      return -1;
+   }
+   ret = read ( fd, identify, 512 );
+   close ( fd );
+
+   return ( ret == 512 ) ? 0 : -1;
+}
+
+static int bench_parse_uint (
+   const char* const arg, const unsigned long max, unsigned int* const out
+) {
+   unsigned long val;
+   char* end;
+
+   errno = 0;
+   val   = strtoul ( arg, &end, 10 );
+   if ( errno != 0 || end == arg || *end != '\0' || val > max ) {
+      fprintf ( stderr, "invalid number: '%s'\n", arg );
+      return -1;
+   }
+   *out = (unsigned int)val;
+   return 0;
+}
+
+
+int main ( const int argc, char* const* argv ) {
+   int retcode          = EXIT_SUCCESS;
+   char** devices       = NULL;
+   char* names          = NULL;
+   uint64_t* latency    = NULL;
+   struct fake_disk_config config;
+   struct fake_disk fake;
+   struct probe_limits limits;
+   struct bench_timeouts timeouts;
+   unsigned int max_devices;
+   size_t count;
+   size_t k;
+   int i;
+
+   static const struct option long_options[] = {
+      { "devices",  required_argument, NULL, 'n' },
+      { "jobs",     required_argument, NULL, 'j' },
+      { "latency",  required_argument, NULL, 'l' },
+      { "jitter",   required_argument, NULL, 'J' },
+      { "errors",   required_argument, NULL, 'e' },
+      { "timeouts", required_argument, NULL, 't' },
+      { "timeout",  required_argument, NULL, 'T' },
+      { "identify", required_argument, NULL, 'i' },
+      { "hosts",    required_argument, NULL, 'H' },
+      { "host-queue", required_argument, NULL, 'Q' },
+      { "host-jobs", required_argument, NULL, 'L' },
+      { "cmd-timeout", required_argument, NULL, 'c' },
+      { "deadline", required_argument, NULL, 'D' },
+      { "no-sg-v4", no_argument,       NULL, 'V' },
+      { "help",     no_argument,       NULL, 'h' },
+      {0}
+   };
+
+   fake_disk_config_init ( &config );
+   max_devices = BENCH_DEFAULT_DEVICES;
+   limits      = (struct probe_limits) {
+      .max_workers = 1, .host_jobs = 0, .expander_jobs = 0
+   };
+   timeouts    = (struct bench_timeouts) {
+      .cmd_timeout_msec = 0, .deadline_msec = 0
+   };
+
+   while (
+      ( i = getopt_long (
+         argc, argv, "n:j:l:J:e:t:T:i:H:Q:L:c:D:Vh", long_options, NULL
+      ) ) != -1
+   ) {
+      switch ( i ) {
+         case 'h':
+            fprintf ( stdout,
+               (
+                  "Usage: %s [option...]\n"
+                  "\n"
+                  "Probes 1, 4, 16, ... simulated ATA disks the way diskid does.\n"
+                  "Each size is repeated until about --devices disks have been\n"
+                  "probed, maxrss is the peak RSS of the process so far.\n"
+                  "\n"
+                  "  -h, --help           print this help message and exit\n"
+                  "  -n, --devices <N>    largest number of disks (default: %u)\n"
+                  "  -j, --jobs <N>       probe N disks at once (default: 1)\n"
+                  "  -l, --latency <us>   time each command takes (default: 0)\n"
+                  "  -J, --jitter <us>    random extra time per command\n"
+                  "  -e, --errors <N>     fail N of 1000 commands with EIO\n"
+                  "  -t, --timeouts <N>   time out N of 1000 commands\n"
+                  "  -T, --timeout <ms>   how long a timed out command blocks\n"
+                  "                       (default: %u)\n"
+                  "  -i, --identify <file>\n"
+                  "                       serve this IDENTIFY DEVICE data\n"
+                  "                       (512 bytes, as sent by the disk)\n"
+                  "  -H, --hosts <N>      spread the disks over N host adapters\n"
+                  "                       (at most %u)\n"
+                  "  -Q, --host-queue <N> a host queues up to N commands, further\n"
+                  "                       ones time out (default: no limit)\n"
+                  "  -L, --host-jobs <N>  probe up to N disks per host at once\n"
+                  "  -c, --cmd-timeout <ms>\n"
+                  "                       diskid's --timeout (default: 30000),\n"
+                  "                       cuts -T short\n"
+                  "  -D, --deadline <ms>  diskid's --deadline, for each run\n"
+                  "  -V, --no-sg-v4       the disks' driver rejects SG_IO v4\n"
+                  "                       (skipped: v4 calls saved per run,\n"
+                  "                       rejected: v4 calls made per run)\n"
+                  "\n"
+               ), basename(argv[0]), BENCH_DEFAULT_DEVICES, config.timeout_msec,
+               FAKE_DISK_MAX_HOSTS
+            );
+            goto main_exit;
+
+         case 'n':
+            if ( bench_parse_uint ( optarg, BENCH_MAX_DEVICES, &max_devices ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'j':
+            if ( bench_parse_uint ( optarg, 4096, &(limits.max_workers) ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'l':
+            if ( bench_parse_uint ( optarg, 10000000, &config.latency_usec ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'J':
+            if ( bench_parse_uint ( optarg, 10000000, &config.jitter_usec ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'e':
+            if ( bench_parse_uint ( optarg, 1000, &config.error_permille ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 't':
+            if ( bench_parse_uint ( optarg, 1000, &config.timeout_permille ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'T':
+            if ( bench_parse_uint ( optarg, 60000, &config.timeout_msec ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'i':
+            if ( bench_read_identify ( optarg, config.identify ) != 0 ) {
+               fprintf ( stderr, "failed to read 512 bytes from '%s'\n", optarg );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'H':
+            if (
+               bench_parse_uint ( optarg, FAKE_DISK_MAX_HOSTS, &config.hosts ) != 0
+            ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'Q':
+            if ( bench_parse_uint ( optarg, 4096, &config.host_queue_depth ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'L':
+            if ( bench_parse_uint ( optarg, 4096, &(limits.host_jobs) ) != 0 ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'c':
+            if (
+               bench_parse_uint ( optarg, 60000, &timeouts.cmd_timeout_msec ) != 0
+            ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'V':
+            config.no_sg_v4 = 1;
+            break;
+         case 'D':
+            if (
+               bench_parse_uint ( optarg, 3600000, &timeouts.deadline_msec ) != 0
+            ) {
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         default:
+            retcode = EXIT_FAILURE;
+            goto main_exit;
+      }
+   }
+
+   if ( max_devices == 0 ) {
+      fprintf ( stderr, "--devices must be at least 1\n" );
+      retcode = EXIT_FAILURE;
+      goto main_exit;
+   }
+
+   fake_disk_init ( &fake, &config );
+
+   devices = malloc ( max_devices * sizeof *devices );
+   names   = malloc ( (size_t)max_devices * BENCH_DEVICE_NAME_MAX );
+   latency = malloc ( max_devices * sizeof *latency );
+   if ( devices == NULL || names == NULL || latency == NULL ) {
+      fprintf ( stderr, "out of memory\n" );
+      retcode = EXIT_FAILURE;
+      goto main_exit;
+   }
+   for ( k = 0; k < max_devices; k++ ) {
+      devices[k] = names + k * BENCH_DEVICE_NAME_MAX;
+      snprintf (
+         devices[k], BENCH_DEVICE_NAME_MAX, FAKE_DISK_PREFIX "%zu", k
+      );
+   }
+
+   fprintf ( stdout,
+      "# fake disks: latency %u+%uus, errors %u/1000, timeouts %u/1000 (%ums), jobs %u\n"
+      "# hosts %u, host queue depth %u, jobs per host %u (0: no limit)\n"
+      "# command timeout %ums, deadline %ums (0: default / none)\n"
+      "# devices  rounds        dev/s    p50_us    p99_us  failed  skipped rejected  allocs arena_kB maxrss_kB\n",
+      config.latency_usec, config.jitter_usec, config.error_permille,
+      config.timeout_permille, config.timeout_msec, limits.max_workers,
+      config.hosts, config.host_queue_depth, limits.host_jobs,
+      timeouts.cmd_timeout_msec, timeouts.deadline_msec
+   );
+
+   /* 1, 4, 16, ..., always ending with max_devices */
+   for ( count = 1;; count = ( count * 4 < max_devices ) ? count * 4 : max_devices ) {
+      if (
+         bench_size (
+            &fake, &limits, &timeouts, devices, count, max_devices, latency
+         ) != 0
+      ) {
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+      if ( count == max_devices ) { break; }
+   }
+
+main_exit:
+   fflush ( stdout );
+   fflush ( stderr );
+
+   if ( latency != NULL ) { free ( latency ); }
+   if ( names   != NULL ) { free ( names ); }
+   if ( devices != NULL ) { free ( devices ); }
+
+   return retcode;
+}
@@ -0,0 +1,545 @@
+/*
+ * bench_strings.c - diskid_bench_strings, times the IDENTIFY string decoding
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <linux/hdreg.h>
+
+#include "udev_util.h"
+#include "ata_id.h"
+#include "fake_disk.h"
+
+#define BENCH_DEFAULT_RANDOM 4096
+#define BENCH_DEFAULT_OPS    (2 * 1000 * 1000)
+/* each timing is the best of this many runs, against noise */
+#define BENCH_REPEAT         5
+/* longest random string for the udev_util checks */
+#define BENCH_STRING_MAX     300
+
+/* udev_util.c built with UDEV_UTIL_SCALAR, i.e. char by char only */
+int scalar_util_replace_chars    ( char* const, const char* const );
+int scalar_encode_devnode_name   ( const char* const, char* const, const size_t );
+int scalar_util_normalize_string (
+   const char* const str, const size_t len, char* const to,
+   char* const enc, const size_t enc_len
+);
+
+/* the strings ata_disk_info_set_strings() produces */
+struct bench_strings {
+   char model[41];
+   char model_enc[256];
+   char serial[21];
+   char revision[9];
+};
+
+struct bench_corpus {
+   uint8_t* blocks;
+   size_t   count;
+   size_t   size;
+};
+
+
+static inline uint64_t bench_now ( void ) {
+   struct timespec ts;
+
+   clock_gettime ( CLOCK_MONOTONIC, &ts );
+   return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* xorshift64* */
+static inline uint64_t bench_rand ( uint64_t* const state ) {
+   *state ^= *state >> 12;
+   *state ^= *state << 25;
+   *state ^= *state >> 27;
+   return *state * 0x2545f4914f6cdd1dULL;
+}
+
+
+/* what ata_disk_info_set_strings() did before util_normalize_string() */
+static void bench_strings_chain (
+   const struct hd_driveid* const id, struct bench_strings* const out
+) {
+   char model[41];
+
+   memcpy ( model, id->model, 40 );
+   model[40] = '\0';
+   encode_devnode_name ( model, out->model_enc, sizeof out->model_enc );
+
+   util_replace_whitespace ( (const char*)(id->model), out->model, 40 );
+   util_replace_chars ( out->model, NULL );
+   util_replace_whitespace ( (const char*)(id->serial_no), out->serial, 20 );
+   util_replace_chars ( out->serial, NULL );
+   util_replace_whitespace ( (const char*)(id->fw_rev), out->revision, 8 );
+   util_replace_chars ( out->revision, NULL );
+}
+
+static void bench_strings_scalar (
+   const struct hd_driveid* const id, struct bench_strings* const out
+) {
+   scalar_util_normalize_string (
+      (const char*)(id->model), 40,
+      out->model, out->model_enc, sizeof out->model_enc
+   );
+   scalar_util_normalize_string (
+      (const char*)(id->serial_no), 20, out->serial, NULL, 0
+   );
+   scalar_util_normalize_string (
+      (const char*)(id->fw_rev), 8, out->revision, NULL, 0
+   );
+}
+
+static void bench_strings_fused (
+   const struct hd_driveid* const id, struct bench_strings* const out
+) {
+   util_normalize_string (
+      (const char*)(id->model), 40,
+      out->model, out->model_enc, sizeof out->model_enc
+   );
+   util_normalize_string (
+      (const char*)(id->serial_no), 20, out->serial, NULL, 0
+   );
+   util_normalize_string (
+      (const char*)(id->fw_rev), 8, out->revision, NULL, 0
+   );
+}
+
+static int bench_strings_equal (
+   const struct bench_strings* const a, const struct bench_strings* const b
+) {
+   return (
+      strcmp ( a->model,     b->model )     == 0 &&
+      strcmp ( a->model_enc, b->model_enc ) == 0 &&
+      strcmp ( a->serial,    b->serial )    == 0 &&
+      strcmp ( a->revision,  b->revision )  == 0
+   ) ? 1 : 0;
+}
+
+
+static uint8_t* bench_corpus_add ( struct bench_corpus* const corpus ) {
+   uint8_t* blocks;
+   size_t size;
+
+   if ( corpus->count == corpus->size ) {
+      size   = ( corpus->size > 0 ) ? corpus->size * 2 : 64;
+      blocks = realloc ( corpus->blocks, size * 512 );
+      if ( blocks == NULL ) { return NULL; }
+      corpus->blocks = blocks;
+      corpus->size   = size;
+   }
+
+   return corpus->blocks + 512 * corpus->count++;
+}
+
+/* adds the non-empty blocks of a --decode-identify corpus file */
+static int bench_corpus_read (
+   struct bench_corpus* const corpus, const char* const path
+) {
+   uint8_t block[512];
+   uint8_t* dst;
+   ssize_t ret;
+   int fd;
+
+   fd = open ( path, O_RDONLY|O_CLOEXEC );
+   if ( fd < 0 ) {
+      fprintf ( stderr, "failed to open '%s'\n", path );
+      return -1;
+   }
+
+   while ( ( ret = read ( fd, block, sizeof block ) ) == (ssize_t)sizeof block ) {
+      if ( ata_identify_is_empty ( block ) ) { continue; }
+
+      dst = bench_corpus_add ( corpus );
+      if ( dst == NULL ) {
+         close ( fd );
+         return -1;
+      }
+      memcpy ( dst, block, sizeof block );
+   }
+   close ( fd );
+
+   if ( ret != 0 ) {
+      fprintf ( stderr, "%s: not a multiple of 512 bytes\n", path );
+      return -1;
+   }
+   return 0;
+}
+
+/*
+ * Random strings, mostly printable ASCII with runs of whitespace,
+ * backslashes, UTF-8 sequences (valid or not) and, if allow_nul is set, NULs.
+ */
+static void bench_random_chars (
+   char* const str, const size_t len, const int allow_nul,
+   uint64_t* const state
+) {
+   static const char* const pieces[] = {
+      "A", "z", "0", "-", "_", ".", " ", " ", "  ", "\t", "\\", "\\x",
+      "/", "\"", "$", "\xc3\xa4", "\xe2\x82\xac", "\xf0\x9f\x92\xbe",
+      "\xc3", "\x80", "\xff", "\xed\xa0\x80", "\xc0\xaf", "",
+   };
+   const char* piece;
+   size_t n;
+   size_t k;
+
+   n = 0;
+   while ( n < len ) {
+      piece = pieces[bench_rand ( state ) % ( sizeof pieces / sizeof *pieces )];
+      if ( *piece == '\0' ) {
+         /* NUL, rarely */
+         if ( allow_nul && bench_rand ( state ) % 8 == 0 ) { str[n++] = '\0'; }
+         continue;
+      }
+      for ( k = 0; piece[k] != '\0' && n < len; k++ ) {
+         str[n++] = piece[k];
+      }
+   }
+}
+
+/* a random ATA string, as sent by the disk */
+static void bench_random_string (
+   uint8_t* const block, const unsigned int word, const size_t len,
+   uint64_t* const state
+) {
+   char str[64];
+   size_t k;
+
+   bench_random_chars ( str, len, 1, state );
+
+   /* first char in the high byte */
+   for ( k = 0; k < len; k++ ) {
+      block[word * 2 + ( k ^ 1 )] = (uint8_t)str[k];
+   }
+}
+
+static int bench_corpus_add_random (
+   struct bench_corpus* const corpus, const uint8_t* const base,
+   const size_t count, uint64_t seed
+) {
+   uint8_t* block;
+   size_t k;
+
+   for ( k = 0; k < count; k++ ) {
+      block = bench_corpus_add ( corpus );
+      if ( block == NULL ) { return -1; }
+
+      memcpy ( block, base, 512 );
+      bench_random_string ( block, 10, 20, &seed );
+      bench_random_string ( block, 23,  8, &seed );
+      bench_random_string ( block, 27, 40, &seed );
+   }
+   return 0;
+}
+
+
+/* returns the number of blocks whose strings differ */
+static size_t bench_check (
+   const struct ata_disk_info* const info, const size_t count
+) {
+   struct bench_strings chain;
+   struct bench_strings fused;
+   size_t failed;
+   size_t k;
+
+   failed = 0;
+   for ( k = 0; k < count; k++ ) {
+      bench_strings_chain ( &(info[k].id), &chain );
+      bench_strings_fused ( &(info[k].id), &fused );
+
+      if (
+         !bench_strings_equal ( &chain, &fused ) ||
+         strcmp ( chain.model,     info[k].model )     != 0 ||
+         strcmp ( chain.model_enc, info[k].model_enc ) != 0 ||
+         strcmp ( chain.serial,    info[k].serial )    != 0 ||
+         strcmp ( chain.revision,  info[k].revision )  != 0
+      ) {
+         if ( failed++ < 8 ) {
+            fprintf ( stderr,
+               "block %zu differs:\n"
+               "  chain: '%s' '%s' '%s' '%s'\n"
+               "  fused: '%s' '%s' '%s' '%s'\n",
+               k,
+               chain.model, chain.model_enc, chain.serial, chain.revision,
+               fused.model, fused.model_enc, fused.serial, fused.revision
+            );
+         }
+      }
+   }
+
+   return failed;
+}
+
+/*
+ * Differential check of the udev_util run-at-a-time code against the
+ * scalar code, count random strings of 0..BENCH_STRING_MAX chars at all
+ * alignments.
+ * Returns the number of strings with differing results.
+ */
+static size_t bench_check_udev_util ( const size_t count, uint64_t seed ) {
+   /* the string starts at buf + k % 32 */
+   static char buf[BENCH_STRING_MAX + 32 + 1];
+   char out[2][4 * BENCH_STRING_MAX + 1];
+   char to[2][BENCH_STRING_MAX + 1];
+   int ret[2];
+   char* str;
+   size_t enc_len;
+   size_t len;
+   size_t failed;
+   size_t k;
+
+   failed = 0;
+   for ( k = 0; k < count; k++ ) {
+      len = (size_t)( bench_rand ( &seed ) % ( BENCH_STRING_MAX + 1 ) );
+      str = buf + k % 32;
+      bench_random_chars ( str, len, 0, &seed );
+      str[len] = '\0';
+      /* sometimes too small for the result */
+      enc_len = ( k % 4 == 0 )
+         ? (size_t)( bench_rand ( &seed ) % ( 4 * BENCH_STRING_MAX ) ) + 1
+         : sizeof out[0];
+
+      ret[0] = scalar_encode_devnode_name ( str, out[0], enc_len );
+      ret[1] = encode_devnode_name ( str, out[1], enc_len );
+      if ( ret[0] != ret[1] || ( ret[0] == 0 && strcmp ( out[0], out[1] ) != 0 ) ) {
+         fprintf ( stderr, "encode_devnode_name() differs: '%s'\n", str );
+         failed++;
+         continue;
+      }
+
+      memcpy ( out[0], str, len + 1 );
+      memcpy ( out[1], str, len + 1 );
+      ret[0] = scalar_util_replace_chars ( out[0], ( k % 2 ) ? " " : NULL );
+      ret[1] = util_replace_chars ( out[1], ( k % 2 ) ? " " : NULL );
+      if ( ret[0] != ret[1] || strcmp ( out[0], out[1] ) != 0 ) {
+         fprintf ( stderr, "util_replace_chars() differs: '%s'\n", str );
+         failed++;
+         continue;
+      }
+
+      /* not terminated, with NULs */
+      bench_random_chars ( str, len, 1, &seed );
+      ret[0] = scalar_util_normalize_string ( str, len, to[0], out[0], enc_len );
+      ret[1] = util_normalize_string ( str, len, to[1], out[1], enc_len );
+      if (
+         ret[0] != ret[1] || strcmp ( to[0], to[1] ) != 0 ||
+         ( ret[0] == 0 && strcmp ( out[0], out[1] ) != 0 )
+      ) {
+         fprintf ( stderr, "util_normalize_string() differs: '%.*s'\n", (int)len, str );
+         failed++;
+      }
+   }
+
+   return failed;
+}
+
+/* returns the time per block in ns */
+/* ns per block, the best of BENCH_REPEAT runs over info[0..count) */
+static double bench_time (
+   void (*func) ( const struct hd_driveid* const, struct bench_strings* const ),
+   const struct ata_disk_info* const info, const size_t count,
+   unsigned int* const sink
+) {
+   struct bench_strings out;
+   const size_t rounds = ( BENCH_DEFAULT_OPS / BENCH_REPEAT / count > 0 )
+      ? BENCH_DEFAULT_OPS / BENCH_REPEAT / count : 1;
+   uint64_t start;
+   uint64_t elapsed;
+   uint64_t best;
+   size_t n;
+   size_t r;
+   size_t k;
+
+   best = UINT64_MAX;
+   for ( n = 0; n < BENCH_REPEAT; n++ ) {
+      start = bench_now();
+      for ( r = 0; r < rounds; r++ ) {
+         for ( k = 0; k < count; k++ ) {
+            func ( &(info[k].id), &out );
+            *sink += (unsigned char)out.model_enc[0] + (unsigned char)out.serial[0];
+         }
+      }
+      elapsed = bench_now() - start;
+      if ( elapsed < best ) { best = elapsed; }
+   }
+
+   return (double)best / (double)( rounds * count );
+}
+
+/* prints the timings of info[0..count) as one line */
+static void bench_print_set (
+   const char* const name, const struct ata_disk_info* const info,
+   const size_t count, unsigned int* const sink
+) {
+   double chain_ns;
+   double scalar_ns;
+   double fused_ns;
+
+   if ( count == 0 ) { return; }
+
+   chain_ns  = bench_time ( bench_strings_chain,  info, count, sink );
+   scalar_ns = bench_time ( bench_strings_scalar, info, count, sink );
+   fused_ns  = bench_time ( bench_strings_fused,  info, count, sink );
+
+   fprintf ( stdout,
+      "%-8s %7zu %9.1f %9.1f %9.1f %8.2f %9.2f\n",
+      name, count, chain_ns, scalar_ns, fused_ns,
+      ( fused_ns > 0 ) ? chain_ns / fused_ns : 0.0,
+      ( fused_ns > 0 ) ? scalar_ns / fused_ns : 0.0
+   );
+}
+
+
+int main ( const int argc, char* const* argv ) {
+   int retcode                = EXIT_SUCCESS;
+   struct bench_corpus corpus = { .blocks = NULL };
+   struct ata_disk_info* info = NULL;
+   struct fake_disk_config config;
+   uint8_t* block;
+   unsigned int random_count;
+   unsigned int sink;
+   size_t file_blocks;
+   /* the blocks from files or the fake disk's block, then random ones */
+   size_t identify_blocks;
+   size_t failed;
+   size_t k;
+   char* end;
+   int i;
+
+   static const struct option long_options[] = {
+      { "random", required_argument, NULL, 'r' },
+      { "help",   no_argument,       NULL, 'h' },
+      {0}
+   };
+
+   random_count = BENCH_DEFAULT_RANDOM;
+
+   while (
+      ( i = getopt_long ( argc, argv, "r:h", long_options, NULL ) ) != -1
+   ) {
+      switch ( i ) {
+         case 'h':
+            fprintf ( stdout,
+               (
+                  "Usage: %s [-r <N>] [<FILE>...]\n"
+                  "\n"
+                  "Decodes model, serial number and revision of IDENTIFY DEVICE\n"
+                  "blocks with util_normalize_string() and with the chain of\n"
+                  "udev functions it replaces, checks that both agree and prints\n"
+                  "their timings. FILEs are --decode-identify corpora, e.g.\n"
+                  "collected with diskid --dump-identify.\n"
+                  "\n"
+                  "  -h, --help           print this help message and exit\n"
+                  "  -r, --random <N>     also decode N blocks with random strings\n"
+                  "                       (default: %u)\n"
+                  "\n"
+               ), basename(argv[0]), BENCH_DEFAULT_RANDOM
+            );
+            goto main_exit;
+
+         case 'r':
+            errno        = 0;
+            random_count = (unsigned int) strtoul ( optarg, &end, 10 );
+            if ( errno != 0 || end == optarg || *end != '\0' ) {
+               fprintf ( stderr, "invalid number: '%s'\n", optarg );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+
+         default:
+            retcode = EXIT_FAILURE;
+            goto main_exit;
+      }
+   }
+
+   for ( i = optind; i < argc; i++ ) {
+      if ( bench_corpus_read ( &corpus, argv[i] ) != 0 ) {
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+   }
+   file_blocks = corpus.count;
+
+   /* without a corpus, there is at least the fake disk's block */
+   fake_disk_config_init ( &config );
+   block = ( file_blocks == 0 ) ? bench_corpus_add ( &corpus ) : NULL;
+   if ( block != NULL ) {
+      memcpy ( block, config.identify, 512 );
+   }
+   if (
+      ( file_blocks == 0 && block == NULL ) ||
+      bench_corpus_add_random (
+         &corpus, config.identify, random_count, 0x6469736b6964ULL
+      ) != 0
+   ) {
+      fprintf ( stderr, "out of memory\n" );
+      retcode = EXIT_FAILURE;
+      goto main_exit;
+   }
+
+   info = malloc ( corpus.count * sizeof *info );
+   if ( info == NULL ) {
+      fprintf ( stderr, "out of memory\n" );
+      retcode = EXIT_FAILURE;
+      goto main_exit;
+   }
+   for ( k = 0; k < corpus.count; k++ ) {
+      ata_disk_info_from_identify ( &info[k], corpus.blocks + 512 * k );
+   }
+
+   failed = bench_check ( info, corpus.count ) +
+            bench_check_udev_util ( 16 * (size_t)random_count, 0x75646576ULL );
+
+   identify_blocks = ( file_blocks > 0 ) ? file_blocks : 1;
+   sink            = 0;
+
+   fprintf ( stdout,
+      "# blocks: %zu from files, %zu synthetic\n"
+      "# scalar: fused, but char by char only (UDEV_UTIL_SCALAR)\n"
+      "# set     blocks  chain_ns scalar_ns  fused_ns chain/fu scalar/fu\n",
+      file_blocks, corpus.count - file_blocks
+   );
+   bench_print_set ( "identify", info, identify_blocks, &sink );
+   bench_print_set (
+      "random", info + identify_blocks, corpus.count - identify_blocks, &sink
+   );
+   fprintf ( stdout, "# mismatches: %zu (sink %u)\n", failed, sink );
+
+   if ( failed > 0 ) {
+      retcode = EXIT_FAILURE;
+   }
+
+main_exit:
+   fflush ( stdout );
+   fflush ( stderr );
+
+   if ( info != NULL ) { free ( info ); }
+   if ( corpus.blocks != NULL ) { free ( corpus.blocks ); }
+
+   return retcode;
+}
@@ -0,0 +1,261 @@
+/*
+ * block_list.c - enumerate the block devices in /sys/class/block
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include "block_list.h"
+
+#define BLOCK_LIST_DIRENT_BUFSIZE (32 * 1024)
+
+/* what getdents64() writes, glibc < 2.30 has no declaration of its own */
+struct block_dirent64 {
+   uint64_t       d_ino;
+   int64_t        d_off;
+   unsigned short d_reclen;
+   unsigned char  d_type;
+   char           d_name[];
+};
+
+
+int block_class_parse ( const char* const str, unsigned int* const classes ) {
+   static const struct {
+      const char*      name;
+      enum block_class bclass;
+   } names[] = {
+      { "disk",    BLOCK_CLASS_DISK },
+      { "part",    BLOCK_CLASS_PART },
+      { "virtual", BLOCK_CLASS_VIRTUAL },
+      { NULL, 0 }
+   };
+   const char* s;
+   size_t len;
+   size_t k;
+
+   *classes = 0;
+   s        = str;
+
+   for (;;) {
+      len = strcspn ( s, "," );
+
+      for ( k = 0; names[k].name != NULL; k++ ) {
+         if (
+            strlen ( names[k].name ) == len &&
+            strncmp ( s, names[k].name, len ) == 0
+         ) {
+            break;
+         }
+      }
+      if ( names[k].name == NULL ) { return -1; }
+      *classes |= names[k].bclass;
+
+      if ( s[len] == '\0' ) { return 0; }
+      s += len + 1;
+   }
+}
+
+
+/* "<name>/<attr>" relative to /sys/class/block */
+static inline int block_attr_exists (
+   const int dirfd, const char* const name, const char* const attr
+) {
+   char path[BLOCK_LIST_DEVICE_MAX + 16];
+   int ret;
+
+   ret = snprintf ( path, sizeof path, "%s/%s", name, attr );
+   return (
+      ret > 0 && (size_t)ret < sizeof path &&
+      faccessat ( dirfd, path, F_OK, 0 ) == 0
+   );
+}
+
+static enum block_class block_classify (
+   const int dirfd, const char* const name
+) {
+   /*
+    * Only devices backed by hardware have a device link, partitions
+    * share the one of their disk (which is their parent dir in sysfs).
+    */
+   if ( block_attr_exists ( dirfd, name, "partition" ) ) {
+      return block_attr_exists ( dirfd, name, "../device" )
+         ? BLOCK_CLASS_PART : BLOCK_CLASS_VIRTUAL;
+   }
+
+   return block_attr_exists ( dirfd, name, "device" )
+      ? BLOCK_CLASS_DISK : BLOCK_CLASS_VIRTUAL;
+}
+
+/* reads the "<major>:<minor>" dev attribute */
+static int block_read_devnum (
+   const int dirfd, const char* const name, dev_t* const devnum
+) {
+   char path[BLOCK_LIST_DEVICE_MAX + 16];
+   char buf[32];
+   unsigned int maj;
+   unsigned int min;
+   ssize_t ret;
+   int fd;
+
+   ret = snprintf ( path, sizeof path, "%s/dev", name );
+   if ( ret < 1 || (size_t)ret >= sizeof path ) { return -1; }
+
+   fd = openat ( dirfd, path, O_RDONLY|O_CLOEXEC );
+   if ( fd < 0 ) { return -1; }
+
+   do {
+      ret = read ( fd, buf, sizeof buf - 1 );
+   } while ( ret < 0 && errno == EINTR );
+   close ( fd );
+
+   if ( ret < 1 ) { return -1; }
+   buf[ret] = '\0';
+
+   if ( sscanf ( buf, "%u:%u", &maj, &min ) != 2 ) { return -1; }
+
+   *devnum = makedev ( maj, min );
+   return 0;
+}
+
+static struct block_dev* block_list_new_dev ( struct block_list* const list ) {
+   struct block_dev* dev;
+   size_t new_size;
+
+   if ( list->count >= list->size ) {
+      new_size = ( list->size == 0 ) ? 64 : ( 2 * list->size );
+      dev      = realloc ( list->dev, new_size * sizeof *dev );
+      if ( dev == NULL ) { return NULL; }
+
+      list->dev  = dev;
+      list->size = new_size;
+   }
+
+   return &(list->dev[list->count++]);
+}
+
+/* adds a directory entry to list if its class is wanted */
+static int block_list_add (
+   struct block_list* const list, const unsigned int classes,
+   const int dirfd, const char* const name
+) {
+   struct block_dev* dev;
+   enum block_class bclass;
+   dev_t devnum;
+   size_t len;
+   char* p;
+
+   len = strlen ( name );
+   if ( len + 5 >= BLOCK_LIST_DEVICE_MAX ) { return 0; }
+
+   bclass = block_classify ( dirfd, name );
+   if ( !( bclass & classes ) ) { return 0; }
+
+   /* not a device (yet) */
+   if ( block_read_devnum ( dirfd, name, &devnum ) != 0 ) { return 0; }
+
+   dev = block_list_new_dev ( list );
+   if ( dev == NULL ) { return -1; }
+
+   dev->devnum = devnum;
+   dev->bclass = bclass;
+   memcpy ( dev->device, "/dev/", 5 );
+   memcpy ( dev->device + 5, name, len + 1 );
+
+   /* e.g. cciss!c0d0 -> /dev/cciss/c0d0 */
+   for ( p = dev->device + 5; ( p = strchr ( p, '!' ) ) != NULL; p++ ) {
+      *p = '/';
+   }
+
+   return 0;
+}
+
+static int block_dev_cmp ( const void* a, const void* b ) {
+   const struct block_dev* const da = a;
+   const struct block_dev* const db = b;
+
+   if ( major ( da->devnum ) != major ( db->devnum ) ) {
+      return ( major ( da->devnum ) < major ( db->devnum ) ) ? -1 : 1;
+   } else if ( minor ( da->devnum ) != minor ( db->devnum ) ) {
+      return ( minor ( da->devnum ) < minor ( db->devnum ) ) ? -1 : 1;
+   }
+   return 0;
+}
+
+int block_list_scan (
+   struct block_list* const list, const unsigned int classes
+) {
+   char* buf;
+   const struct block_dirent64* ent;
+   long nread;
+   long pos;
+   int dirfd;
+   int retcode;
+
+   buf = malloc ( BLOCK_LIST_DIRENT_BUFSIZE );
+   if ( buf == NULL ) { return -1; }
+
+   dirfd = open ( BLOCK_LIST_SYSFS_DIR, O_RDONLY|O_DIRECTORY|O_CLOEXEC );
+   if ( dirfd < 0 ) {
+      free ( buf );
+      return -1;
+   }
+
+   retcode = 0;
+   while (
+      ( nread = syscall (
+         SYS_getdents64, dirfd, buf, BLOCK_LIST_DIRENT_BUFSIZE
+      ) ) > 0
+   ) {
+      for ( pos = 0; pos < nread; pos += ent->d_reclen ) {
+         ent = (const struct block_dirent64*)( buf + pos );
+
+         if ( ent->d_name[0] == '.' ) {
+            continue;
+         } else if ( block_list_add ( list, classes, dirfd, ent->d_name ) != 0 ) {
+            retcode = -1;
+            goto scan_exit;
+         }
+      }
+   }
+   if ( nread < 0 ) { retcode = -1; }
+
+scan_exit:
+   close ( dirfd );
+   free ( buf );
+
+   /* sda, sda1, ..., sdb, ... like the kernel registered them */
+   if ( list->count > 1 ) {
+      qsort ( list->dev, list->count, sizeof *(list->dev), block_dev_cmp );
+   }
+
+   return retcode;
+}
+
+void block_list_free ( struct block_list* const list ) {
+   free ( list->dev );
+   *list = (struct block_list) { .dev = NULL };
+}
@@ -0,0 +1,81 @@
+/*
+ * block_list.h - enumerate the block devices in /sys/class/block
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_BLOCK_LIST_
+#define _DISKID_BLOCK_LIST_
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLOCK_LIST_SYSFS_DIR "/sys/class/block"
+/* "/dev/" + kernel device name, longer names are skipped */
+#define BLOCK_LIST_DEVICE_MAX 64
+
+enum block_class {
+   /* whole disk backed by hardware (has a "device" link) */
+   BLOCK_CLASS_DISK    = 0x1,
+   /* partition of such a disk */
+   BLOCK_CLASS_PART    = 0x2,
+   /* loop, dm, md, zram, ... devices and their partitions */
+   BLOCK_CLASS_VIRTUAL = 0x4,
+   BLOCK_CLASS_ALL     = 0x7,
+};
+
+struct block_dev {
+   dev_t            devnum;
+   enum block_class bclass;
+   /* device node, e.g. "/dev/sda" ("!" in sysfs names becomes "/") */
+   char             device[BLOCK_LIST_DEVICE_MAX];
+};
+
+struct block_list {
+   /* sorted by devnum */
+   struct block_dev* dev;
+   size_t            count;
+   size_t            size;
+};
+
+/*
+ * Parses a comma-separated list of classes (disk, part, virtual)
+ * into a bitmask of enum block_class. Returns 0 on success.
+ */
+int  block_class_parse ( const char* const str, unsigned int* const classes );
+
+/*
+ * Reads /sys/class/block (in one pass over the directory) and adds
+ * all devices whose class is in classes to list, which has to be
+ * zero-initialized. Only the attributes needed to tell the classes apart
+ * are looked at, and the dev attribute only of the devices that are kept.
+ *
+ * Returns 0 on success, else -1 (list may hold some devices then).
+ */
+int  block_list_scan ( struct block_list* const list, const unsigned int classes );
+
+void block_list_free ( struct block_list* const list );
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
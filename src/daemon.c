@@ -0,0 +1,747 @@
+/*
+ * daemon.c - maintain /dev/disk/by-id links based on kernel uevents
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "udev_util.h"
+#include "disk_type.h"
+#include "ata_id.h"
+#include "sysfs.h"
+#include "links.h"
+#include "probe.h"
+#include "block_list.h"
+#include "daemon.h"
+
+#define DAEMON_UEVENT_BUFSIZE  8192
+#define DAEMON_UEVENT_RCVBUF   (16 * 1024 * 1024)
+#define DAEMON_DEVNAME_MAX     64
+
+
+enum daemon_dev_state {
+   DAEMON_DEV_IDLE  = 0,
+   DAEMON_DEV_PROBE = 1, /* needs to be probed */
+   DAEMON_DEV_LINK  = 2, /* needs its links to be updated */
+};
+
+struct daemon_dev {
+   char                   devname[DAEMON_DEVNAME_MAX];
+   /* name of the parent disk, partitions only */
+   char                   parent[DAEMON_DEVNAME_MAX];
+   char                   device[DAEMON_DEVNAME_MAX + 8];
+   char                   target[LINK_NAME_MAX];
+   unsigned int           partn;
+   uint64_t               diskseq;
+   enum daemon_dev_state  state;
+   /* the backend that has identified the device, selects info's member */
+   enum disk_type         type;
+   /* NULL if the device has not been identified (yet) */
+   union u_specific_device_info* info;
+   /* storage for info, kept until the device is removed */
+   union u_specific_device_info* info_buf;
+   /* links that currently exist */
+   struct disk_link_names links;
+};
+
+struct daemon {
+   const struct daemon_config* config;
+   struct links_dir            ldir;
+   struct daemon_dev*          devs;
+   size_t                      count;
+   size_t                      size;
+   /* probe jobs of a batch of devices, reset after each batch */
+   struct arena                arena;
+   struct probe_ctx            probe;
+   /* Identify Controller data, allocated from arena as well */
+   struct nvme_ctrl_cache      nvme_ctrls;
+   /* what the drivers support, for as long as the daemon runs */
+   struct disk_caps            caps;
+};
+
+struct uevent {
+   const char* action;
+   const char* devpath;
+   const char* subsystem;
+   const char* devname;
+   const char* devtype;
+   const char* partn;
+   const char* diskseq;
+};
+
+
+static volatile sig_atomic_t daemon_stop_requested = 0;
+
+static void daemon_signal_handler ( int sig ) {
+   daemon_stop_requested = 1;
+}
+
+
+static struct daemon_dev* daemon_find_dev (
+   struct daemon* const d, const char* const devname
+) {
+   size_t k;
+
+   for ( k = 0; k < d->count; k++ ) {
+      if ( strcmp ( d->devs[k].devname, devname ) == 0 ) {
+         return &(d->devs[k]);
+      }
+   }
+   return NULL;
+}
+
+static struct daemon_dev* daemon_new_dev (
+   struct daemon* const d, const char* const devname
+) {
+   struct daemon_dev* devs;
+   struct daemon_dev* dev;
+   size_t new_size;
+
+   if ( d->count >= d->size ) {
+      new_size = ( d->size == 0 ) ? 64 : ( 2 * d->size );
+      devs     = realloc ( d->devs, new_size * sizeof *devs );
+      if ( devs == NULL ) { return NULL; }
+
+      d->devs = devs;
+      d->size = new_size;
+   }
+
+   dev  = &(d->devs[d->count]);
+   *dev = (struct daemon_dev) { .state = DAEMON_DEV_IDLE, .info = NULL };
+   strcpy ( dev->devname, devname );
+   snprintf ( dev->device, sizeof dev->device, "/dev/%s", devname );
+   if ( links_get_target ( dev->device, dev->target, sizeof dev->target ) != 0 ) {
+      return NULL;
+   }
+
+   d->count++;
+   return dev;
+}
+
+static void daemon_dev_unlink (
+   struct daemon* const d, struct daemon_dev* const dev
+) {
+   int k;
+
+   for ( k = 0; k < LINK_COUNT; k++ ) {
+      if ( dev->links.name[k][0] != '\0' ) {
+         links_remove ( &(d->ldir), dev->target, dev->links.name[k] );
+         dev->links.name[k][0] = '\0';
+      }
+   }
+}
+
+static void daemon_dev_link (
+   struct daemon* const d, struct daemon_dev* const dev
+) {
+   struct disk_link_names names;
+   int k;
+
+   if ( dev->type == DISK_TYPE_NVME ) {
+      links_get_nvme_names ( &(dev->info->nvme), dev->partn, &names );
+   } else if ( dev->type == DISK_TYPE_SCSI ) {
+      links_get_scsi_names ( &(dev->info->scsi), dev->partn, &names );
+   } else {
+      links_get_names ( &(dev->info->ata), dev->partn, &names );
+   }
+
+   for ( k = 0; k < LINK_COUNT; k++ ) {
+      /* remove stale links (e.g. after a media change) */
+      if (
+         dev->links.name[k][0] != '\0' &&
+         strcmp ( dev->links.name[k], names.name[k] ) != 0
+      ) {
+         links_remove ( &(d->ldir), dev->target, dev->links.name[k] );
+      }
+
+      if ( names.name[k][0] != '\0' ) {
+         if ( links_create ( &(d->ldir), dev->target, names.name[k] ) != 0 ) {
+            fprintf ( stderr,
+               "failed to create link '%s' for '%s'\n",
+               names.name[k], dev->device
+            );
+            names.name[k][0] = '\0';
+         }
+      }
+   }
+
+   dev->links = names;
+}
+
+static void daemon_dev_release ( struct daemon_dev* const dev ) {
+   dev->info = NULL;
+}
+
+static void daemon_dev_free ( struct daemon_dev* const dev ) {
+   daemon_dev_release ( dev );
+   if ( dev->info_buf != NULL ) {
+      free ( dev->info_buf );
+      dev->info_buf = NULL;
+   }
+}
+
+/* copies info out of the arena, returns 0 on success */
+static int daemon_dev_set_info (
+   struct daemon_dev* const dev, const enum disk_type type,
+   const union u_specific_device_info* const info
+) {
+   if ( dev->info_buf == NULL ) {
+      dev->info_buf = malloc ( sizeof *(dev->info_buf) );
+      if ( dev->info_buf == NULL ) { return -1; }
+   }
+
+   memcpy ( dev->info_buf, info, sizeof *(dev->info_buf) );
+   if ( type == DISK_TYPE_ATA && info->ata.identify_words != NULL ) {
+      dev->info_buf->ata.identify_words =
+         (uint16_t*) dev->info_buf->ata.identify;
+   }
+   dev->type = type;
+   dev->info = dev->info_buf;
+   return 0;
+}
+
+static void daemon_remove_dev (
+   struct daemon* const d, const char* const devname
+) {
+   struct daemon_dev* const dev = daemon_find_dev ( d, devname );
+
+   if ( dev == NULL ) { return; }
+
+   daemon_dev_unlink ( d, dev );
+   daemon_dev_free ( dev );
+
+   /* fill the gap with the last entry */
+   d->count--;
+   if ( dev != &(d->devs[d->count]) ) {
+      *dev = d->devs[d->count];
+   }
+}
+
+/*
+ * Only devices backed by hardware are of interest, which excludes loop,
+ * dm, md, zram, ... devices. devpath is relative to /sys.
+ */
+static int daemon_devpath_has_device ( const char* const devpath ) {
+   char path[PATH_MAX];
+   int ret;
+
+   ret = snprintf ( path, sizeof path, "/sys%s/device", devpath );
+   if ( ret > 0 && (size_t)ret < sizeof path && access ( path, F_OK ) == 0 ) {
+      return 1;
+   }
+
+   ret = snprintf ( path, sizeof path, "/sys%s/../device", devpath );
+   if ( ret > 0 && (size_t)ret < sizeof path && access ( path, F_OK ) == 0 ) {
+      return 1;
+   }
+
+   return 0;
+}
+
+/* writes the name of devpath's parent dir to buf */
+static void daemon_devpath_parent (
+   const char* const devpath, char* const buf, const size_t len
+) {
+   const char* end;
+   const char* start;
+
+   buf[0] = '\0';
+
+   end = strrchr ( devpath, '/' );
+   if ( end == NULL || end == devpath ) { return; }
+
+   for ( start = end - 1; start > devpath && *start != '/'; start-- ) { ; }
+   if ( *start == '/' ) { start++; }
+
+   if ( (size_t)(end - start) < len ) {
+      memcpy ( buf, start, (size_t)(end - start) );
+      buf[end - start] = '\0';
+   }
+}
+
+static void daemon_queue_dev (
+   struct daemon* const d,
+   const char* const devname, const char* const devpath,
+   const unsigned int partn, const uint64_t diskseq
+) {
+   struct daemon_dev* dev;
+
+   if (
+      devname[0] == '\0' ||
+      strlen ( devname ) >= DAEMON_DEVNAME_MAX ||
+      strstr ( devname, ".." ) != NULL ||
+      !daemon_devpath_has_device ( devpath )
+   ) {
+      return;
+   }
+
+   dev = daemon_find_dev ( d, devname );
+   if ( dev == NULL ) {
+      dev = daemon_new_dev ( d, devname );
+      if ( dev == NULL ) {
+         fprintf ( stderr, "failed to add device '%s'\n", devname );
+         return;
+      }
+   }
+
+   dev->partn = partn;
+   if ( partn > 0 ) {
+      daemon_devpath_parent ( devpath, dev->parent, sizeof dev->parent );
+   } else {
+      dev->parent[0] = '\0';
+   }
+
+   /* same media as before: no need to probe the device again */
+   if ( dev->info != NULL && diskseq != 0 && dev->diskseq == diskseq ) {
+      dev->state = DAEMON_DEV_LINK;
+   } else {
+      daemon_dev_release ( dev );
+      dev->diskseq = diskseq;
+      dev->state   = DAEMON_DEV_PROBE;
+   }
+}
+
+
+static void daemon_probe_job ( struct probe_job* const job, void* const data ) {
+   struct daemon* const d = data;
+
+   probe_job_run ( job, &(d->probe) );
+}
+
+/* probes all disks (partitions=0) or partitions (partitions=1) */
+static void daemon_probe_pending (
+   struct daemon* const d, const int partitions
+) {
+   struct probe_job* jobs;
+   size_t* job_devs;
+   struct daemon_dev* dev;
+   struct daemon_dev* parent;
+   size_t job_count;
+   size_t k;
+
+   jobs     = arena_alloc ( &(d->arena), d->count * sizeof *jobs );
+   job_devs = arena_alloc ( &(d->arena), d->count * sizeof *job_devs );
+   if ( jobs == NULL || job_devs == NULL ) {
+      goto daemon_probe_pending_exit;
+   }
+
+   job_count = 0;
+   for ( k = 0; k < d->count; k++ ) {
+      dev = &(d->devs[k]);
+      if (
+         dev->state != DAEMON_DEV_PROBE ||
+         ( partitions ? (dev->partn == 0) : (dev->partn != 0) )
+      ) {
+         continue;
+      }
+
+      /* partitions share the identity of their disk */
+      parent = ( dev->parent[0] != '\0' ) ? daemon_find_dev ( d, dev->parent ) : NULL;
+      if (
+         parent != NULL && parent->info != NULL &&
+         daemon_dev_set_info ( dev, parent->type, parent->info ) == 0
+      ) {
+         dev->state = DAEMON_DEV_LINK;
+         continue;
+      }
+
+      jobs[job_count]     = (struct probe_job) { .device = dev->device };
+      job_devs[job_count] = k;
+      job_count++;
+   }
+
+   if ( job_count > 0 ) {
+      probe_run ( jobs, job_count, d->config->jobs, daemon_probe_job, d );
+   }
+
+   for ( k = 0; k < job_count; k++ ) {
+      dev = &(d->devs[job_devs[k]]);
+
+      if (
+         jobs[k].status == PROBE_OK && jobs[k].info != NULL &&
+         daemon_dev_set_info ( dev, jobs[k].node->type, jobs[k].info ) == 0
+      ) {
+         dev->state = DAEMON_DEV_LINK;
+      } else {
+         /* not a disk that can be identified (anymore) */
+         daemon_dev_unlink ( d, dev );
+         dev->state = DAEMON_DEV_IDLE;
+      }
+
+      probe_job_release ( &jobs[k] );
+   }
+
+daemon_probe_pending_exit:
+   /*
+    * bounded memory use, no matter how many devices come and go;
+    * the controller data lives in the arena, it is fetched again
+    * for the next batch
+    */
+   nvme_ctrl_cache_free ( &(d->nvme_ctrls) );
+   arena_reset ( &(d->arena) );
+   nvme_ctrl_cache_init ( &(d->nvme_ctrls) );
+}
+
+static void daemon_process_pending ( struct daemon* const d ) {
+   size_t k;
+
+   daemon_probe_pending ( d, 0 );
+   daemon_probe_pending ( d, 1 );
+
+   for ( k = 0; k < d->count; k++ ) {
+      if ( d->devs[k].state == DAEMON_DEV_LINK ) {
+         daemon_dev_link ( d, &(d->devs[k]) );
+         d->devs[k].state = DAEMON_DEV_IDLE;
+      }
+   }
+}
+
+
+static int daemon_parse_uevent (
+   char* const buf, const size_t len, struct uevent* const ev
+) {
+   size_t k;
+   const char* entry;
+
+   *ev = (struct uevent) { .action = NULL };
+
+   /* "<action>@<devpath>\0KEY=value\0..." */
+   if ( strchr ( buf, '@' ) == NULL ) { return -1; }
+
+   for ( k = strlen ( buf ) + 1; k < len; k += strlen ( entry ) + 1 ) {
+      entry = buf + k;
+
+      if ( strncmp ( entry, "ACTION=", 7 ) == 0 ) {
+         ev->action = entry + 7;
+      } else if ( strncmp ( entry, "DEVPATH=", 8 ) == 0 ) {
+         ev->devpath = entry + 8;
+      } else if ( strncmp ( entry, "SUBSYSTEM=", 10 ) == 0 ) {
+         ev->subsystem = entry + 10;
+      } else if ( strncmp ( entry, "DEVNAME=", 8 ) == 0 ) {
+         ev->devname = entry + 8;
+      } else if ( strncmp ( entry, "DEVTYPE=", 8 ) == 0 ) {
+         ev->devtype = entry + 8;
+      } else if ( strncmp ( entry, "PARTN=", 6 ) == 0 ) {
+         ev->partn = entry + 6;
+      } else if ( strncmp ( entry, "DISKSEQ=", 8 ) == 0 ) {
+         ev->diskseq = entry + 8;
+      }
+   }
+
+   return (
+      ev->action != NULL && ev->devpath != NULL &&
+      ev->subsystem != NULL && ev->devname != NULL
+   ) ? 0 : -1;
+}
+
+static void daemon_handle_uevent (
+   struct daemon* const d, const struct uevent* const ev
+) {
+   unsigned long partn;
+   unsigned long long diskseq;
+
+   if ( strcmp ( ev->subsystem, "block" ) != 0 ) {
+      return;
+
+   } else if ( strcmp ( ev->action, "remove" ) == 0 ) {
+      daemon_remove_dev ( d, ev->devname );
+
+   } else if (
+      strcmp ( ev->action, "add" ) == 0 || strcmp ( ev->action, "change" ) == 0
+   ) {
+      partn   = ( ev->partn != NULL ) ? strtoul ( ev->partn, NULL, 10 ) : 0;
+      diskseq = ( ev->diskseq != NULL ) ? strtoull ( ev->diskseq, NULL, 10 ) : 0;
+
+      if (
+         ev->devtype != NULL &&
+         strcmp ( ev->devtype, "partition" ) == 0 && partn == 0
+      ) {
+         return;
+      }
+
+      daemon_queue_dev (
+         d, ev->devname, ev->devpath,
+         (unsigned int)( partn > 0xffff ? 0 : partn ), (uint64_t)diskseq
+      );
+   }
+}
+
+/* queues a device node given on the command line */
+static void daemon_queue_device_arg (
+   struct daemon* const d, const char* const device
+) {
+   struct stat stat_info;
+   char path[SYSFS_PATH_MAX];
+   char real_path[PATH_MAX];
+   uint64_t diskseq;
+
+   if (
+      strncmp ( device, "/dev/", 5 ) != 0 ||
+      stat ( device, &stat_info ) != 0 ||
+      !S_ISBLK ( stat_info.st_mode ) ||
+      sysfs_dev_path ( path, sizeof path, &stat_info, NULL ) != 0 ||
+      realpath ( path, real_path ) == NULL ||
+      strncmp ( real_path, "/sys/", 5 ) != 0
+   ) {
+      fprintf ( stderr, "failed to add device '%s'\n", device );
+      return;
+   }
+
+   if (
+      sysfs_dev_path ( path, sizeof path, &stat_info, "diskseq" ) != 0 ||
+      sysfs_read_uint64 ( path, &diskseq ) != 0
+   ) {
+      diskseq = 0;
+   }
+
+   daemon_queue_dev (
+      d, device + 5, real_path + 4,
+      links_get_partn_stat ( &stat_info ), diskseq
+   );
+}
+
+/*
+ * Events have been lost (uevent queue overrun): queues all disks and
+ * partitions again, as on startup, and removes the devices that are
+ * gone. Devices whose diskseq has not changed are not probed again.
+ */
+static void daemon_rescan ( struct daemon* const d ) {
+   struct block_list blocks = { .dev = NULL };
+   size_t k;
+   size_t b;
+
+   if ( block_list_scan ( &blocks, BLOCK_CLASS_DISK | BLOCK_CLASS_PART ) != 0 ) {
+      fprintf ( stderr, "failed to read " BLOCK_LIST_SYSFS_DIR "\n" );
+      block_list_free ( &blocks );
+      return;
+   }
+
+   /* backwards, daemon_remove_dev() moves the last entry to the gap */
+   for ( k = d->count; k-- > 0; ) {
+      for ( b = 0; b < blocks.count; b++ ) {
+         if ( strcmp ( blocks.dev[b].device, d->devs[k].device ) == 0 ) {
+            break;
+         }
+      }
+      if ( b == blocks.count ) {
+         daemon_remove_dev ( d, d->devs[k].devname );
+      }
+   }
+
+   for ( b = 0; b < blocks.count; b++ ) {
+      daemon_queue_device_arg ( d, blocks.dev[b].device );
+   }
+
+   block_list_free ( &blocks );
+}
+
+
+static int daemon_open_uevent_socket ( void ) {
+   struct sockaddr_nl addr;
+   int rcvbuf;
+   int fd;
+
+   fd = socket (
+      AF_NETLINK, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK,
+      NETLINK_KOBJECT_UEVENT
+   );
+   if ( fd < 0 ) { return -1; }
+
+   /* a large buffer so that event storms do not overflow it */
+   rcvbuf = DAEMON_UEVENT_RCVBUF;
+   if ( setsockopt ( fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof rcvbuf ) != 0 ) {
+      setsockopt ( fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf );
+   }
+
+   memzero ( &addr, sizeof addr );
+   addr.nl_family = AF_NETLINK;
+   addr.nl_groups = 1; /* kernel uevents */
+
+   if ( bind ( fd, (struct sockaddr*) &addr, sizeof addr ) != 0 ) {
+      close ( fd );
+      return -1;
+   }
+
+   return fd;
+}
+
+/*
+ * Receives one uevent.
+ * Returns its length, 0 if the message should be ignored and -1 on error.
+ */
+static ssize_t daemon_recv_uevent (
+   const int fd, char* const buf, const size_t len
+) {
+   struct sockaddr_nl addr;
+   struct iovec iov;
+   struct msghdr msg;
+   ssize_t ret;
+
+   iov = (struct iovec) { .iov_base = buf, .iov_len = len - 1 };
+   msg = (struct msghdr) {
+      .msg_name    = &addr,
+      .msg_namelen = sizeof addr,
+      .msg_iov     = &iov,
+      .msg_iovlen  = 1,
+   };
+
+   ret = recvmsg ( fd, &msg, 0 );
+   if ( ret < 0 ) { return -1; }
+
+   /* accept messages from the kernel only */
+   if ( addr.nl_pid != 0 || (msg.msg_flags & MSG_TRUNC) ) {
+      return 0;
+   }
+
+   buf[ret] = '\0';
+   return ret;
+}
+
+
+int daemon_run (
+   const struct daemon_config* const config,
+   char* const* const devices, const size_t device_count
+) {
+   struct daemon d;
+   struct sigaction sa;
+   struct pollfd pfd;
+   struct uevent ev;
+   char buf[DAEMON_UEVENT_BUFSIZE];
+   ssize_t len;
+   size_t k;
+   int sock;
+   int rescan;
+   int retcode;
+
+   d = (struct daemon) { .config = config, .devs = NULL, .count = 0, .size = 0 };
+   retcode = 1;
+   sock    = -1;
+
+   if ( links_dir_open ( &(d.ldir), config->links_dir, 0 ) != 0 ) {
+      fprintf ( stderr, "failed to open '%s'\n", config->links_dir );
+      return 1;
+   }
+
+   if ( arena_init ( &(d.arena), 0 ) != 0 ) {
+      links_dir_close ( &(d.ldir) );
+      return 1;
+   }
+
+   nvme_ctrl_cache_init ( &(d.nvme_ctrls) );
+   disk_caps_init ( &(d.caps) );
+   d.probe = (struct probe_ctx) {
+      .disk_types = DISK_TYPE_ALL,
+      .cache      = config->cache,
+      .source     = config->source,
+      .arena      = &(d.arena),
+      .nvme_ctrls = &(d.nvme_ctrls),
+      .caps       = &(d.caps),
+      .ops        = NULL,
+      /* no deadline, the daemon runs until it is told to stop */
+      .timeout_msec = config->timeout_msec,
+      .deadline     = 0,
+   };
+
+   memzero ( &sa, sizeof sa );
+   sa.sa_handler = daemon_signal_handler;
+   sigemptyset ( &(sa.sa_mask) );
+   sigaction ( SIGTERM, &sa, NULL );
+   sigaction ( SIGINT, &sa, NULL );
+
+   /* subscribe first, so that no event gets lost while processing devices */
+   sock = daemon_open_uevent_socket();
+   if ( sock < 0 ) {
+      fprintf ( stderr, "failed to open the uevent socket\n" );
+      goto daemon_run_exit;
+   }
+
+   for ( k = 0; k < device_count; k++ ) {
+      daemon_queue_device_arg ( &d, devices[k] );
+   }
+   daemon_process_pending ( &d );
+
+   pfd = (struct pollfd) { .fd = sock, .events = POLLIN };
+
+   while ( !daemon_stop_requested ) {
+      if ( poll ( &pfd, 1, -1 ) < 0 ) {
+         if ( errno == EINTR ) { continue; }
+         fprintf ( stderr, "poll() failed\n" );
+         goto daemon_run_exit;
+      }
+
+      /* collect all queued events, then process them in one go */
+      rescan = 0;
+      for (;;) {
+         len = daemon_recv_uevent ( sock, buf, sizeof buf );
+         if ( len < 0 ) {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+               break;
+            } else if ( errno == ENOBUFS ) {
+               /* once the queue has been drained */
+               rescan = 1;
+            } else if ( errno != EINTR ) {
+               fprintf ( stderr, "failed to receive uevent\n" );
+               goto daemon_run_exit;
+            }
+
+         } else if (
+            len > 0 && daemon_parse_uevent ( buf, (size_t)len, &ev ) == 0
+         ) {
+            daemon_handle_uevent ( &d, &ev );
+         }
+      }
+
+      if ( rescan ) {
+         fprintf ( stderr, "uevent queue overrun, rescanning devices\n" );
+         daemon_rescan ( &d );
+      }
+      daemon_process_pending ( &d );
+   }
+
+   retcode = 0;
+
+daemon_run_exit:
+   if ( sock >= 0 ) { close ( sock ); }
+
+   if ( config->stats ) {
+      fprintf ( stderr, "skipped %lu ioctls\n", d.caps.skipped );
+   }
+
+   /* links are kept */
+   for ( k = 0; k < d.count; k++ ) {
+      daemon_dev_free ( &(d.devs[k]) );
+   }
+   if ( d.devs != NULL ) { free ( d.devs ); }
+   nvme_ctrl_cache_free ( &(d.nvme_ctrls) );
+   arena_free ( &(d.arena) );
+
+   links_dir_close ( &(d.ldir) );
+
+   return retcode;
+}
@@ -0,0 +1,62 @@
+/*
+ * daemon.h - maintain /dev/disk/by-id links based on kernel uevents
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_DAEMON_
+#define _DISKID_DAEMON_
+
+#include <stdlib.h>
+
+#include "disk_type.h"
+#include "id_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct daemon_config {
+   const char*            links_dir;
+   /* may be NULL */
+   const struct id_cache* cache;
+   /* max. number of devices that get probed concurrently */
+   unsigned int           jobs;
+   enum id_source         source;
+   /* timeout of a command, 0: COMMAND_TIMEOUT_MSEC */
+   unsigned int           timeout_msec;
+   /* print the disk_caps counters at exit */
+   unsigned int           stats;
+};
+
+/*
+ * Creates links for the given devices (may be empty), then listens for
+ * block device uevents and adds/removes links as devices come and go.
+ * Runs in the foreground until SIGTERM or SIGINT is received.
+ *
+ * Returns 0 on clean exit, else non-zero.
+ */
+int daemon_run (
+   const struct daemon_config* const config,
+   char* const* const devices, const size_t device_count
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
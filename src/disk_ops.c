@@ -0,0 +1,482 @@
+/*
+ * disk_ops.c - device access of the ATA and SCSI backends
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The SG_IO commands have been moved here from ata_id.c,
+ * which is based on udev's ata_id.c:
+ *
+ * Copyright (C) 2005-2008 Kay Sievers <kay@vrfy.org>
+ * Copyright (C) 2009 Lennart Poettering <lennart@poettering.net>
+ * Copyright (C) 2009-2010 David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <scsi/scsi.h>
+#include <scsi/sg.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/hdreg.h>
+#include <linux/bsg.h>
+
+#include "util.h"
+#include "sysfs.h"
+#include "disk_type.h"
+#include "ata_id.h"
+#include "disk_ops.h"
+
+/* host byte / driver byte of a command that timed out, from scsi/scsi.h */
+#define DISK_SG_DID_TIME_OUT   0x03
+#define DISK_SG_DRIVER_TIMEOUT 0x06
+
+
+static int disk_sg_open (
+   const struct disk_ops* const ops, const char* const device,
+   const int flags
+) {
+   (void) ops;
+   return open ( device, flags );
+}
+
+static inline uint8_t* disk_caps_get_slot ( const struct disk_info* const node ) {
+   return (
+      node->caps != NULL && node->dev_major != 0 &&
+      node->dev_major != DISK_CAPS_SHARED_MAJOR &&
+      node->dev_major < DISK_CAPS_MAX_MAJOR
+   ) ? &(node->caps->unsupported[node->dev_major]) : NULL;
+}
+
+int disk_caps_skip ( const struct disk_info* const node, const enum disk_cap cap ) {
+   const uint8_t* const slot = disk_caps_get_slot ( node );
+
+   if ( slot != NULL && ( __atomic_load_n ( slot, __ATOMIC_RELAXED ) & cap ) ) {
+      __sync_add_and_fetch ( &(node->caps->skipped), 1 );
+      return 1;
+   }
+   return 0;
+}
+
+void disk_caps_set_unsupported (
+   const struct disk_info* const node, const enum disk_cap cap
+) {
+   uint8_t* const slot = disk_caps_get_slot ( node );
+   struct stat stat_info;
+   char path[SYSFS_PATH_MAX];
+
+   if ( slot == NULL || fstat ( node->fd, &stat_info ) != 0 ) {
+      return;
+   }
+
+   /*
+    * Partitions share the major of their disk, but not its ioctls
+    * (SG_IO needs CAP_SYS_RAWIO there), they do not speak for the driver.
+    * This is rare enough (once per driver) to ask sysfs.
+    */
+   if (
+      sysfs_dev_path ( path, sizeof path, &stat_info, "partition" ) == 0 &&
+      access ( path, F_OK ) == 0
+   ) {
+      return;
+   }
+
+   __sync_fetch_and_or ( slot, (uint8_t)cap );
+}
+
+
+/* whether a command failed because it timed out */
+static inline int disk_sg_timed_out (
+   const unsigned int host_status, const unsigned int driver_status
+) {
+   return (
+      host_status == DISK_SG_DID_TIME_OUT ||
+      ( driver_status & 0x0f ) == DISK_SG_DRIVER_TIMEOUT
+   ) ? 1 : 0;
+}
+
+/* status bytes of a command, the same for both SG_IO versions */
+struct disk_sg_status {
+   unsigned int device_status;
+   unsigned int host_status;
+   unsigned int driver_status;
+};
+
+/*
+ * Sends a data-in command with the given SG_IO version.
+ * Returns 0 if the ioctl succeeds (the command may still have failed,
+ * see *status and sense), -1 if not (ETIMEDOUT if the command timed out).
+ */
+static int disk_sg_send (
+   const struct disk_info* const node, const enum disk_sg_version version,
+   uint8_t* const cdb, const size_t cdb_len,
+   void* const buf, const size_t buf_len,
+   uint8_t* const sense, const size_t sense_len,
+   const unsigned int timeout_msec, struct disk_sg_status* const status
+) {
+   struct sg_io_v4 io_v4;
+   struct sg_io_hdr io_hdr;
+
+   if ( version == DISK_SG_V4 ) {
+      io_v4 = (struct sg_io_v4) {
+         .guard            = 'Q',
+         .protocol         = BSG_PROTOCOL_SCSI,
+         .subprotocol      = BSG_SUB_PROTOCOL_SCSI_CMD,
+         .request_len      = cdb_len,
+         .request          = (uintptr_t) cdb,
+         .max_response_len = sense_len,
+         .response         = (uintptr_t) sense,
+         .din_xfer_len     = buf_len,
+         .din_xferp        = (uintptr_t) buf,
+         .timeout          = timeout_msec,
+      };
+
+      if ( ioctl ( node->fd, SG_IO, &io_v4 ) != 0 ) {
+         return -1;
+      }
+
+      status->device_status = io_v4.device_status;
+      status->host_status   = io_v4.transport_status;
+      status->driver_status = io_v4.driver_status;
+
+   } else {
+      io_hdr = (struct sg_io_hdr) {
+         .interface_id    = 'S',
+         .cmdp            = cdb,
+         .cmd_len         = cdb_len,
+         .dxferp          = buf,
+         .dxfer_len       = buf_len,
+         .sbp             = sense,
+         .mx_sb_len       = sense_len,
+         .dxfer_direction = SG_DXFER_FROM_DEV,
+         .timeout         = timeout_msec,
+      };
+
+      if ( ioctl ( node->fd, SG_IO, &io_hdr ) != 0 ) {
+         return -1;
+      }
+
+      status->device_status = io_hdr.status;
+      status->host_status   = io_hdr.host_status;
+      status->driver_status = io_hdr.driver_status;
+   }
+
+   if ( disk_sg_timed_out ( status->host_status, status->driver_status ) ) {
+      errno = ETIMEDOUT;
+      return -1;
+   }
+
+   return 0;
+}
+
+/* IDENTIFY [PACKET] DEVICE, tunneled through ATA PASS-THROUGH */
+static int disk_sg_ata_identify (
+   const struct disk_info* const node, const enum ata_id_command cmd,
+   void* const buf, const size_t buf_len,
+   const unsigned int timeout_msec, const enum disk_sg_version version
+) {
+   uint8_t cdb[16];
+   const size_t cdb_len = ata_id_init_cdb ( cmd, cdb, buf_len );
+   uint8_t sense[32] = {0};
+   struct disk_sg_status status;
+
+   if (
+      disk_sg_send (
+         node, version, cdb, cdb_len, buf, buf_len, sense, sizeof sense,
+         timeout_msec, &status
+      ) != 0
+   ) {
+      return -1;
+   }
+
+   if ( !ata_id_sense_ok ( sense ) ) {
+      errno = EIO;
+      return -1;
+   }
+
+   return 0;
+}
+
+static int disk_sg_identify (
+   const struct disk_info* const node, void* const buf, const size_t buf_len,
+   const unsigned int timeout_msec, const enum disk_sg_version version
+) {
+   return disk_sg_ata_identify (
+      node, ATA_ID_CMD_IDENTIFY, buf, buf_len, timeout_msec, version
+   );
+}
+
+static int disk_sg_identify_packet (
+   const struct disk_info* const node, void* const buf, const size_t buf_len,
+   const unsigned int timeout_msec, const enum disk_sg_version version
+) {
+   return disk_sg_ata_identify (
+      node, ATA_ID_CMD_IDENTIFY_PACKET, buf, buf_len, timeout_msec, version
+   );
+}
+
+static int disk_sg_inquiry (
+   const struct disk_info* const node, const int vpd_page,
+   void* const buf, const size_t buf_len,
+   const unsigned int timeout_msec, const enum disk_sg_version version
+) {
+   uint8_t cdb[16];
+   const size_t cdb_len = ata_id_init_cdb (
+      ATA_ID_CMD_INQUIRY, cdb, buf_len
+   );
+   uint8_t sense[32] = {0};
+   struct disk_sg_status status;
+
+   if ( vpd_page >= 0 ) {
+      cdb[1] = 0x01;                /* EVPD */
+      cdb[2] = (uint8_t) vpd_page;  /* PAGE CODE */
+   }
+
+   if (
+      disk_sg_send (
+         node, version, cdb, cdb_len, buf, buf_len, sense, sizeof sense,
+         timeout_msec, &status
+      ) != 0
+   ) {
+      return -1;
+   }
+
+   /* even if the ioctl succeeds, we need to check the return value */
+   if ( !(
+      status.device_status == 0 &&
+      status.host_status   == 0 &&
+      status.driver_status == 0
+   ) ) {
+      errno = EIO;
+      return -1;
+   }
+
+   return 0;
+}
+
+/*
+ * Whether HDIO_GET_IDENTITY works is up to the SCSI host (libata has it,
+ * usb-storage and SAS HBAs do not) rather than the driver of the device
+ * node, so it is not remembered in node->caps.
+ */
+static int disk_sg_hdio_identity (
+   const struct disk_info* const node, struct hd_driveid* const id
+) {
+   return ( ioctl ( node->fd, HDIO_GET_IDENTITY, id ) == 0 ) ? 0 : -1;
+}
+
+
+const struct disk_ops disk_ops_sg = {
+   .name            = "sg",
+   .open            = disk_sg_open,
+   .inquiry         = disk_sg_inquiry,
+   .identify        = disk_sg_identify,
+   .identify_packet = disk_sg_identify_packet,
+   .hdio_identity   = disk_sg_hdio_identity,
+   .priv            = NULL,
+};
+
+
+unsigned int disk_cmd_timeout (
+   const struct disk_info* const node, const enum disk_cmd_attempt attempt
+) {
+   const unsigned int total = ( node->timeout_msec > 0 )
+      ? node->timeout_msec : COMMAND_TIMEOUT_MSEC;
+   unsigned int first;
+   unsigned int timeout;
+   uint64_t now;
+   uint64_t left;
+
+   first = total / 4;
+   if ( first < DISK_CMD_MIN_TIMEOUT_MSEC ) {
+      first = ( total < DISK_CMD_MIN_TIMEOUT_MSEC )
+         ? total : DISK_CMD_MIN_TIMEOUT_MSEC;
+   }
+
+   switch ( attempt ) {
+      case DISK_CMD_FIRST:
+         timeout = first;
+         break;
+      case DISK_CMD_RETRY:
+         timeout = total - first;
+         break;
+      default:
+         timeout = total;
+         break;
+   }
+
+   if ( node->deadline != 0 && timeout > 0 ) {
+      now = util_now_ns();
+      if ( now >= node->deadline ) {
+         return 0;
+      }
+
+      left = ( node->deadline - now ) / 1000000;
+      if ( left < timeout ) {
+         timeout = (unsigned int)left;
+      }
+   }
+
+   return timeout;
+}
+
+/* the commands disk_cmd_run() can send */
+enum disk_op {
+   DISK_OP_INQUIRY,
+   DISK_OP_IDENTIFY,
+   DISK_OP_IDENTIFY_PACKET,
+};
+
+static int disk_cmd_call (
+   const struct disk_info* const node, const enum disk_op op,
+   const int vpd_page, void* const buf, const size_t buf_len,
+   const unsigned int timeout, const enum disk_sg_version version
+) {
+   const struct disk_ops* const ops = node->ops;
+
+   switch ( op ) {
+      case DISK_OP_INQUIRY:
+         return ops->inquiry (
+            node, vpd_page, buf, buf_len, timeout, version
+         );
+      case DISK_OP_IDENTIFY:
+         return ops->identify ( node, buf, buf_len, timeout, version );
+      default:
+         return ops->identify_packet ( node, buf, buf_len, timeout, version );
+   }
+}
+
+/*
+ * Sends a command with SG_IO v4, falling back to v3 if the driver does
+ * not do version 4 (EINVAL). What the driver has rejected is remembered
+ * in node->caps, so that its other devices go straight to what works.
+ */
+static int disk_cmd_send (
+   const struct disk_info* const node, const enum disk_op op,
+   const int vpd_page, void* const buf, const size_t buf_len,
+   const unsigned int timeout
+) {
+   int ret;
+   int err;
+
+   if ( disk_caps_skip ( node, DISK_CAP_SG_IO ) ) {
+      errno = ENOTTY;
+      return -1;
+
+   } else if ( disk_caps_skip ( node, DISK_CAP_SG_V4 ) ) {
+      ret = -1;
+      err = EINVAL;
+
+   } else {
+      ret = disk_cmd_call (
+         node, op, vpd_page, buf, buf_len, timeout, DISK_SG_V4
+      );
+      if ( ret == 0 ) {
+         return 0;
+      }
+      err = errno;
+
+      if ( err == ENOTTY ) {
+         disk_caps_set_unsupported ( node, DISK_CAP_SG_IO );
+      } else if ( err == EINVAL ) {
+         disk_caps_set_unsupported ( node, DISK_CAP_SG_V4 );
+      }
+   }
+
+   /* could be that the driver doesn't do version 4, try version 3 */
+   if ( err == EINVAL ) {
+      ret = disk_cmd_call (
+         node, op, vpd_page, buf, buf_len, timeout, DISK_SG_V3
+      );
+      err = errno;
+
+      /* rejects both versions, no SG_IO at all */
+      if ( ret != 0 && ( err == EINVAL || err == ENOTTY ) ) {
+         disk_caps_set_unsupported ( node, DISK_CAP_SG_IO );
+      }
+   }
+
+   errno = err;
+   return ret;
+}
+
+static int disk_cmd_run (
+   struct disk_info* const node, const enum disk_op op,
+   const int vpd_page, void* const buf, const size_t buf_len
+) {
+   static const enum disk_cmd_attempt attempts[] = {
+      DISK_CMD_FIRST, DISK_CMD_RETRY
+   };
+   unsigned int timeout;
+   size_t k;
+   int ret;
+
+   if ( node->timed_out ) {
+      errno = ETIMEDOUT;
+      return -1;
+   }
+
+   for ( k = 0; k < sizeof attempts / sizeof *attempts; k++ ) {
+      timeout = disk_cmd_timeout ( node, attempts[k] );
+      if ( timeout == 0 ) {
+         break;
+      }
+
+      ret = disk_cmd_send ( node, op, vpd_page, buf, buf_len, timeout );
+      if ( ret == 0 || errno != ETIMEDOUT ) {
+         return ret;
+      }
+   }
+
+   /* dead or out of time, spare it (and the run) the other commands */
+   node->timed_out = 1;
+   errno           = ETIMEDOUT;
+   return -1;
+}
+
+int disk_cmd_inquiry (
+   struct disk_info* const node, const int vpd_page,
+   void* const buf, const size_t buf_len
+) {
+   return disk_cmd_run ( node, DISK_OP_INQUIRY, vpd_page, buf, buf_len );
+}
+
+int disk_cmd_identify (
+   struct disk_info* const node, void* const buf, const size_t buf_len
+) {
+   return disk_cmd_run ( node, DISK_OP_IDENTIFY, -1, buf, buf_len );
+}
+
+int disk_cmd_identify_packet (
+   struct disk_info* const node, void* const buf, const size_t buf_len
+) {
+   return disk_cmd_run ( node, DISK_OP_IDENTIFY_PACKET, -1, buf, buf_len );
+}
+
+int disk_cmd_hdio_identity (
+   struct disk_info* const node, struct hd_driveid* const id
+) {
+   if ( node->timed_out || disk_cmd_timeout ( node, DISK_CMD_ONLY ) == 0 ) {
+      node->timed_out = 1;
+      errno           = ETIMEDOUT;
+      return -1;
+   }
+
+   return node->ops->hdio_identity ( node, id );
+}
@@ -0,0 +1,186 @@
+/*
+ * disk_ops.h - device access of the ATA and SCSI backends
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_DISK_OPS_
+#define _DISKID_DISK_OPS_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <linux/hdreg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct disk_info;
+
+/* SG_IO interface version a command is sent with */
+enum disk_sg_version {
+   /* struct sg_io_v4 */
+   DISK_SG_V4,
+   /* struct sg_io_hdr */
+   DISK_SG_V3,
+};
+
+/*
+ * Every command the ATA and SCSI backends send to a device goes through
+ * its node's disk_ops, so that they can be served by something else than
+ * a real disk (see fake_disk.h).
+ *
+ * The command functions give up after timeout_msec and return 0 on
+ * success, else -1 and set errno (ETIMEDOUT if the command timed out).
+ * SCSI commands are sent with the given SG_IO version, an implementation
+ * that does not support it fails with EINVAL (ENOTTY: no SG_IO at all).
+ * The backends call them through disk_cmd_*(), which take care of
+ * the SG_IO version, timeouts, retries and the deadline.
+ */
+struct disk_ops {
+   const char* name;
+   /* returns a file descriptor for device, or -1 */
+   int  (*open) (
+      const struct disk_ops* const ops, const char* const device,
+      const int flags
+   );
+   /* standard INQUIRY (vpd_page < 0) or a VPD page */
+   int  (*inquiry) (
+      const struct disk_info* const node, const int vpd_page,
+      void* const buf, const size_t buf_len, const unsigned int timeout_msec,
+      const enum disk_sg_version version
+   );
+   /* ATA IDENTIFY DEVICE, buf_len is 512 */
+   int  (*identify) (
+      const struct disk_info* const node,
+      void* const buf, const size_t buf_len, const unsigned int timeout_msec,
+      const enum disk_sg_version version
+   );
+   /* ATA IDENTIFY PACKET DEVICE, buf_len is 512 */
+   int  (*identify_packet) (
+      const struct disk_info* const node,
+      void* const buf, const size_t buf_len, const unsigned int timeout_msec,
+      const enum disk_sg_version version
+   );
+   /* HDIO_GET_IDENTITY */
+   int  (*hdio_identity) (
+      const struct disk_info* const node, struct hd_driveid* const id
+   );
+   /* private data of the implementation */
+   void* priv;
+};
+
+/* SG_IO and HDIO_GET_IDENTITY */
+extern const struct disk_ops disk_ops_sg;
+
+/* majors are 12 bits wide (see linux/kdev_t.h) */
+#define DISK_CAPS_MAX_MAJOR 4096
+
+/*
+ * blkext, partitions (and NVMe namespaces) of any driver,
+ * which is why nothing is remembered for it
+ */
+#define DISK_CAPS_SHARED_MAJOR 259
+
+/* interfaces a driver may not support */
+enum disk_cap {
+   /* SG_IO at all (ENOTTY: legacy IDE, virtio, NVMe, ...) */
+   DISK_CAP_SG_IO = 0x1,
+   /* SG_IO with struct sg_io_v4 (EINVAL: v3 only) */
+   DISK_CAP_SG_V4 = 0x2,
+};
+
+/*
+ * What the devices of a run have shown about their drivers, keyed by
+ * the major number of the device node: once a driver has rejected an
+ * interface, its other devices are not asked again.
+ * Safe to share between threads, a run (or the daemon) owns one.
+ */
+struct disk_caps {
+   /* enum disk_cap mask of the interfaces each major does not support */
+   uint8_t       unsupported[DISK_CAPS_MAX_MAJOR];
+   /* calls that have not been made because of the above */
+   unsigned long skipped;
+};
+
+static inline void disk_caps_init ( struct disk_caps* const caps ) {
+   memset ( caps, 0, sizeof *caps );
+}
+
+/*
+ * Returns 1 (and counts the call as skipped) if node's driver is known
+ * not to support cap, else 0. node->caps may be NULL.
+ */
+int disk_caps_skip ( const struct disk_info* const node, const enum disk_cap cap );
+
+/* remembers that node's driver does not support cap */
+void disk_caps_set_unsupported (
+   const struct disk_info* const node, const enum disk_cap cap
+);
+
+/* a first attempt never gets less than this (unless the deadline is near) */
+#define DISK_CMD_MIN_TIMEOUT_MSEC 100
+
+enum disk_cmd_attempt {
+   /* a quarter of the node's timeout, a healthy disk answers in time */
+   DISK_CMD_FIRST,
+   /* the rest of it, for disks that are slow (spinning up, ...) */
+   DISK_CMD_RETRY,
+   /* all of it, for commands that are not retried */
+   DISK_CMD_ONLY,
+};
+
+/*
+ * Returns the timeout of the given attempt of a command to node,
+ * cut short by node->deadline, or 0 if there is no time left for it.
+ * A command that is retried costs no more than the node's timeout in total.
+ */
+unsigned int disk_cmd_timeout (
+   const struct disk_info* const node, const enum disk_cmd_attempt attempt
+);
+
+/*
+ * The node's disk_ops commands, sent with SG_IO v4 or, if node's driver
+ * rejects that (or is known to, see disk_caps), v3. Each is retried once with a longer timeout
+ * if it times out. Once a command has timed out for good (or the deadline
+ * has passed), node->timed_out is set and the node does not get any
+ * further commands: they fail with ETIMEDOUT right away.
+ */
+int disk_cmd_inquiry (
+   struct disk_info* const node, const int vpd_page,
+   void* const buf, const size_t buf_len
+);
+
+int disk_cmd_identify (
+   struct disk_info* const node, void* const buf, const size_t buf_len
+);
+
+int disk_cmd_identify_packet (
+   struct disk_info* const node, void* const buf, const size_t buf_len
+);
+
+/* HDIO_GET_IDENTITY has no timeout of its own, it is sent only once */
+int disk_cmd_hdio_identity (
+   struct disk_info* const node, struct hd_driveid* const id
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -28,20 +28,16 @@ int set_disk_id (
    struct disk_info* const node,
    const char* const model, const char* const serial
 ) {
-   if ( node->disk_id != NULL ) {
-      free ( node->disk_id );
-      node->disk_id = NULL;
-   }
+   /* a previous disk_id stays in the arena until it gets reset */
+   node->disk_id = NULL;
 
    if ( model == NULL || model[0] == '\0' ) {
       return 1;
 
    } else if ( serial == NULL || serial[0] == '\0' ) {
-      /* copy model to node->disk_id */
-      /* node->disk_id = model; */ /* ref */
-      node->disk_id = strdup ( model );
+      node->disk_id = arena_strdup ( node->arena, model );
    } else {
-      node->disk_id = join_str_triple ( model, "_", serial );
+      node->disk_id = arena_join3 ( node->arena, model, "_", serial );
    }
 
    return ( node->disk_id != NULL ) ? 0 : 2;
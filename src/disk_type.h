@@ -22,13 +22,17 @@
 
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include <string.h>
 #include <libgen.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 
 #include "util.h"
+#include "arena.h"
+#include "disk_ops.h"
 
 
 #ifdef __cplusplus
@@ -39,16 +43,55 @@ enum disk_type {
    DISK_TYPE_NONE = 0,
    DISK_TYPE_ATA  = 1,
    DISK_TYPE_SCSI = 2,
-   DISK_TYPE_ALL  = (1<<2) - 1,
+   DISK_TYPE_NVME = 4,
+   DISK_TYPE_ALL  = (1<<3) - 1,
 };
 
+/* where disk identities are read from */
+enum id_source {
+   ID_SOURCE_IOCTL = 0, /* SG_IO pass-through / HDIO_GET_IDENTITY */
+   ID_SOURCE_SYSFS = 1, /* sysfs attributes only */
+   ID_SOURCE_AUTO  = 2, /* sysfs, falling back to ioctl */
+   /* like auto, but only full IDENTIFY data is accepted from sysfs */
+   ID_SOURCE_IDENTIFY = 3,
+};
+
+/* standard INQUIRY data length (SPC-4, section 6.4.2) */
+#define DISK_INQUIRY_LEN 36
+
+struct id_cache;
+struct nvme_ctrl_cache;
+
+/* allocated from an arena, which also owns var_name and disk_id */
 struct disk_info {
-   const char*    device;
-   const char*    name;
-   char*          var_name;
-   enum disk_type type;
-   int            fd;
-   char*          disk_id;
+   struct arena*           arena;
+   /* how commands are sent to the device */
+   const struct disk_ops*  ops;
+   const char*             device;
+   const char*             name;
+   char*                   var_name;
+   enum disk_type          type;
+   int                     fd;
+   char*                   disk_id;
+   /* optional, may be NULL */
+   const struct id_cache*  cache;
+   enum id_source          source;
+   /* optional, may be NULL */
+   struct nvme_ctrl_cache* nvme_ctrls;
+   /* optional, may be NULL, keyed by dev_major (0: not a device node) */
+   struct disk_caps*       caps;
+   unsigned int            dev_major;
+   /* standard INQUIRY data, shared by the ATA and SCSI backends */
+   uint8_t                 inquiry[DISK_INQUIRY_LEN];
+   size_t                  inquiry_len;
+   /*
+    * timeout of a command (0: COMMAND_TIMEOUT_MSEC) and deadline of the
+    * whole run (util_now_ns() time base, 0: none), see disk_cmd_timeout()
+    */
+   unsigned int            timeout_msec;
+   uint64_t                deadline;
+   /* a command has timed out, the device does not get any further ones */
+   int                     timed_out;
 };
 
 
@@ -64,26 +107,63 @@ static inline void set_disk_type_scsi ( struct disk_info* const pnode ) {
    pnode->type = DISK_TYPE_SCSI;
 }
 
+static inline void set_disk_type_nvme ( struct disk_info* const pnode ) {
+   pnode->type = DISK_TYPE_NVME;
+}
+
+
+/* the major number of the device node fd refers to, 0 if none */
+static inline unsigned int disk_info_get_major ( const int fd ) {
+   struct stat stat_info;
+
+   return (
+      fstat ( fd, &stat_info ) == 0 &&
+      ( S_ISBLK ( stat_info.st_mode ) || S_ISCHR ( stat_info.st_mode ) )
+   ) ? major ( stat_info.st_rdev ) : 0;
+}
 
-static inline struct disk_info* init_disk_info ( const char* const device ) {
+/* ops may be NULL (disk_ops_sg) */
+static inline struct disk_info* init_disk_info_flags (
+   const char* const device, const int open_flags, struct arena* const arena,
+   const struct disk_ops* ops
+) {
    int fd;
    struct disk_info* pnode = NULL;
 
+   if ( ops == NULL ) {
+      ops = &disk_ops_sg;
+   }
+
    if ( device != NULL ) {
       /* for meaningful return values, device should not be NULL */
-      fd = open ( device, O_RDONLY|O_NONBLOCK );
+      fd = ops->open ( ops, device, open_flags );
       if ( fd >= 0 ) {
-         pnode = malloc ( sizeof *pnode );
+         pnode = arena_alloc ( arena, sizeof *pnode );
          if ( pnode != NULL ) {
             *pnode = (struct disk_info) {
+               .arena  = arena,
+               .ops    = ops,
                .device = device,
                .name = basename ( (char*)device ),
                .var_name = NULL,
                .type = DISK_TYPE_NONE,
                .fd = fd,
                .disk_id = NULL,
+               .cache = NULL,
+               .source = ID_SOURCE_IOCTL,
+               .nvme_ctrls = NULL,
+               .caps = NULL,
+               .dev_major = disk_info_get_major ( fd ),
+               .inquiry_len = 0,
+               .timeout_msec = 0,
+               .deadline = 0,
+               .timed_out = 0,
             };
-            pnode->var_name = get_uppercase ( pnode->name );
+            pnode->var_name = arena_strdup_upper ( arena, pnode->name );
+         }
+         if ( pnode == NULL || pnode->var_name == NULL ) {
+            close ( fd );
+            pnode = NULL;
          }
       }
    }
@@ -91,21 +171,21 @@ static inline struct disk_info* init_disk_info ( const char* const device ) {
    return pnode;
 }
 
-static inline void close_disk_info ( struct disk_info* pnode ) {
+static inline struct disk_info* init_disk_info (
+   const char* const device, struct arena* const arena,
+   const struct disk_ops* const ops
+) {
+   return init_disk_info_flags ( device, O_RDONLY|O_NONBLOCK, arena, ops );
+}
+
+static inline void close_disk_info_fd ( struct disk_info* const pnode ) {
    if ( pnode->fd >= 0 ) {
       close ( pnode->fd );
       pnode->fd = -1;
    }
-   if ( pnode->disk_id != NULL ) {
-      free ( pnode->disk_id );
-      pnode->disk_id = NULL;
-   }
-   if ( pnode->var_name != NULL ) {
-      free ( pnode->var_name );
-   }
-   free(pnode);
 }
 
+/* node->disk_id = "<model>[_<serial>]", allocated from node->arena */
 int set_disk_id (
    struct disk_info* const node,
    const char* const model, const char* const serial
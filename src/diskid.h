@@ -0,0 +1,133 @@
+/*
+ * diskid.h - libdiskid, probe disk identities from other programs
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_DISKID_
+#define _DISKID_DISKID_
+
+/*
+ * This is the public interface of libdiskid. It depends on nothing else
+ * from diskid's source tree, and results are accessed only by functions,
+ * so that their layout can change without breaking users of the library.
+ *
+ * All functions are reentrant: the library has no global state, everything
+ * a probe needs lives as long as a diskid_probe_many() call.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DISKID_API_VERSION 1
+
+/* diskid_probe_many() flags, backends to try (in this order) */
+#define DISKID_TYPE_ATA        0x0001u
+#define DISKID_TYPE_SCSI       0x0002u
+#define DISKID_TYPE_NVME       0x0004u
+#define DISKID_TYPE_ALL        0x0007u
+
+/* where identities are read from, see diskid --source (default: ioctl) */
+#define DISKID_SOURCE_IOCTL    0x0000u
+#define DISKID_SOURCE_SYSFS    0x0100u
+#define DISKID_SOURCE_AUTO     0x0200u
+#define DISKID_SOURCE_IDENTIFY 0x0300u
+#define DISKID_SOURCE_MASK     0x0300u
+
+/* probe up to n (< 65536) devices concurrently (default: one at a time) */
+#define DISKID_JOBS(n)         ( ( (unsigned int)(n) & 0xffffu ) << 16 )
+
+enum diskid_status {
+   DISKID_OK         = 0,
+   /* the device could not be opened */
+   DISKID_ERR_OPEN   = 1,
+   /* none of the requested backends identified the device */
+   DISKID_ERR_DETECT = 2,
+};
+
+/*
+ * All memory of a diskid_probe_many() call is allocated with alloc()
+ * and released with free(), ctx is passed to both.
+ * alloc() has to return memory suitably aligned for any type.
+ */
+struct diskid_allocator {
+   void* (*alloc) ( void* ctx, size_t size );
+   void  (*free)  ( void* ctx, void* ptr );
+   void* ctx;
+};
+
+struct diskid_results;
+struct diskid_result;
+
+/*
+ * Probes devs[0..n) (device node paths), the results are stored in
+ * the same order in *results, which has to be freed with
+ * diskid_results_free(). flags is a combination of DISKID_TYPE_*,
+ * one DISKID_SOURCE_* value and DISKID_JOBS(), 0 means DISKID_TYPE_ALL.
+ * allocator may be NULL (malloc() and free()).
+ *
+ * A device that cannot be probed does not make the call fail,
+ * see diskid_result_status().
+ *
+ * Returns 0 on success, else -1 and sets errno (EINVAL, ENOMEM).
+ */
+int diskid_probe_many (
+   const char* const* devs, size_t n, unsigned int flags,
+   const struct diskid_allocator* allocator,
+   struct diskid_results** results
+);
+
+void   diskid_results_free  ( struct diskid_results* results );
+size_t diskid_results_count ( const struct diskid_results* results );
+/* k < diskid_results_count(), the result lives as long as results */
+const struct diskid_result* diskid_results_get (
+   const struct diskid_results* results, size_t k
+);
+/*
+ * Number of ioctls the call has not made because the device's driver
+ * had already rejected them for another device (SG_IO, SG_IO v4)
+ */
+unsigned long diskid_results_skipped ( const struct diskid_results* results );
+
+/* the path given to diskid_probe_many() */
+const char*        diskid_result_device   ( const struct diskid_result* r );
+enum diskid_status diskid_result_status   ( const struct diskid_result* r );
+/* DISKID_TYPE_ATA, _SCSI or _NVME, 0 if status is not DISKID_OK */
+unsigned int       diskid_result_type     ( const struct diskid_result* r );
+
+/* identity strings, empty if not available */
+const char*        diskid_result_model    ( const struct diskid_result* r );
+const char*        diskid_result_serial   ( const struct diskid_result* r );
+const char*        diskid_result_revision ( const struct diskid_result* r );
+/* "0x<NAA>" (ATA, SCSI) or "eui.<...>" (NVMe) */
+const char*        diskid_result_wwn      ( const struct diskid_result* r );
+
+/*
+ * The raw IDENTIFY [PACKET] DEVICE data (512 bytes, little-endian words)
+ * of an ATA device, NULL if not available.
+ */
+const uint8_t*     diskid_result_identify ( const struct diskid_result* r );
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
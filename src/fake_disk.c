@@ -0,0 +1,377 @@
+/*
+ * fake_disk.c - simulated ATA disks for benchmarking the probe code
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <linux/hdreg.h>
+
+#include "udev_util.h"
+#include "disk_type.h"
+#include "disk_ops.h"
+#include "ata_id.h"
+#include "fake_disk.h"
+
+enum fake_disk_cmd {
+   FAKE_CMD_INQUIRY,
+   FAKE_CMD_IDENTIFY,
+   FAKE_CMD_IDENTIFY_PACKET,
+   FAKE_CMD_HDIO,
+};
+
+/* NAA 5 WWN of disk 0, disk n gets FAKE_DISK_WWN_BASE + n */
+#define FAKE_DISK_WWN_BASE 0x5000c50000000000ULL
+
+
+static inline void fake_put_word (
+   uint8_t* const identify, const unsigned int word, const uint16_t value
+) {
+   identify[word * 2]     = (uint8_t)( value & 0xff );
+   identify[word * 2 + 1] = (uint8_t)( value >> 8 );
+}
+
+/* ATA strings: two chars per word, first char in the high byte */
+static void fake_put_string (
+   uint8_t* const identify, const unsigned int word, const size_t len,
+   const char* const str
+) {
+   const size_t slen = strlen ( str );
+   size_t k;
+   char c;
+
+   for ( k = 0; k < len; k++ ) {
+      c = ( k < slen ) ? str[k] : ' ';
+      identify[word * 2 + ( k ^ 1 )] = (uint8_t)c;
+   }
+}
+
+void fake_disk_config_init ( struct fake_disk_config* const config ) {
+   uint8_t* const id = config->identify;
+
+   memzero ( config, sizeof *config );
+
+   fake_put_word   ( id,   0, 0x0040 );    /* fixed disk, ATA device */
+   fake_put_string ( id,  10, 20, "FAKE" );
+   fake_put_string ( id,  23,  8, "1.0" );
+   fake_put_string ( id,  27, 40, "diskid fake disk" );
+   fake_put_word   ( id,  49, 0x0200 );    /* LBA */
+   fake_put_word   ( id,  60, 0xffff );    /* 28-bit LBA capacity */
+   fake_put_word   ( id,  61, 0x0fff );
+   fake_put_word   ( id,  76, 0x010e );    /* SATA gen1-3, NCQ */
+   fake_put_word   ( id,  80, 0x03f0 );    /* ATA8-ACS .. ACS-3 */
+   fake_put_word   ( id,  82, 0x7469 );    /* SMART, security, ... */
+   fake_put_word   ( id,  83, 0x7d09 );    /* 48-bit LBA */
+   fake_put_word   ( id,  84, 0x6163 );    /* WWN */
+   fake_put_word   ( id,  85, 0x7469 );
+   fake_put_word   ( id,  86, 0xbc01 );
+   fake_put_word   ( id,  87, 0x6163 );
+   fake_put_word   ( id, 100, 0x6db0 );    /* 48-bit LBA capacity */
+   fake_put_word   ( id, 101, 0x7470 );
+   fake_put_word   ( id, 217, 0x0001 );    /* non-rotating media */
+
+   /* SPC-4, section 6.4.2: Standard INQUIRY data */
+   config->inquiry[0] = 0x00;              /* direct access block device */
+   config->inquiry[2] = 0x05;              /* SPC-3 */
+   config->inquiry[3] = 0x02;
+   config->inquiry[4] = DISK_INQUIRY_LEN - 5;
+   memcpy ( config->inquiry +  8, "ATA     ", 8 );
+   memcpy ( config->inquiry + 16, "diskid fake disk", 16 );
+   memcpy ( config->inquiry + 32, "1.0 ", 4 );
+
+   config->timeout_msec = 100;
+   config->seed         = 0x6469736b6964ULL;
+}
+
+
+/* returns 0 and sets *index if device is a fake disk */
+static int fake_disk_index (
+   const char* const device, unsigned long* const index
+) {
+   char* end;
+
+   if ( strncmp ( device, FAKE_DISK_PREFIX, FAKE_DISK_PREFIX_LEN ) != 0 ) {
+      return -1;
+   }
+
+   errno  = 0;
+   *index = strtoul ( device + FAKE_DISK_PREFIX_LEN, &end, 10 );
+   return ( errno == 0 && end != device + FAKE_DISK_PREFIX_LEN && *end == '\0' )
+      ? 0 : -1;
+}
+
+/* splitmix64, the same disk and command always get the same value */
+static uint64_t fake_disk_roll (
+   const struct fake_disk_config* const config,
+   const unsigned long index, const enum fake_disk_cmd cmd
+) {
+   uint64_t z;
+
+   z = config->seed + ( (uint64_t)index * 4 + cmd + 1 ) * 0x9e3779b97f4a7c15ULL;
+   z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+   z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+   return z ^ ( z >> 31 );
+}
+
+static void fake_disk_sleep_usec ( const unsigned long usec ) {
+   struct timespec ts;
+
+   ts.tv_sec  = (time_t)( usec / 1000000 );
+   ts.tv_nsec = (long)( usec % 1000000 ) * 1000;
+   while ( nanosleep ( &ts, &ts ) != 0 && errno == EINTR ) { ; }
+}
+
+static inline const struct fake_disk_config* fake_disk_get_config (
+   const struct disk_info* const node
+) {
+   return &(((const struct fake_disk*)node->ops->priv)->config);
+}
+
+/*
+ * Simulates the latency, errors and timeouts of a command, which gives up
+ * after timeout_msec (0: config->timeout_msec) if the disk does not answer.
+ * Returns 0 and sets *index if the command succeeds, else -1 (errno set).
+ */
+static int fake_disk_command (
+   const struct disk_info* const node, const enum fake_disk_cmd cmd,
+   const unsigned int timeout_msec, unsigned long* const index
+) {
+   struct fake_disk* const fake                = node->ops->priv;
+   const struct fake_disk_config* const config = &(fake->config);
+   unsigned int* host_busy;
+   unsigned long timeout_usec;
+   uint64_t roll;
+   unsigned long usec;
+   int ret;
+
+   if ( fake_disk_index ( node->device, index ) != 0 ) {
+      errno = ENODEV;
+      return -1;
+   }
+
+   timeout_usec = (unsigned long)(
+      ( timeout_msec > 0 && timeout_msec < config->timeout_msec )
+         ? timeout_msec : config->timeout_msec
+   ) * 1000;
+
+   ret       = -1;
+   host_busy = NULL;
+   if ( config->hosts > 0 && config->host_queue_depth > 0 ) {
+      host_busy = &(fake->host_busy[*index % config->hosts]);
+
+      /* the host's queue is full, the command gets lost */
+      if (
+         __sync_add_and_fetch ( host_busy, 1 ) > config->host_queue_depth
+      ) {
+         fake_disk_sleep_usec ( timeout_usec );
+         errno = ETIMEDOUT;
+         goto command_exit;
+      }
+   }
+
+   roll = fake_disk_roll ( config, *index, cmd );
+
+   if ( ( roll >> 16 ) % 1000 < config->timeout_permille ) {
+      fake_disk_sleep_usec ( timeout_usec );
+      errno = ETIMEDOUT;
+      goto command_exit;
+   }
+
+   usec = config->latency_usec;
+   if ( config->jitter_usec > 0 ) {
+      usec += (unsigned long)( ( roll >> 32 ) % config->jitter_usec );
+   }
+   if ( usec > 0 ) {
+      fake_disk_sleep_usec ( usec );
+   }
+
+   if ( ( roll >> 48 ) % 1000 < config->error_permille ) {
+      errno = EIO;
+      goto command_exit;
+   }
+
+   ret = 0;
+
+command_exit:
+   if ( host_busy != NULL ) {
+      __sync_sub_and_fetch ( host_busy, 1 );
+   }
+   return ret;
+}
+
+/* a v3-only driver rejects SG_IO v4 right away, like sg_io() does */
+static int fake_disk_reject_sg_version (
+   const struct disk_info* const node, const enum disk_sg_version version
+) {
+   struct fake_disk* const fake = node->ops->priv;
+
+   if ( fake->config.no_sg_v4 && version == DISK_SG_V4 ) {
+      __sync_add_and_fetch ( &(fake->rejected), 1 );
+      errno = EINVAL;
+      return -1;
+   }
+   return 0;
+}
+
+/* the canned IDENTIFY data, with a serial number and WWN of its own */
+static void fake_disk_get_identify (
+   const struct fake_disk_config* const config, const unsigned long index,
+   uint8_t* const identify
+) {
+   char serial[21];
+   const uint64_t wwn = FAKE_DISK_WWN_BASE + index;
+
+   memcpy ( identify, config->identify, 512 );
+
+   snprintf ( serial, sizeof serial, "FAKE%016lu", index );
+   fake_put_string ( identify, 10, 20, serial );
+
+   fake_put_word ( identify, 108, (uint16_t)( wwn >> 48 ) );
+   fake_put_word ( identify, 109, (uint16_t)( wwn >> 32 ) );
+   fake_put_word ( identify, 110, (uint16_t)( wwn >> 16 ) );
+   fake_put_word ( identify, 111, (uint16_t)( wwn ) );
+}
+
+
+static int fake_disk_open (
+   const struct disk_ops* const ops, const char* const device,
+   const int flags
+) {
+   unsigned long index;
+
+   (void) ops;
+   (void) flags;
+
+   if ( fake_disk_index ( device, &index ) != 0 ) {
+      errno = ENOENT;
+      return -1;
+   }
+
+   /* the backends need a real fd for fstat() and close() */
+   return open ( "/dev/null", O_RDONLY|O_CLOEXEC );
+}
+
+static int fake_disk_inquiry (
+   const struct disk_info* const node, const int vpd_page,
+   void* const buf, const size_t buf_len, const unsigned int timeout_msec,
+   const enum disk_sg_version version
+) {
+   const struct fake_disk_config* const config = fake_disk_get_config ( node );
+   unsigned long index;
+
+   if (
+      fake_disk_reject_sg_version ( node, version ) != 0 ||
+      fake_disk_command ( node, FAKE_CMD_INQUIRY, timeout_msec, &index ) != 0
+   ) {
+      return -1;
+   }
+
+   /* no VPD pages */
+   if ( vpd_page >= 0 ) {
+      errno = EIO;
+      return -1;
+   }
+
+   memzero ( buf, buf_len );
+   memcpy (
+      buf, config->inquiry,
+      ( buf_len < sizeof config->inquiry ) ? buf_len : sizeof config->inquiry
+   );
+   return 0;
+}
+
+static int fake_disk_identify (
+   const struct disk_info* const node, void* const buf, const size_t buf_len,
+   const unsigned int timeout_msec, const enum disk_sg_version version
+) {
+   uint8_t identify[512];
+   unsigned long index;
+
+   if (
+      fake_disk_reject_sg_version ( node, version ) != 0 ||
+      fake_disk_command ( node, FAKE_CMD_IDENTIFY, timeout_msec, &index ) != 0
+   ) {
+      return -1;
+   }
+
+   fake_disk_get_identify ( fake_disk_get_config ( node ), index, identify );
+   memcpy ( buf, identify, ( buf_len < 512 ) ? buf_len : 512 );
+   return 0;
+}
+
+static int fake_disk_identify_packet (
+   const struct disk_info* const node, void* const buf, const size_t buf_len,
+   const unsigned int timeout_msec, const enum disk_sg_version version
+) {
+   unsigned long index;
+
+   if (
+      fake_disk_reject_sg_version ( node, version ) != 0 ||
+      fake_disk_command (
+         node, FAKE_CMD_IDENTIFY_PACKET, timeout_msec, &index
+      ) != 0
+   ) {
+      return -1;
+   }
+
+   /* not a packet device, aborted by the disk */
+   errno = EIO;
+   return -1;
+}
+
+static int fake_disk_hdio_identity (
+   const struct disk_info* const node, struct hd_driveid* const id
+) {
+   uint8_t identify[512];
+   unsigned long index;
+
+   /* the disk decides when it gives up */
+   if ( fake_disk_command ( node, FAKE_CMD_HDIO, 0, &index ) != 0 ) {
+      return -1;
+   }
+
+   /* libata hands out host byte order words and strings in char order */
+   fake_disk_get_identify ( fake_disk_get_config ( node ), index, identify );
+   ata_identify_fixup_byte_order ( identify );
+   memcpy ( id, identify, sizeof *id );
+   return 0;
+}
+
+
+void fake_disk_init (
+   struct fake_disk* const fake, const struct fake_disk_config* const config
+) {
+   memzero ( fake, sizeof *fake );
+   fake->config = *config;
+   if ( fake->config.hosts > FAKE_DISK_MAX_HOSTS ) {
+      fake->config.hosts = FAKE_DISK_MAX_HOSTS;
+   }
+   fake->ops    = (struct disk_ops) {
+      .name            = "fake",
+      .open            = fake_disk_open,
+      .inquiry         = fake_disk_inquiry,
+      .identify        = fake_disk_identify,
+      .identify_packet = fake_disk_identify_packet,
+      .hdio_identity   = fake_disk_hdio_identity,
+      .priv            = fake,
+   };
+}
@@ -0,0 +1,96 @@
+/*
+ * fake_disk.h - simulated ATA disks for benchmarking the probe code
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_FAKE_DISK_
+#define _DISKID_FAKE_DISK_
+
+#include <stdint.h>
+
+#include "disk_type.h"
+#include "disk_ops.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* device names are FAKE_DISK_PREFIX<n>, n makes each disk unique */
+#define FAKE_DISK_PREFIX     "fake:"
+#define FAKE_DISK_PREFIX_LEN 5
+#define FAKE_DISK_MAX_HOSTS  64
+
+struct fake_disk_config {
+   /*
+    * canned IDENTIFY DEVICE data (as sent by a disk) and standard INQUIRY
+    * data, the serial number and WWN get replaced per disk
+    */
+   uint8_t      identify[512];
+   uint8_t      inquiry[DISK_INQUIRY_LEN];
+   /* each command takes latency_usec + [0, jitter_usec) */
+   unsigned int latency_usec;
+   unsigned int jitter_usec;
+   /* chance (per mille) of a command failing with EIO */
+   unsigned int error_permille;
+   /*
+    * chance (per mille) of a command timing out after timeout_msec
+    * (or after the command's own timeout, if that is shorter)
+    */
+   unsigned int timeout_permille;
+   unsigned int timeout_msec;
+   /*
+    * disk n is attached to host n % hosts (0: no hosts), a host queues up
+    * to host_queue_depth commands and lets any further ones time out after
+    * timeout_msec (0: no limit)
+    */
+   unsigned int hosts;
+   unsigned int host_queue_depth;
+   /*
+    * the driver does not do SG_IO v4,
+    * commands sent with it fail with EINVAL
+    */
+   unsigned int no_sg_v4;
+   /* the same seed gives the same errors/latencies for the same disks */
+   uint64_t     seed;
+};
+
+/* the disk_ops of a fake disk, ops.priv points to the fake_disk */
+struct fake_disk {
+   struct disk_ops         ops;
+   struct fake_disk_config config;
+   /* commands in flight per host */
+   unsigned int            host_busy[FAKE_DISK_MAX_HOSTS];
+   /* SG_IO v4 attempts rejected because of config.no_sg_v4 */
+   unsigned long           rejected;
+};
+
+/*
+ * Default config: a SATA disk with a WWN that answers immediately
+ * and never fails.
+ */
+void fake_disk_config_init ( struct fake_disk_config* const config );
+
+void fake_disk_init (
+   struct fake_disk* const fake, const struct fake_disk_config* const config
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
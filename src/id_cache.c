@@ -0,0 +1,284 @@
+/*
+ * id_cache.c - persistent cache for decoded disk identities
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sysmacros.h>
+
+#include "udev_util.h"
+#include "ata_id.h"
+#include "sysfs.h"
+#include "id_cache.h"
+
+
+struct id_cache_key {
+   uint32_t dev_kind;
+   uint32_t dev_major;
+   uint32_t dev_minor;
+   uint32_t seq_kind;
+   uint64_t seq;
+   char     name[32];
+};
+
+/* FNV-1a */
+static uint32_t fnv1a (
+   uint32_t hash, const uint8_t* const data, const size_t len
+) {
+   size_t k;
+
+   for ( k = 0; k < len; k++ ) {
+      hash ^= data[k];
+      hash *= 16777619U;
+   }
+   return hash;
+}
+
+/* checksum of the record, skipping the checksum field itself */
+static uint32_t id_cache_checksum (
+   const struct id_cache_record* const record
+) {
+   const uint8_t* const data = (const uint8_t*) record;
+   const size_t csum_off     = offsetof ( struct id_cache_record, checksum );
+   const size_t data_off     = csum_off + sizeof record->checksum;
+
+   return fnv1a (
+      fnv1a ( 2166136261U, data, csum_off ),
+      data + data_off, sizeof *record - data_off
+   );
+}
+
+/*
+ * The key consists of the device number and the "disk sequence number",
+ * which changes whenever the media is replaced. Partitions use their
+ * disk's diskseq. diskseq numbers start over on every boot, so records
+ * also carry the boot id (see id_cache_open()).
+ *
+ * Without diskseq (kernels before 5.15, sg nodes), there is no key:
+ * nothing else tells whether the media is still the same. (The uevent's
+ * $SEQNUM is no substitute, it is different for every event and a record
+ * stored under it would never be found again.)
+ *
+ * Returns 0 if a usable key has been found.
+ */
+static int id_cache_get_key ( const int fd, struct id_cache_key* const key ) {
+   struct stat stat_info;
+   char path[SYSFS_PATH_MAX];
+
+   if ( fstat ( fd, &stat_info ) != 0 ) { return -1; }
+
+   if ( S_ISBLK ( stat_info.st_mode ) ) {
+      key->dev_kind = 'b';
+   } else if ( S_ISCHR ( stat_info.st_mode ) ) {
+      key->dev_kind = 'c';
+   } else {
+      return -1;
+   }
+
+   key->dev_major = major ( stat_info.st_rdev );
+   key->dev_minor = minor ( stat_info.st_rdev );
+   key->seq_kind  = ID_CACHE_SEQ_NONE;
+   key->seq       = 0;
+
+   if (
+      (
+         sysfs_dev_path ( path, sizeof path, &stat_info, "diskseq" ) == 0 &&
+         sysfs_read_uint64 ( path, &(key->seq) ) == 0
+      ) || (
+         sysfs_dev_path ( path, sizeof path, &stat_info, "../diskseq" ) == 0 &&
+         sysfs_read_uint64 ( path, &(key->seq) ) == 0
+      )
+   ) {
+      key->seq_kind = ID_CACHE_SEQ_DISKSEQ;
+
+   } else {
+      return -1;
+   }
+
+   snprintf (
+      key->name, sizeof key->name, "%c%u:%u",
+      (char)key->dev_kind, key->dev_major, key->dev_minor
+   );
+   return 0;
+}
+
+
+int id_cache_open ( struct id_cache* const cache, const char* const dir ) {
+   cache->dirfd = -1;
+
+   /* without it, a record could belong to another disk of an earlier boot */
+   memzero ( cache->boot_id, sizeof cache->boot_id );
+   if (
+      sysfs_read_attr (
+         ID_CACHE_BOOT_ID_FILE, cache->boot_id, sizeof cache->boot_id
+      ) < 1
+   ) {
+      return -1;
+   }
+
+   if ( mkdir ( dir, 0755 ) != 0 && errno != EEXIST ) {
+      return -1;
+   }
+
+   cache->dirfd = open ( dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC );
+   return ( cache->dirfd < 0 ) ? -1 : 0;
+}
+
+void id_cache_close ( struct id_cache* const cache ) {
+   if ( cache->dirfd >= 0 ) {
+      close ( cache->dirfd );
+      cache->dirfd = -1;
+   }
+}
+
+
+int id_cache_lookup (
+   const struct id_cache* const cache, const int fd,
+   struct ata_disk_info* const pinfo
+) {
+   struct id_cache_key key;
+   struct stat stat_info;
+   const struct id_cache_record* record;
+   void* map;
+   int cfd;
+   int ret;
+
+   if ( cache == NULL || cache->dirfd < 0 ) { return -1; }
+   if ( id_cache_get_key ( fd, &key ) != 0 ) { return -1; }
+
+   cfd = openat ( cache->dirfd, key.name, O_RDONLY|O_CLOEXEC );
+   if ( cfd < 0 ) { return -1; }
+
+   if (
+      fstat ( cfd, &stat_info ) != 0 ||
+      stat_info.st_size != (off_t)(sizeof *record)
+   ) {
+      close ( cfd );
+      return -1;
+   }
+
+   map = mmap ( NULL, sizeof *record, PROT_READ, MAP_SHARED, cfd, 0 );
+   close ( cfd );
+   if ( map == MAP_FAILED ) { return -1; }
+
+   record = map;
+   ret    = -1;
+
+   if (
+      record->magic     == ID_CACHE_MAGIC &&
+      record->version   == ID_CACHE_VERSION &&
+      record->size      == sizeof *record &&
+      record->dev_kind  == key.dev_kind &&
+      record->dev_major == key.dev_major &&
+      record->dev_minor == key.dev_minor &&
+      record->seq_kind  == key.seq_kind &&
+      record->seq       == key.seq &&
+      memcmp ( record->boot_id, cache->boot_id, sizeof record->boot_id ) == 0 &&
+      record->checksum  == id_cache_checksum ( record )
+   ) {
+      memcpy ( pinfo->identify, record->identify, sizeof pinfo->identify );
+      memcpy ( &(pinfo->id), record->id, sizeof pinfo->id );
+      memcpy ( pinfo->model, record->model, sizeof pinfo->model );
+      memcpy ( pinfo->model_enc, record->model_enc, sizeof pinfo->model_enc );
+      memcpy ( pinfo->serial, record->serial, sizeof pinfo->serial );
+      memcpy ( pinfo->revision, record->revision, sizeof pinfo->revision );
+      pinfo->model[sizeof pinfo->model - 1]         = '\0';
+      pinfo->model_enc[sizeof pinfo->model_enc - 1] = '\0';
+      pinfo->serial[sizeof pinfo->serial - 1]       = '\0';
+      pinfo->revision[sizeof pinfo->revision - 1]   = '\0';
+      pinfo->is_packet_device = (int)record->is_packet_device;
+      pinfo->identify_words   = (uint16_t*) pinfo->identify;
+      /* HDIO_GET_IDENTITY results come without IDENTIFY data */
+      pinfo->has_identify     = !ata_identify_is_empty ( pinfo->identify );
+      ret = 0;
+   }
+
+   munmap ( map, sizeof *record );
+   return ret;
+}
+
+int id_cache_store (
+   const struct id_cache* const cache, const int fd,
+   const struct ata_disk_info* const pinfo
+) {
+   static unsigned int tmp_counter = 0;
+
+   struct id_cache_key key;
+   struct id_cache_record record;
+   char tmp_name[64];
+   int cfd;
+   ssize_t ret;
+
+   if ( cache == NULL || cache->dirfd < 0 ) { return -1; }
+   if ( id_cache_get_key ( fd, &key ) != 0 ) { return -1; }
+
+   memzero ( &record, sizeof record );
+   record.magic            = ID_CACHE_MAGIC;
+   record.version          = ID_CACHE_VERSION;
+   record.size             = sizeof record;
+   record.dev_kind         = key.dev_kind;
+   record.dev_major        = key.dev_major;
+   record.dev_minor        = key.dev_minor;
+   record.seq_kind         = key.seq_kind;
+   record.seq              = key.seq;
+   memcpy ( record.boot_id, cache->boot_id, sizeof record.boot_id );
+   record.is_packet_device = (uint32_t)pinfo->is_packet_device;
+   memcpy ( record.identify, pinfo->identify, sizeof record.identify );
+   memcpy ( record.id, &(pinfo->id), sizeof record.id );
+   memcpy ( record.model, pinfo->model, sizeof record.model );
+   memcpy ( record.model_enc, pinfo->model_enc, sizeof record.model_enc );
+   memcpy ( record.serial, pinfo->serial, sizeof record.serial );
+   memcpy ( record.revision, pinfo->revision, sizeof record.revision );
+   record.checksum         = id_cache_checksum ( &record );
+
+   /* write to a temporary file, then rename() it (atomic replace) */
+   snprintf (
+      tmp_name, sizeof tmp_name, ".%s.%ld.%u", key.name, (long) getpid(),
+      __sync_fetch_and_add ( &tmp_counter, 1 )
+   );
+
+   cfd = openat (
+      cache->dirfd, tmp_name, O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644
+   );
+   if ( cfd < 0 ) { return -1; }
+
+   do {
+      ret = write ( cfd, &record, sizeof record );
+   } while ( ret < 0 && errno == EINTR );
+
+   if ( close ( cfd ) != 0 || ret != (ssize_t)(sizeof record) ) {
+      unlinkat ( cache->dirfd, tmp_name, 0 );
+      return -1;
+   }
+
+   if ( renameat ( cache->dirfd, tmp_name, cache->dirfd, key.name ) != 0 ) {
+      unlinkat ( cache->dirfd, tmp_name, 0 );
+      return -1;
+   }
+
+   return 0;
+}
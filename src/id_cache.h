@@ -0,0 +1,117 @@
+/*
+ * id_cache.h - persistent cache for decoded disk identities
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_ID_CACHE_
+#define _DISKID_ID_CACHE_
+
+#include <stdint.h>
+#include <linux/hdreg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ata_disk_info;
+
+#define ID_CACHE_DEFAULT_DIR  "/run/diskid"
+
+#define ID_CACHE_MAGIC        0x4449444bU /* "DIDK" */
+#define ID_CACHE_VERSION      4
+
+/* changes on every boot, diskseq numbers start over */
+#define ID_CACHE_BOOT_ID_FILE  "/proc/sys/kernel/random/boot_id"
+#define ID_CACHE_BOOT_ID_LEN   40
+
+enum id_cache_seq_kind {
+   ID_CACHE_SEQ_NONE    = 0,
+   ID_CACHE_SEQ_DISKSEQ = 1, /* /sys/.../diskseq */
+};
+
+/*
+ * On-disk format: one file per device node, named "b<major>:<minor>" or
+ * "c<major>:<minor>", containing exactly one record in host byte order.
+ * Files are replaced atomically (rename()), readers mmap() them.
+ *
+ * The checksum is computed over the entire record with the checksum
+ * field set to 0.
+ */
+struct id_cache_record {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t size;
+   uint32_t checksum;
+
+   /* key */
+   uint32_t dev_kind;   /* 'b' or 'c' */
+   uint32_t dev_major;
+   uint32_t dev_minor;
+   uint32_t seq_kind;
+   uint64_t seq;
+   char     boot_id[ID_CACHE_BOOT_ID_LEN]; /* seq is only valid for this boot */
+
+   /* struct ata_disk_info */
+   uint32_t is_packet_device;
+   uint32_t reserved;
+   uint8_t  identify[512];
+   uint8_t  id[sizeof(struct hd_driveid)];
+   char     model[41];
+   char     model_enc[256];
+   char     serial[21];
+   char     revision[9];
+   uint8_t  padding[1];
+};
+
+struct id_cache {
+   int  dirfd;
+   char boot_id[ID_CACHE_BOOT_ID_LEN];
+};
+
+/*
+ * Opens (and creates) the cache directory and reads the boot id.
+ * Returns 0 on success.
+ */
+int  id_cache_open  ( struct id_cache* const cache, const char* const dir );
+void id_cache_close ( struct id_cache* const cache );
+
+/*
+ * Looks up the disk info of the device node referenced by fd.
+ * Returns 0 if a valid record has been found and copied to pinfo,
+ * never for a node without diskseq.
+ */
+int id_cache_lookup (
+   const struct id_cache* const cache, const int fd,
+   struct ata_disk_info* const pinfo
+);
+
+/*
+ * Stores the disk info of the device node referenced by fd.
+ * Nothing is stored if the node has no diskseq.
+ * Returns 0 on success.
+ */
+int id_cache_store (
+   const struct id_cache* const cache, const int fd,
+   const struct ata_disk_info* const pinfo
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+/*
+ * id_dump.c - save and decode raw IDENTIFY data
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "disk_type.h"
+#include "ata_id.h"
+#include "out_buf.h"
+#include "id_dump.h"
+
+
+int id_dump_open ( struct id_dump* const dump, const char* const dir ) {
+   if ( mkdir ( dir, 0755 ) != 0 && errno != EEXIST ) {
+      dump->dirfd = -1;
+      return -1;
+   }
+
+   dump->dirfd = open ( dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC );
+   return ( dump->dirfd < 0 ) ? -1 : 0;
+}
+
+void id_dump_close ( struct id_dump* const dump ) {
+   if ( dump->dirfd >= 0 ) {
+      close ( dump->dirfd );
+      dump->dirfd = -1;
+   }
+}
+
+
+static int id_dump_write_file (
+   const struct id_dump* const dump, const char* const name,
+   const char* const suffix, const void* const data, const size_t len
+) {
+   char file_name[NAME_MAX+1];
+   ssize_t ret;
+   int fd;
+
+   if (
+      snprintf ( file_name, sizeof file_name, "%s%s", name, suffix )
+         >= (int)(sizeof file_name)
+   ) {
+      errno = ENAMETOOLONG;
+      return -1;
+   }
+
+   fd = openat (
+      dump->dirfd, file_name, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644
+   );
+   if ( fd < 0 ) { return -1; }
+
+   do {
+      ret = write ( fd, data, len );
+   } while ( ret < 0 && errno == EINTR );
+
+   if ( close ( fd ) != 0 || ret != (ssize_t)len ) {
+      unlinkat ( dump->dirfd, file_name, 0 );
+      return -1;
+   }
+
+   return 0;
+}
+
+int id_dump_store (
+   const struct id_dump* const dump, const struct disk_info* const node,
+   const struct ata_disk_info* const pinfo
+) {
+   uint8_t identify[ID_DUMP_BLOCK_SIZE];
+   int ret = 0;
+
+   if ( dump == NULL || dump->dirfd < 0 ) { return -1; }
+
+   if ( pinfo != NULL && pinfo->has_identify ) {
+      ata_disk_info_get_raw_identify ( pinfo, identify );
+      if (
+         id_dump_write_file (
+            dump, node->name, ".identify", identify, sizeof identify
+         ) != 0
+      ) {
+         ret = -1;
+      }
+   }
+
+   if (
+      node->inquiry_len > 0 &&
+      id_dump_write_file (
+         dump, node->name, ".inquiry", node->inquiry, node->inquiry_len
+      ) != 0
+   ) {
+      ret = -1;
+   }
+
+   return ret;
+}
+
+
+static int id_dump_decode_block (
+   const uint8_t* const block, const char* const label,
+   unsigned const int mdev_export, struct out_buf* const out
+) {
+   struct ata_disk_info info;
+   struct out_record rec;
+   /* print_ata_id_vars() does not send any commands */
+   const struct disk_info node = {
+      .arena   = NULL,
+      .ops     = &disk_ops_sg,
+      .device  = label,
+      .name    = label,
+      .type    = DISK_TYPE_ATA,
+      .fd      = -1,
+      .source  = ID_SOURCE_IDENTIFY,
+   };
+   int ret;
+
+   ata_disk_info_from_identify ( &info, block );
+
+   if ( out->format == OUT_FORMAT_BIN ) {
+      ata_id_get_record ( &info, &rec );
+      rec.device = label;
+      out_buf_put_record ( out, &rec );
+      return 0;
+   }
+
+   out_record_begin ( out, label );
+   ret = print_ata_id_vars ( &node, &info, mdev_export, out );
+   out_record_end ( out );
+   return ret;
+}
+
+int id_dump_decode_file (
+   const char* const path, unsigned const int mdev_export,
+   struct out_buf* const out, size_t* const count
+) {
+   static const uint8_t zero_block[ID_DUMP_BLOCK_SIZE];
+   char label[PATH_MAX+24];
+   struct stat stat_info;
+   const uint8_t* data;
+   void* map;
+   size_t size;
+   size_t nblocks;
+   size_t skipped;
+   size_t k;
+   int retcode;
+   int fd;
+
+   fd = open ( path, O_RDONLY|O_CLOEXEC );
+   if ( fd < 0 ) {
+      fprintf ( stderr, "failed to open '%s'\n", path );
+      return 1;
+   }
+
+   if ( fstat ( fd, &stat_info ) != 0 || !S_ISREG ( stat_info.st_mode ) ) {
+      fprintf ( stderr, "not a regular file: '%s'\n", path );
+      close ( fd );
+      return 1;
+   }
+
+   size    = (size_t)stat_info.st_size;
+   nblocks = size / ID_DUMP_BLOCK_SIZE;
+   retcode = 0;
+
+   if ( size % ID_DUMP_BLOCK_SIZE != 0 ) {
+      fprintf ( stderr,
+         "%s: size is not a multiple of %d bytes, ignoring the last %zu\n",
+         path, ID_DUMP_BLOCK_SIZE, size % ID_DUMP_BLOCK_SIZE
+      );
+      retcode = 1;
+   }
+
+   if ( nblocks == 0 ) {
+      close ( fd );
+      return retcode;
+   }
+
+   map = mmap (
+      NULL, nblocks * ID_DUMP_BLOCK_SIZE, PROT_READ, MAP_PRIVATE, fd, 0
+   );
+   close ( fd );
+   if ( map == MAP_FAILED ) {
+      fprintf ( stderr, "failed to map '%s'\n", path );
+      return 1;
+   }
+   madvise ( map, nblocks * ID_DUMP_BLOCK_SIZE, MADV_SEQUENTIAL );
+
+   data    = map;
+   skipped = 0;
+   for ( k = 0; k < nblocks; k++ ) {
+      const uint8_t* const block = data + k * ID_DUMP_BLOCK_SIZE;
+
+      if ( memcmp ( block, zero_block, ID_DUMP_BLOCK_SIZE ) == 0 ) {
+         skipped++;
+         continue;
+      }
+
+      snprintf ( label, sizeof label, "%s:%zu", path, k );
+
+      /* env: records are separated by an empty line */
+      if ( out->format == OUT_FORMAT_ENV && *count > 0 ) {
+         out_buf_putc ( out, '\n' );
+      }
+
+      if ( id_dump_decode_block ( block, label, mdev_export, out ) != 0 ) {
+         fprintf ( stderr, "%s: failed to decode block %zu\n", path, k );
+         retcode = 1;
+      }
+      (*count)++;
+
+      /* keep the memory usage flat for large corpora */
+      if ( out->len >= out->size / 2 ) {
+         out_buf_flush ( out );
+      }
+   }
+
+   munmap ( map, nblocks * ID_DUMP_BLOCK_SIZE );
+
+   if ( skipped > 0 ) {
+      fprintf ( stderr, "%s: skipped %zu empty blocks\n", path, skipped );
+   }
+
+   return retcode;
+}
@@ -0,0 +1,78 @@
+/*
+ * id_dump.h - save and decode raw IDENTIFY data
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_ID_DUMP_
+#define _DISKID_ID_DUMP_
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct disk_info;
+struct ata_disk_info;
+struct out_buf;
+
+#define ID_DUMP_BLOCK_SIZE 512
+
+/*
+ * --dump-identify writes the data a device has sent to files named
+ * after the device node:
+ *
+ *  <name>.identify   IDENTIFY [PACKET] DEVICE data, 512 bytes, as sent
+ *                    by the disk (before the fixup)
+ *  <name>.inquiry    standard INQUIRY data
+ *
+ * A corpus for --decode-identify is any concatenation of .identify files.
+ */
+struct id_dump {
+   int dirfd;
+};
+
+/* Opens (and creates) the dump directory. Returns 0 on success. */
+int  id_dump_open  ( struct id_dump* const dump, const char* const dir );
+void id_dump_close ( struct id_dump* const dump );
+
+/* pinfo may be NULL (not an ATA disk). Returns 0 on success. */
+int id_dump_store (
+   const struct id_dump* const dump, const struct disk_info* const node,
+   const struct ata_disk_info* const pinfo
+);
+
+/*
+ * Decodes each 512-byte block of a corpus file as if it had been read
+ * from a disk named "<path>:<index>" and prints it to out, which gets
+ * flushed every now and then. All-zero blocks are skipped.
+ * *count is the number of blocks printed so far (across files).
+ *
+ * Returns 0 on success, else 1 (file not readable or not a multiple
+ * of 512 bytes, its whole blocks are decoded nevertheless).
+ */
+int id_dump_decode_file (
+   const char* const path, unsigned const int mdev_export,
+   struct out_buf* const out, size_t* const count
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * libdiskid.c - libdiskid, probe disk identities from other programs
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "diskid.h"
+#include "disk_type.h"
+#include "arena.h"
+#include "out_buf.h"
+#include "probe.h"
+#include "ata_id.h"
+#include "nvme_id.h"
+#include "scsi_id.h"
+
+/* the public flags are passed through as enum disk_type / id_source */
+typedef char diskid_check_types[
+   ( DISKID_TYPE_ATA == DISK_TYPE_ATA && DISKID_TYPE_SCSI == DISK_TYPE_SCSI &&
+     DISKID_TYPE_NVME == DISK_TYPE_NVME ) ? 1 : -1
+];
+typedef char diskid_check_sources[
+   ( (DISKID_SOURCE_SYSFS >> 8) == ID_SOURCE_SYSFS &&
+     (DISKID_SOURCE_AUTO >> 8) == ID_SOURCE_AUTO &&
+     (DISKID_SOURCE_IDENTIFY >> 8) == ID_SOURCE_IDENTIFY ) ? 1 : -1
+];
+
+
+struct diskid_result {
+   const char*        device;
+   enum diskid_status status;
+   unsigned int       type;
+   unsigned int       has_identify;
+   char               model[64];
+   char               serial[SCSI_ID_SERIAL_MAX];
+   char               revision[16];
+   char               wwn[40];
+   uint8_t            identify[512];
+};
+
+/* allocated as a whole, with the allocator that is needed to free it */
+struct diskid_results {
+   struct diskid_allocator allocator;
+   size_t                  count;
+   /* disk_caps.skipped of the call */
+   unsigned long           skipped;
+   struct diskid_result    result[];
+};
+
+
+static void* diskid_default_alloc ( void* const ctx, const size_t size ) {
+   (void) ctx;
+   return malloc ( size );
+}
+
+static void diskid_default_free ( void* const ctx, void* const ptr ) {
+   (void) ctx;
+   free ( ptr );
+}
+
+static void diskid_probe_job ( struct probe_job* const job, void* const data ) {
+   probe_job_run ( job, data );
+}
+
+static void diskid_result_set (
+   struct diskid_result* const r, const struct probe_job* const job
+) {
+   struct out_record rec;
+
+   memset ( r, 0, sizeof *r );
+   r->device = job->device;
+
+   if ( job->status == PROBE_ERR_OPEN ) {
+      r->status = DISKID_ERR_OPEN;
+      return;
+   }
+
+   rec.flags = 0;
+   switch ( ( job->status == PROBE_OK ) ? job->node->type : DISK_TYPE_NONE ) {
+      case DISK_TYPE_ATA:
+         ata_id_get_record ( &(job->info->ata), &rec );
+         break;
+      case DISK_TYPE_NVME:
+         nvme_id_get_record ( &(job->info->nvme), &rec );
+         break;
+      case DISK_TYPE_SCSI:
+         scsi_id_get_record ( &(job->info->scsi), &rec );
+         break;
+      default:
+         r->status = DISKID_ERR_DETECT;
+         return;
+   }
+
+   r->status = DISKID_OK;
+   r->type   = rec.type;
+   snprintf ( r->model,    sizeof r->model,    "%s", rec.model );
+   snprintf ( r->serial,   sizeof r->serial,   "%s", rec.serial );
+   snprintf ( r->revision, sizeof r->revision, "%s", rec.revision );
+   memcpy ( r->wwn, rec.wwn, sizeof r->wwn );
+
+   if ( rec.flags & OUT_BIN_FLAG_IDENTIFY ) {
+      memcpy ( r->identify, rec.identify, sizeof r->identify );
+      r->has_identify = 1;
+   }
+}
+
+
+int diskid_probe_many (
+   const char* const* devs, size_t n, unsigned int flags,
+   const struct diskid_allocator* allocator,
+   struct diskid_results** results
+) {
+   struct diskid_allocator alloc;
+   struct diskid_results* res;
+   struct arena arena = { .chunk = NULL };
+   struct nvme_ctrl_cache nvme_ctrls;
+   struct disk_caps caps;
+   struct probe_ctx ctx;
+   struct probe_job* jobs;
+   unsigned int max_jobs;
+   size_t k;
+
+   if ( results == NULL || ( devs == NULL && n > 0 ) ) {
+      errno = EINVAL;
+      return -1;
+   }
+   *results = NULL;
+
+   if ( allocator == NULL ) {
+      alloc = (struct diskid_allocator) {
+         .alloc = diskid_default_alloc,
+         .free  = diskid_default_free,
+         .ctx   = NULL,
+      };
+   } else if ( allocator->alloc == NULL || allocator->free == NULL ) {
+      errno = EINVAL;
+      return -1;
+   } else {
+      alloc = *allocator;
+   }
+
+   if ( n > ( SIZE_MAX - sizeof *res ) / sizeof res->result[0] ) {
+      errno = ENOMEM;
+      return -1;
+   }
+   res = alloc.alloc ( alloc.ctx, sizeof *res + n * sizeof res->result[0] );
+   if ( res == NULL ) {
+      errno = ENOMEM;
+      return -1;
+   }
+   res->allocator = alloc;
+   res->count     = n;
+   res->skipped   = 0;
+
+   if ( n == 0 ) {
+      *results = res;
+      return 0;
+   }
+
+   /* one allocation for all devices, unless they need more than that */
+   if (
+      n > SIZE_MAX / ( sizeof *jobs + ARENA_DEVICE_SIZE ) ||
+      arena_init_alloc (
+         &arena, n * ( sizeof *jobs + ARENA_DEVICE_SIZE ),
+         alloc.alloc, alloc.free, alloc.ctx
+      ) != 0
+   ) {
+      goto err_nomem;
+   }
+
+   jobs = arena_alloc ( &arena, n * sizeof *jobs );
+   if ( jobs == NULL ) {
+      goto err_nomem;
+   }
+   for ( k = 0; k < n; k++ ) {
+      jobs[k] = (struct probe_job) { .device = devs[k] };
+   }
+
+   nvme_ctrl_cache_init ( &nvme_ctrls );
+   disk_caps_init ( &caps );
+   ctx = (struct probe_ctx) {
+      .disk_types = ( flags & DISKID_TYPE_ALL ) ? flags & DISKID_TYPE_ALL
+                                                : DISK_TYPE_ALL,
+      .cache      = NULL,
+      .source     = (enum id_source)( ( flags & DISKID_SOURCE_MASK ) >> 8 ),
+      .arena      = &arena,
+      .nvme_ctrls = &nvme_ctrls,
+      .caps       = &caps,
+      .ops        = NULL,
+   };
+
+   max_jobs = flags >> 16;
+   if ( max_jobs > 1 ) {
+      probe_run ( jobs, n, max_jobs, diskid_probe_job, &ctx );
+   }
+
+   for ( k = 0; k < n; k++ ) {
+      /* also catches the jobs left over if no thread could be created */
+      if ( jobs[k].status == PROBE_PENDING ) {
+         probe_job_run ( &jobs[k], &ctx );
+      }
+      diskid_result_set ( &(res->result[k]), &jobs[k] );
+      probe_job_release ( &jobs[k] );
+   }
+
+   res->skipped = caps.skipped;
+   nvme_ctrl_cache_free ( &nvme_ctrls );
+   arena_free ( &arena );
+
+   *results = res;
+   return 0;
+
+err_nomem:
+   arena_free ( &arena );
+   alloc.free ( alloc.ctx, res );
+   errno = ENOMEM;
+   return -1;
+}
+
+void diskid_results_free ( struct diskid_results* results ) {
+   if ( results != NULL ) {
+      results->allocator.free ( results->allocator.ctx, results );
+   }
+}
+
+size_t diskid_results_count ( const struct diskid_results* results ) {
+   return results->count;
+}
+
+const struct diskid_result* diskid_results_get (
+   const struct diskid_results* results, size_t k
+) {
+   return ( k < results->count ) ? &(results->result[k]) : NULL;
+}
+
+unsigned long diskid_results_skipped ( const struct diskid_results* results ) {
+   return results->skipped;
+}
+
+
+const char* diskid_result_device ( const struct diskid_result* r ) {
+   return r->device;
+}
+
+enum diskid_status diskid_result_status ( const struct diskid_result* r ) {
+   return r->status;
+}
+
+unsigned int diskid_result_type ( const struct diskid_result* r ) {
+   return r->type;
+}
+
+const char* diskid_result_model ( const struct diskid_result* r ) {
+   return r->model;
+}
+
+const char* diskid_result_serial ( const struct diskid_result* r ) {
+   return r->serial;
+}
+
+const char* diskid_result_revision ( const struct diskid_result* r ) {
+   return r->revision;
+}
+
+const char* diskid_result_wwn ( const struct diskid_result* r ) {
+   return r->wwn;
+}
+
+const uint8_t* diskid_result_identify ( const struct diskid_result* r ) {
+   return r->has_identify ? r->identify : NULL;
+}
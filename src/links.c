@@ -0,0 +1,298 @@
+/*
+ * links.c - create /dev/disk/by-id links
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "ata_id.h"
+#include "sysfs.h"
+#include "links.h"
+
+
+/* mkdir -p */
+static int links_mkdir_p ( const char* const dir ) {
+   char path[LINK_NAME_MAX];
+   size_t k;
+
+   if ( strlen ( dir ) >= sizeof path ) {
+      errno = ENAMETOOLONG;
+      return -1;
+   }
+   strcpy ( path, dir );
+
+   for ( k = 1; path[k] != '\0'; k++ ) {
+      if ( path[k] == '/' ) {
+         path[k] = '\0';
+         if ( mkdir ( path, 0755 ) != 0 && errno != EEXIST ) {
+            return -1;
+         }
+         path[k] = '/';
+      }
+   }
+
+   return ( mkdir ( path, 0755 ) != 0 && errno != EEXIST ) ? -1 : 0;
+}
+
+
+int links_dir_open (
+   struct links_dir* const ldir, const char* const dir,
+   const unsigned int pretend
+) {
+   ldir->pretend = pretend;
+   ldir->dirfd   = -1;
+
+   if ( pretend == 0 && links_mkdir_p ( dir ) != 0 ) {
+      return -1;
+   }
+
+   ldir->dirfd = open ( dir, O_RDONLY|O_DIRECTORY|O_CLOEXEC );
+   return ( ldir->dirfd < 0 && pretend == 0 ) ? -1 : 0;
+}
+
+void links_dir_close ( struct links_dir* const ldir ) {
+   if ( ldir->dirfd >= 0 ) {
+      close ( ldir->dirfd );
+      ldir->dirfd = -1;
+   }
+}
+
+
+void links_get_names (
+   const struct ata_disk_info* const pinfo, const unsigned int partn,
+   struct disk_link_names* const names
+) {
+   char serial[LINK_NAME_MAX];
+   char part_suffix[16];
+   uint64_t wwn;
+   int ret;
+   int k;
+
+   for ( k = 0; k < LINK_COUNT; k++ ) {
+      names->name[k][0] = '\0';
+   }
+
+   part_suffix[0] = '\0';
+   if ( partn > 0 ) {
+      snprintf ( part_suffix, sizeof part_suffix, "-part%u", partn );
+   }
+
+   if (
+      ata_disk_info_get_serial ( pinfo, serial, sizeof serial ) == 0 &&
+      serial[0] != '\0'
+   ) {
+      ret = snprintf (
+         names->name[LINK_ID], LINK_NAME_MAX, "ata-%s%s", serial, part_suffix
+      );
+      if ( ret < 0 || ret >= LINK_NAME_MAX ) {
+         names->name[LINK_ID][0] = '\0';
+      }
+   }
+
+   if ( ata_disk_info_get_wwn ( pinfo, &wwn ) == 0 ) {
+      /* ATA devices have no vendor extension */
+      snprintf (
+         names->name[LINK_WWN], LINK_NAME_MAX, "wwn-0x%llx%s",
+         (unsigned long long int) wwn, part_suffix
+      );
+   }
+}
+
+void links_get_nvme_names (
+   const struct nvme_disk_info* const pinfo, const unsigned int partn,
+   struct disk_link_names* const names
+) {
+   char part_suffix[16];
+   int ret;
+
+   part_suffix[0] = '\0';
+   if ( partn > 0 ) {
+      snprintf ( part_suffix, sizeof part_suffix, "-part%u", partn );
+   }
+
+   if ( pinfo->serial[0] != '\0' ) {
+      ret = snprintf (
+         names->name[LINK_ID], LINK_NAME_MAX, "nvme-%s_%s%s",
+         pinfo->model, pinfo->serial, part_suffix
+      );
+   } else {
+      ret = snprintf (
+         names->name[LINK_ID], LINK_NAME_MAX, "nvme-%s%s",
+         pinfo->model, part_suffix
+      );
+   }
+   if ( ret < 0 || ret >= LINK_NAME_MAX || pinfo->model[0] == '\0' ) {
+      names->name[LINK_ID][0] = '\0';
+   }
+
+   names->name[LINK_WWN][0] = '\0';
+   if ( pinfo->wwn[0] != '\0' ) {
+      snprintf (
+         names->name[LINK_WWN], LINK_NAME_MAX, "nvme-%s%s",
+         pinfo->wwn, part_suffix
+      );
+   }
+}
+
+void links_get_scsi_names (
+   const struct scsi_disk_info* const pinfo, const unsigned int partn,
+   struct disk_link_names* const names
+) {
+   char part_suffix[16];
+   char wwn[40];
+   int ret;
+
+   part_suffix[0] = '\0';
+   if ( partn > 0 ) {
+      snprintf ( part_suffix, sizeof part_suffix, "-part%u", partn );
+   }
+
+   ret = snprintf (
+      names->name[LINK_ID], LINK_NAME_MAX, "scsi-%s%s",
+      pinfo->serial, part_suffix
+   );
+   if ( ret < 0 || ret >= LINK_NAME_MAX || pinfo->serial[0] == '\0' ) {
+      names->name[LINK_ID][0] = '\0';
+   }
+
+   names->name[LINK_WWN][0] = '\0';
+   if ( scsi_disk_info_get_wwn ( pinfo, wwn, sizeof wwn ) == 0 ) {
+      snprintf (
+         names->name[LINK_WWN], LINK_NAME_MAX, "wwn-%s%s", wwn, part_suffix
+      );
+   }
+}
+
+unsigned int links_get_partn ( const int fd ) {
+   struct stat stat_info;
+
+   return ( fstat ( fd, &stat_info ) == 0 )
+      ? links_get_partn_stat ( &stat_info ) : 0;
+}
+
+unsigned int links_get_partn_stat ( const struct stat* const stat_info ) {
+   char path[SYSFS_PATH_MAX];
+   uint64_t partn;
+
+   if (
+      sysfs_dev_path ( path, sizeof path, stat_info, "partition" ) == 0 &&
+      sysfs_read_uint64 ( path, &partn ) == 0 &&
+      partn <= 0xffff
+   ) {
+      return (unsigned int)partn;
+   }
+
+   return 0;
+}
+
+int links_get_target (
+   const char* const device, char* const buf, const size_t len
+) {
+   const char* const DEV_PREFIX = "/dev/";
+   const size_t DEV_PREFIX_LEN  = 5;
+   int ret;
+
+   if (
+      strncmp ( device, DEV_PREFIX, DEV_PREFIX_LEN ) == 0 &&
+      device[DEV_PREFIX_LEN] != '\0' &&
+      strchr ( device + DEV_PREFIX_LEN, '/' ) == NULL
+   ) {
+      ret = snprintf ( buf, len, "../../%s", device + DEV_PREFIX_LEN );
+   } else {
+      ret = snprintf ( buf, len, "%s", device );
+   }
+
+   return ( ret > 0 && (size_t)ret < len ) ? 0 : -1;
+}
+
+int links_create (
+   const struct links_dir* const ldir,
+   const char* const target, const char* const name
+) {
+   char tmp_name[LINK_NAME_MAX + 32];
+   char cur_target[LINK_NAME_MAX];
+   ssize_t cur_len;
+
+   if ( name[0] == '\0' ) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   if ( ldir->pretend ) {
+      return 0;
+   }
+
+   /* nothing to do if the link exists already */
+   cur_len = readlinkat ( ldir->dirfd, name, cur_target, sizeof cur_target );
+   if (
+      cur_len > 0 && (size_t)cur_len < sizeof cur_target &&
+      strncmp ( cur_target, target, (size_t)cur_len ) == 0 &&
+      target[cur_len] == '\0'
+   ) {
+      return 0;
+   }
+
+   /* like "ln -s -f", but atomic */
+   snprintf (
+      tmp_name, sizeof tmp_name, ".%s.%ld", name, (long) getpid()
+   );
+   unlinkat ( ldir->dirfd, tmp_name, 0 );
+
+   if ( symlinkat ( target, ldir->dirfd, tmp_name ) != 0 ) {
+      return -1;
+   }
+
+   if ( renameat ( ldir->dirfd, tmp_name, ldir->dirfd, name ) != 0 ) {
+      unlinkat ( ldir->dirfd, tmp_name, 0 );
+      return -1;
+   }
+
+   return 0;
+}
+
+int links_remove (
+   const struct links_dir* const ldir,
+   const char* const target, const char* const name
+) {
+   char cur_target[LINK_NAME_MAX];
+   ssize_t cur_len;
+
+   if ( ldir->pretend || name[0] == '\0' ) {
+      return 0;
+   }
+
+   cur_len = readlinkat ( ldir->dirfd, name, cur_target, sizeof cur_target );
+   if ( cur_len < 1 || (size_t)cur_len >= sizeof cur_target ) {
+      return -1;
+   }
+   cur_target[cur_len] = '\0';
+
+   /* the link may have been taken over by another device */
+   if ( strcmp ( cur_target, target ) != 0 ) {
+      return 0;
+   }
+
+   return unlinkat ( ldir->dirfd, name, 0 );
+}
@@ -0,0 +1,112 @@
+/*
+ * links.h - create /dev/disk/by-id links
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_LINKS_
+#define _DISKID_LINKS_
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "ata_id.h"
+#include "nvme_id.h"
+#include "scsi_id.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LINKS_DEFAULT_DIR "/dev/disk/by-id"
+#define LINK_NAME_MAX     256
+
+enum link_kind {
+   LINK_ID    = 0, /* <ID_BUS>-<ID_SERIAL>[-part<N>] */
+   LINK_WWN   = 1, /* wwn-<ID_WWN_WITH_EXTENSION>[-part<N>],
+                    * nvme-<ID_WWN>[-part<N>] */
+   LINK_COUNT = 2,
+};
+
+struct links_dir {
+   int          dirfd;
+   unsigned int pretend;
+};
+
+/* link names of a device, an empty name means "no link" */
+struct disk_link_names {
+   char name[LINK_COUNT][LINK_NAME_MAX];
+};
+
+/*
+ * Opens (and creates) the link directory. In pretend mode, a missing
+ * directory is not created and links_create()/links_remove() do nothing.
+ *
+ * Returns 0 on success.
+ */
+int  links_dir_open (
+   struct links_dir* const ldir, const char* const dir,
+   const unsigned int pretend
+);
+void links_dir_close ( struct links_dir* const ldir );
+
+/* partn == 0: whole disk */
+void links_get_names (
+   const struct ata_disk_info* const pinfo, const unsigned int partn,
+   struct disk_link_names* const names
+);
+
+void links_get_nvme_names (
+   const struct nvme_disk_info* const pinfo, const unsigned int partn,
+   struct disk_link_names* const names
+);
+
+void links_get_scsi_names (
+   const struct scsi_disk_info* const pinfo, const unsigned int partn,
+   struct disk_link_names* const names
+);
+
+/* reads the partition number of a device node from sysfs */
+unsigned int links_get_partn      ( const int fd );
+unsigned int links_get_partn_stat ( const struct stat* const stat_info );
+
+/*
+ * Writes the link target for device to buf:
+ * "../../<name>" for /dev/<name>, else device itself.
+ */
+int links_get_target (
+   const char* const device, char* const buf, const size_t len
+);
+
+/* atomically creates or replaces dir/name -> target */
+int links_create (
+   const struct links_dir* const ldir,
+   const char* const target, const char* const name
+);
+
+/* removes dir/name if it points to target */
+int links_remove (
+   const struct links_dir* const ldir,
+   const char* const target, const char* const name
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
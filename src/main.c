@@ -8,7 +8,8 @@
  * - other ID_BUS types _may_ be added in future
  *
  * Note that --export and --mdev behave identical if diskid is built with
- * ENABLE_MINIMAL(!=0).
+ * ENABLE_MINIMAL(!=0). Both can be restricted to a list of variables
+ * with --fields.
  *
  * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
  *
@@ -54,147 +55,577 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
 #include <getopt.h>
 #include <string.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 
 #include "disk_type.h"
 #include "ata_id.h"
+#include "nvme_id.h"
+#include "scsi_id.h"
+#include "out_buf.h"
+#include "probe.h"
+#include "sg_async.h"
+#include "id_cache.h"
+#include "id_dump.h"
+#include "block_list.h"
+#include "links.h"
+#include "daemon.h"
 #include "util.h"
 
-union u_specific_device_info {
-   struct ata_disk_info ata;
+
+/* settings and shared state of a diskid run */
+struct diskid_run {
+   /* backends, cache (NULL if caching is disabled), source and arena */
+   struct probe_ctx probe;
+   unsigned int    export;
+   unsigned int    mdev_export;
+   unsigned int    node_count;
+   unsigned int    unordered;
+   /* --create-links, NULL if disabled */
+   const struct links_dir* ldir;
+   const char*     links_dir;
+   unsigned int    list_links;
+   /* --dump-identify, NULL if disabled */
+   const struct id_dump* dump;
+   /* all output goes here, flushed per device in --unordered mode */
+   struct out_buf* out;
+   pthread_mutex_t print_lock;
+   int             retcode;
 };
 
+static int output_job (
+   struct probe_job* const job, const struct diskid_run* const run
+);
+
+/* prints a job's result and releases it, used by --unordered */
+static void print_job ( struct probe_job* const job, void* const data ) {
+   struct diskid_run* const run = data;
+
+   pthread_mutex_lock ( &(run->print_lock) );
+   if ( output_job ( job, run ) != 0 ) {
+      run->retcode = EXIT_FAILURE;
+   }
+   /* streaming mode, write the device's output right away */
+   out_buf_flush ( run->out );
+   job->printed = 1;
+   pthread_mutex_unlock ( &(run->print_lock) );
+
+   /* partitions may still need the result of their disk */
+   if ( job->children == 0 ) {
+      probe_job_release ( job );
+   }
+}
+
+static void probe_device (
+   struct probe_job* const job, void* const data
+) {
+   struct diskid_run* const run = data;
+
+   /*
+    * Partitions get the result of their disk once it has been probed,
+    * which is left to the main thread (see main()). Devices that --async
+    * has already probed (successfully or not) are not sent the same
+    * commands again.
+    */
+   if ( job->parent != NULL || job->status != PROBE_PENDING ) {
+      return;
+   }
+
+   probe_job_run ( job, &(run->probe) );
+
+   /* disks that have been added for their partitions are not printed */
+   if ( run->unordered && !job->printed ) {
+      print_job ( job, run );
+   }
+}
+
+/*
+ * Probes a job, or lets it share the result of its disk or of the first
+ * path of its LUN (job->parent), which gets probed first if necessary.
+ */
+static void run_job (
+   struct probe_job* const job, struct diskid_run* const run
+) {
+   if ( job->parent == NULL ) {
+      probe_device ( job, run );
+      return;
+   }
+
+   if ( job->parent->status == PROBE_PENDING ) {
+      run_job ( job->parent, run );
+   }
+   probe_job_share ( job, &(run->probe) );
+}
+
+
+/* --format=bin */
+static int put_device_record (
+   const struct probe_job* const job, struct out_buf* const out
+) {
+   struct out_record rec;
+
+   switch ( job->node->type ) {
+      case DISK_TYPE_ATA:
+         ata_id_get_record ( &(job->info->ata), &rec );
+         break;
+      case DISK_TYPE_NVME:
+         nvme_id_get_record ( &(job->info->nvme), &rec );
+         break;
+      case DISK_TYPE_SCSI:
+         scsi_id_get_record ( &(job->info->scsi), &rec );
+         break;
+      default:
+         return 2;
+   }
+
+   rec.device = job->device;
+   out_buf_put_record ( out, &rec );
+   return 0;
+}
 
 static int handle_device (
-   struct disk_info* const node,
+   struct probe_job* const job,
    unsigned const int export, unsigned const int mdev_export,
-   unsigned const int disk_type_mask, unsigned const int node_count
+   unsigned const int node_count, struct out_buf* const out
 ) {
    int retcode;
-   union u_specific_device_info** buffer;
-   char* varname_prefix;
+   struct disk_info* const node = job->node;
 
    const char* const VJOIN_SEQ = "_";
 
-   retcode        = 1;
-   varname_prefix = NULL;
-   buffer         = malloc ( sizeof *buffer );
-   if ( buffer == NULL ) {
-      goto handle_device_exit;
-   }
-   *buffer = NULL;
+   retcode = 1;
 
-   if ( node_count > 1 ) {
-      varname_prefix = join_str_double ( node->var_name, VJOIN_SEQ );
-   } else {
-      varname_prefix = malloc(1);
-      if ( varname_prefix != NULL ) { *varname_prefix = '\0'; }
-   }
+   if ( job->status == PROBE_ERR_OPEN ) {
+      fprintf ( stderr, "failed to open device '%s'\n", job->device );
+      return retcode;
 
+   } else if ( job->status == PROBE_ERR_TIMEOUT ) {
+      fprintf ( stderr, "timed out probing device '%s'\n", job->device );
 
-   if (
-      (disk_type_mask & DISK_TYPE_ATA) &&
-      is_ata_disk ( node, (struct ata_disk_info** const)buffer )
-   ) {
-      set_disk_type_ata ( node );
-   } else {
-      set_disk_type_none ( node );
+#if !(ENABLE_MINIMAL)
+      /* whatever has been read before, if the device has been opened */
+      if (
+         node != NULL && export != 0 && mdev_export == 0 &&
+         out->format != OUT_FORMAT_BIN &&
+         out_buf_set_prefix (
+            out, ( node_count > 1 ) ? node->var_name : NULL, VJOIN_SEQ
+         ) == 0
+      ) {
+         out_record_begin ( out, job->device );
+         out_var_str ( out, "ID_TIMEOUT", "1" );
+         print_scsi_inquiry_vars ( node, out );
+         out_record_end ( out );
+      }
+#endif
+      return retcode;
+
+   } else if ( job->status != PROBE_OK ) {
       fprintf ( stderr,
-         "failed to detect disk type for device '%s'\n", node->device
+         "failed to detect disk type for device '%s'\n", job->device
       );
-      goto handle_device_exit;
+      return retcode;
    }
 
+   if (
+      out_buf_set_prefix (
+         out, ( node_count > 1 ) ? node->var_name : NULL, VJOIN_SEQ
+      ) != 0
+   ) {
+      fprintf ( stderr, "device name too long: '%s'\n", job->device );
 
-   if ( (node->type == DISK_TYPE_NONE) || (*buffer == NULL) ) {
+   } else if ( (node->type == DISK_TYPE_NONE) || (job->info == NULL) ) {
       fprintf ( stderr, "failed to get disk info!\n" );
 
+   } else if ( out->format == OUT_FORMAT_BIN ) {
+      retcode = put_device_record ( job, out );
+
    } else if ( export == 0 && mdev_export == 0 ) {
       if ( node->type == DISK_TYPE_ATA ) {
-         set_ata_id ( node, (struct ata_disk_info* const)(*buffer) );
+         set_ata_id ( node, &(job->info->ata) );
+      } else if ( node->type == DISK_TYPE_NVME ) {
+         set_nvme_id ( node, &(job->info->nvme) );
+      } else if ( node->type == DISK_TYPE_SCSI ) {
+         set_scsi_id ( node, &(job->info->scsi) );
       }
 
       if ( node->disk_id != NULL ) {
          if ( node_count > 1 ) {
-            printf ( "%s:%s\n", node->name, node->disk_id );
-         } else {
-            printf ( "%s\n", node->disk_id );
+            out_buf_puts ( out, node->name );
+            out_buf_putc ( out, ':' );
          }
+         out_buf_puts ( out, node->disk_id );
+         out_buf_putc ( out, '\n' );
          retcode = 0;
       }
 
-   } else if ( varname_prefix != NULL ) {
+   } else {
+      out_record_begin ( out, job->device );
+
       if ( node->type == DISK_TYPE_ATA ) {
          retcode = print_ata_id_vars (
-            node,
-            (const struct ata_disk_info* const)(*buffer),
-            mdev_export, (const char* const)varname_prefix
+            node, &(job->info->ata), mdev_export, out
+         );
+      } else if ( node->type == DISK_TYPE_NVME ) {
+         retcode = print_nvme_id_vars (
+            node, &(job->info->nvme), mdev_export, out
+         );
+      } else if ( node->type == DISK_TYPE_SCSI ) {
+         retcode = print_scsi_id_vars (
+            node, &(job->info->scsi), mdev_export, out
          );
       } else {
          fprintf ( stderr, "--export is TODO!\n" );
          retcode = 2;
       }
+
+#if !(ENABLE_MINIMAL)
+      /* paths of the same multipath LUN */
+      if ( job->lun_paths != NULL && !mdev_export ) {
+         out_var_str ( out, "ID_LUN_PATHS", job->lun_paths );
+      }
+#endif
+
+      out_record_end ( out );
    }
 
-handle_device_exit:
-   if ( varname_prefix != NULL ) {
-      free ( varname_prefix );
-      varname_prefix = NULL;
+   return retcode;
+}
+
+/* --create-links */
+static int link_device (
+   struct probe_job* const job, const struct diskid_run* const run
+) {
+   struct disk_link_names names;
+   struct stat stat_info;
+   char target[LINK_NAME_MAX];
+   unsigned int partn;
+   int retcode;
+   int k;
+
+   if ( job->status == PROBE_ERR_OPEN ) {
+      fprintf ( stderr, "failed to open device '%s'\n", job->device );
+      return 1;
+
+   } else if ( job->status == PROBE_ERR_TIMEOUT ) {
+      /* may get its links on the next run */
+      fprintf ( stderr, "timed out probing device '%s'\n", job->device );
+      return 1;
+
+   } else if ( job->status != PROBE_OK || job->info == NULL ) {
+      /* not an error, such devices just do not get any links */
+      fprintf ( stderr,
+         "failed to detect disk type for device '%s'\n", job->device
+      );
+      return 0;
+   }
+
+   if ( links_get_target ( job->device, target, sizeof target ) != 0 ) {
+      fprintf ( stderr, "device path too long: '%s'\n", job->device );
+      return 1;
    }
 
-   if ( buffer != NULL ) {
-      if ( *buffer != NULL ) {
-         free ( *buffer );
-         *buffer = NULL;
+   partn = ( stat ( job->device, &stat_info ) == 0 )
+      ? links_get_partn_stat ( &stat_info ) : 0;
+   if ( job->node->type == DISK_TYPE_NVME ) {
+      links_get_nvme_names ( &(job->info->nvme), partn, &names );
+   } else if ( job->node->type == DISK_TYPE_SCSI ) {
+      links_get_scsi_names ( &(job->info->scsi), partn, &names );
+   } else {
+      links_get_names ( &(job->info->ata), partn, &names );
+   }
+
+   retcode = 0;
+   for ( k = 0; k < LINK_COUNT; k++ ) {
+      if ( names.name[k][0] == '\0' ) {
+         continue;
+
+      } else if ( links_create ( run->ldir, target, names.name[k] ) != 0 ) {
+         fprintf ( stderr,
+            "failed to create link %s/%s\n", run->links_dir, names.name[k]
+         );
+         retcode = 1;
+
+      } else if ( run->list_links ) {
+         out_buf_puts ( run->out, job->device );
+         out_buf_putc ( run->out, ':' );
+         out_buf_puts ( run->out, run->links_dir );
+         out_buf_putc ( run->out, '/' );
+         out_buf_puts ( run->out, names.name[k] );
+         out_buf_putc ( run->out, '\n' );
+
+      } else {
+         out_buf_puts ( run->out, run->links_dir );
+         out_buf_putc ( run->out, '/' );
+         out_buf_puts ( run->out, names.name[k] );
+         out_buf_putc ( run->out, '\n' );
       }
-      free ( buffer );
    }
+
    return retcode;
 }
 
+static int output_job (
+   struct probe_job* const job, const struct diskid_run* const run
+) {
+   if ( run->dump != NULL && job->status == PROBE_OK && job->info != NULL ) {
+      if (
+         id_dump_store (
+            run->dump, job->node,
+            ( job->node->type == DISK_TYPE_ATA ) ? &(job->info->ata) : NULL
+         ) != 0
+      ) {
+         fprintf ( stderr, "failed to dump data of '%s'\n", job->device );
+      }
+   }
+
+   if ( run->ldir != NULL ) {
+      return link_device ( job, run );
+   } else {
+      return handle_device (
+         job, run->export, run->mdev_export, run->node_count, run->out
+      );
+   }
+}
+
+
+static int parse_id_source (
+   const char* const arg, enum id_source* const source
+) {
+   if ( strcmp ( arg, "auto" ) == 0 ) {
+      *source = ID_SOURCE_AUTO;
+   } else if ( strcmp ( arg, "sysfs" ) == 0 ) {
+      *source = ID_SOURCE_SYSFS;
+   } else if ( strcmp ( arg, "ioctl" ) == 0 ) {
+      *source = ID_SOURCE_IOCTL;
+   } else {
+      return -1;
+   }
+   return 0;
+}
+
+static int parse_out_format ( const char* const arg, enum out_format* const format ) {
+   if ( strcmp ( arg, "env" ) == 0 ) {
+      *format = OUT_FORMAT_ENV;
+   } else if ( strcmp ( arg, "json" ) == 0 ) {
+      *format = OUT_FORMAT_JSON;
+   } else if ( strcmp ( arg, "bin" ) == 0 ) {
+      *format = OUT_FORMAT_BIN;
+   } else {
+      return -1;
+   }
+   return 0;
+}
+
+/* --timeout, --deadline: milliseconds, 1 .. INT_MAX */
+static int parse_msec ( const char* const arg, unsigned int* const msec ) {
+   unsigned long val;
+   char* endptr;
+
+   errno = 0;
+   val   = strtoul ( arg, &endptr, 10 );
+   if (
+      *arg == '\0' || *endptr != '\0' || errno != 0 ||
+      val < 1 || val > INT_MAX
+   ) {
+      return -1;
+   }
+
+   *msec = (unsigned int)val;
+   return 0;
+}
 
 int main ( const int argc, char* const* argv ) {
-   int retcode            = EXIT_SUCCESS;
-   struct disk_info* node = NULL;
+   int retcode              = EXIT_SUCCESS;
+   struct probe_job* jobs   = NULL;
+   struct arena arena       = { .chunk = NULL };
+   /* Identify Controller data, allocated from arena */
+   struct nvme_ctrl_cache nvme_ctrls;
+   /* which ioctls the drivers support */
+   struct disk_caps caps;
+   struct diskid_run run;
+   struct id_cache cache    = { .dirfd = -1 };
+   struct id_dump dump      = { .dirfd = -1 };
+   /* --all, devices found in /sys/class/block */
+   struct block_list blocks = { .dev = NULL };
+   char** block_devices     = NULL;
+   /* the devices given on the command line, or the ones found by --all */
+   char* const* devices     = NULL;
+   size_t device_count      = 0;
+   struct out_buf out       = { .data = NULL };
+   struct out_fields fields;
+   /* --fields, NULL: all variables */
+   const struct out_fields* want_fields = NULL;
+   const char* cache_dir    = NULL;
+   const char* dump_dir     = NULL;
 
    int i;
-   unsigned int node_count;
+   char* endptr;
+   unsigned long jobs_arg;
+   unsigned int node_count  = 0;
+   /* node_count plus the disks of partitions that have not been given */
+   size_t job_count         = 0;
    unsigned int exit_after_getopt;
    unsigned int want_export;
    unsigned int want_mdev_export;
+   unsigned int want_jobs;
+   unsigned int want_async;
+   unsigned int want_unordered;
+   unsigned int want_daemon;
+   unsigned int want_links;
+   unsigned int want_pretend;
+   unsigned int want_list_links;
+   unsigned int want_decode;
+   unsigned int want_all;
+   struct probe_limits limits;
+   unsigned int want_timeout;
+   unsigned int want_deadline;
+   unsigned int want_stats;
+   /* --deadline counts from here */
+   const uint64_t start_time = util_now_ns();
+   unsigned int all_classes;
+   size_t decode_count;
+   enum id_source want_source;
+   enum out_format want_format;
+   const char* links_dir    = LINKS_DEFAULT_DIR;
+   struct links_dir ldir    = { .dirfd = -1 };
+   struct daemon_config daemon_config;
    /*enum disk_type want_disk_type;*/
 
 
-   static const struct option const long_options[] = {
-      { "export", no_argument,       NULL, 'x' },
-      { "mdev",   no_argument,       NULL, 'm' },
-      { "help",   no_argument,       NULL, 'h' },
-      /*{ "type",   required_argument, NULL, 't' },*/
+   static const struct option long_options[] = {
+      { "export",    no_argument,       NULL, 'x' },
+      { "mdev",      no_argument,       NULL, 'm' },
+      { "jobs",      required_argument, NULL, 'j' },
+      { "unordered", no_argument,       NULL, 'u' },
+      { "async",     no_argument,       NULL, 'A' },
+      { "cache",     optional_argument, NULL, 'C' },
+      { "daemon",    no_argument,       NULL, 'D' },
+      { "create-links", no_argument,    NULL, 'c' },
+      { "pretend",   no_argument,       NULL, 'p' },
+      { "list-links", no_argument,      NULL, 'L' },
+      { "links-dir", required_argument, NULL, 'd' },
+      { "source",    required_argument, NULL, 'S' },
+      { "fields",    required_argument, NULL, 'F' },
+      { "format",    required_argument, NULL, 'f' },
+      { "dump-identify",   required_argument, NULL, 'I' },
+      { "decode-identify", no_argument,       NULL, 'E' },
+      { "all",       optional_argument, NULL, 'a' },
+      { "host-jobs", required_argument, NULL, 'H' },
+      { "expander-jobs", required_argument, NULL, 'X' },
+      { "timeout",   required_argument, NULL, 'T' },
+      { "deadline",  required_argument, NULL, 'B' },
+      { "stats",     no_argument,       NULL, 's' },
+      { "help",      no_argument,       NULL, 'h' },
+      /*{ "type",      required_argument, NULL, 't' },*/
       {0}
    };
 
+   nvme_ctrl_cache_init ( &nvme_ctrls );
+   disk_caps_init ( &caps );
    exit_after_getopt = 0;
    want_export       = 0;
    want_mdev_export  = 0;
+   want_jobs         = 1;
+   want_async        = 0;
+   want_unordered    = 0;
+   want_daemon       = 0;
+   want_links        = 0;
+   want_pretend      = 0;
+   want_list_links   = 0;
+   want_decode       = 0;
+   want_all          = 0;
+   limits            = (struct probe_limits) {
+      .max_workers = 1, .host_jobs = 0, .expander_jobs = 0
+   };
+   want_timeout      = 0;
+   want_deadline     = 0;
+   want_stats        = 0;
+   all_classes       = 0;
+   want_source       = ID_SOURCE_AUTO;
+   want_format       = OUT_FORMAT_ENV;
    /*want_disk_type    = DISK_TYPE_ALL;*/
    while (
-      ( i = getopt_long ( argc, argv, "xhm", long_options, NULL ) ) != -1
+      ( i = getopt_long ( argc, argv, "xhmj:uC::cpLd:", long_options, NULL ) ) != -1
    ) {
       switch ( i ) {
          case 'h':
             fprintf ( stdout,
                (
                   /* "Usage: %s [-h] [-x] [-m] [-t <TYPE>] <DEVICE> [<DEVICE>...]\n" */
-                  "Usage: %s [-h] [-x] [-m] [<DEVICE>...]\n"
+                  "Usage: %s [-h] [-x] [-m] [-j <N>] [--host-jobs=<N>]\n"
+                  "          [--expander-jobs=<N>] [--timeout=<MS>]\n"
+                  "          [--deadline=<MS>] [--stats] [-u] [--async]\n"
+                  "          [-C[<DIR>]] [--daemon] [-c [-p] [-L]] [-d <DIR>]\n"
+                  "          [--source=<SOURCE>] [--fields=<VAR>[,<VAR>...]]\n"
+                  "          [--format=<FORMAT>] [--dump-identify=<DIR>]\n"
+                  "          [--all[=<CLASS>[,<CLASS>...]] | <DEVICE>...]\n"
+                  "       %s --decode-identify [-m] [--fields=...] [--format=...]\n"
+                  "          <FILE> [<FILE>...]\n"
                   "  -h, --help           print this help message and exit\n"
                   "  -x, --export         print environment variables\n"
                   "  -m, --mdev           print environment variables for mdev\n"
+                  "  -j, --jobs <N>       probe up to N devices concurrently\n"
+                  "      --host-jobs=<N>  probe up to N devices per SCSI host\n"
+                  "                       (HBA) concurrently\n"
+                  "      --expander-jobs=<N>\n"
+                  "                       probe up to N devices per SAS expander\n"
+                  "                       concurrently\n"
+                  "      --timeout=<MS>   give up on a device that does not answer\n"
+                  "                       a command within MS milliseconds\n"
+                  "                       (default: 30000, the first attempt gets\n"
+                  "                       a quarter of it, a retry the rest)\n"
+                  "      --deadline=<MS>  give up on all devices that have not been\n"
+                  "                       probed MS milliseconds after the start\n"
+                  "      --stats          print how many ioctls have been skipped\n"
+                  "                       because the driver is known to reject\n"
+                  "                       them (to stderr, at exit)\n"
+                  "  -u, --unordered      print results as soon as they are available\n"
+                  "      --async          probe sg nodes (/dev/sg*) asynchronously\n"
+                  "  -C, --cache[=<DIR>]  cache disk identities in DIR\n"
+                  "                       (default: " ID_CACHE_DEFAULT_DIR "),\n"
+                  "                       entries are valid until the next reboot\n"
+                  "      --daemon         create " LINKS_DEFAULT_DIR " links for the\n"
+                  "                       given devices, then keep them up-to-date\n"
+                  "                       by listening for uevents\n"
+                  "  -c, --create-links   create " LINKS_DEFAULT_DIR " links\n"
+                  "  -p, --pretend        do not actually create links\n"
+                  "  -L, --list-links     print <DEVICE>:<LINK> for each link\n"
+                  "  -d, --links-dir <DIR>\n"
+                  "                       directory for links\n"
+                  "                       (default: " LINKS_DEFAULT_DIR ")\n"
+                  "      --source=<SOURCE>\n"
+                  "                       read disk identities from sysfs, ioctl\n"
+                  "                       or auto (sysfs if sufficient, default)\n"
+                  "      --fields=<VAR>[,<VAR>...]\n"
+                  "                       print only the given variables\n"
+                  "                       (implies --export unless --mdev is given)\n"
+                  "      --format=<FORMAT>\n"
+                  "                       output format: env (default), json\n"
+                  "                       (one object per line) or bin (records)\n"
+                  "      --dump-identify=<DIR>\n"
+                  "                       save the raw IDENTIFY and INQUIRY data\n"
+                  "                       of each device in DIR\n"
+                  "      --decode-identify\n"
+                  "                       decode files of concatenated raw 512-byte\n"
+                  "                       IDENTIFY blocks instead of probing devices\n"
+                  "                       (implies --export unless --mdev is given)\n"
+                  "      --all[=<CLASS>[,<CLASS>...]]\n"
+                  "                       probe all block devices of the given\n"
+                  "                       classes (disk, part, virtual) found in\n"
+                  "                       " BLOCK_LIST_SYSFS_DIR " (default: disk,\n"
+                  "                       and part with --create-links/--daemon)\n"
                   /*"  -t, --type <TYPE>    restrict or set disk type to TYPE\n"*/
                   "\n"
-               ), basename(argv[0])
+               ), basename(argv[0]), basename(argv[0])
             );
             exit_after_getopt = 1;
             break;
@@ -204,6 +635,114 @@ int main ( const int argc, char* const* argv ) {
          case 'm':
             want_mdev_export = 1;
             break;
+         case 'j':
+            jobs_arg = strtoul ( optarg, &endptr, 10 );
+            if ( *optarg == '\0' || *endptr != '\0' || jobs_arg < 1 ) {
+               fprintf ( stderr, "invalid --jobs value: '%s'\n", optarg );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            want_jobs = ( jobs_arg > 1024 ) ? 1024 : (unsigned int)jobs_arg;
+            break;
+         case 'H':
+         case 'X':
+            jobs_arg = strtoul ( optarg, &endptr, 10 );
+            if ( *optarg == '\0' || *endptr != '\0' || jobs_arg < 1 ) {
+               fprintf ( stderr,
+                  "invalid --%s value: '%s'\n",
+                  ( i == 'H' ) ? "host-jobs" : "expander-jobs", optarg
+               );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            jobs_arg = ( jobs_arg > 1024 ) ? 1024 : jobs_arg;
+            if ( i == 'H' ) {
+               limits.host_jobs     = (unsigned int)jobs_arg;
+            } else {
+               limits.expander_jobs = (unsigned int)jobs_arg;
+            }
+            break;
+         case 'T':
+         case 'B':
+            if (
+               parse_msec (
+                  optarg, ( i == 'T' ) ? &want_timeout : &want_deadline
+               ) != 0
+            ) {
+               fprintf ( stderr,
+                  "invalid --%s value: '%s'\n",
+                  ( i == 'T' ) ? "timeout" : "deadline", optarg
+               );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 's':
+            want_stats = 1;
+            break;
+         case 'u':
+            want_unordered = 1;
+            break;
+         case 'A':
+            want_async = 1;
+            break;
+         case 'C':
+            cache_dir = ( optarg != NULL ) ? optarg : ID_CACHE_DEFAULT_DIR;
+            break;
+         case 'D':
+            want_daemon = 1;
+            break;
+         case 'c':
+            want_links = 1;
+            break;
+         case 'p':
+            want_pretend = 1;
+            break;
+         case 'L':
+            want_list_links = 1;
+            break;
+         case 'd':
+            links_dir = optarg;
+            break;
+         case 'S':
+            if ( parse_id_source ( optarg, &want_source ) != 0 ) {
+               fprintf ( stderr, "invalid --source value: '%s'\n", optarg );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'f':
+            if ( parse_out_format ( optarg, &want_format ) != 0 ) {
+               fprintf ( stderr, "invalid --format value: '%s'\n", optarg );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'I':
+            dump_dir = optarg;
+            break;
+         case 'E':
+            want_decode = 1;
+            break;
+         case 'a':
+            want_all = 1;
+            if (
+               optarg != NULL &&
+               block_class_parse ( optarg, &all_classes ) != 0
+            ) {
+               fprintf ( stderr, "invalid --all value: '%s'\n", optarg );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            break;
+         case 'F':
+            if ( out_fields_parse ( &fields, optarg ) != 0 ) {
+               fprintf ( stderr, "invalid --fields value: '%s'\n", optarg );
+               retcode = EXIT_FAILURE;
+               goto main_exit;
+            }
+            want_fields = &fields;
+            break;
          /* --type, -t has no functionality so far */
          /*
          case 't':
@@ -216,26 +755,262 @@ int main ( const int argc, char* const* argv ) {
       }
    }
 
+   if (
+      ( want_fields != NULL || want_format != OUT_FORMAT_ENV || want_decode ) &&
+      !want_mdev_export
+   ) {
+      want_export = 1;
+   }
+
+#if !(ENABLE_MINIMAL)
+   /*
+    * --export needs the full IDENTIFY data, vpd_pg83 is not sufficient
+    * (unless only some variables have been requested)
+    */
+   if (
+      want_source == ID_SOURCE_AUTO && want_export && !want_mdev_export &&
+      !want_daemon && !want_links &&
+      ata_id_fields_need_identify ( want_fields ) != 0
+   ) {
+      want_source = ID_SOURCE_IDENTIFY;
+   }
+#endif
+
+   /* the dump is about the data sent by the disks, not what sysfs has */
+   if ( dump_dir != NULL && want_source == ID_SOURCE_AUTO ) {
+      want_source = ID_SOURCE_IDENTIFY;
+   }
+
    if ( exit_after_getopt == 1 ) {
       goto main_exit;
+   }
+
+   if ( want_all && !want_decode ) {
+      if ( optind < argc ) {
+         fprintf ( stderr, "--all does not take device arguments\n" );
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+
+      if ( all_classes == 0 ) {
+         all_classes = ( want_links || want_daemon )
+            ? ( BLOCK_CLASS_DISK | BLOCK_CLASS_PART ) : BLOCK_CLASS_DISK;
+      }
+
+      if ( block_list_scan ( &blocks, all_classes ) != 0 ) {
+         fprintf ( stderr, "failed to read " BLOCK_LIST_SYSFS_DIR "\n" );
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+
+      /* nothing to do */
+      if ( blocks.count == 0 && !want_daemon ) {
+         goto main_exit;
+      }
 
-   } else if ( optind < argc ) {
-      node_count = (unsigned int)(argc - optind);
+      block_devices = malloc ( ( blocks.count + 1 ) * sizeof *block_devices );
+      if ( block_devices == NULL ) {
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+      for ( device_count = 0; device_count < blocks.count; device_count++ ) {
+         block_devices[device_count] = blocks.dev[device_count].device;
+      }
+      devices = block_devices;
+
+   } else {
+      devices      = argv + optind;
+      device_count = (size_t)(argc - optind);
+   }
+
+   if ( want_decode ) {
+      if ( optind >= argc ) {
+         fprintf ( stderr, "no file specified\n" );
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+
+      if ( out_buf_init ( &out, STDOUT_FILENO, OUT_BUF_DEFAULT_SIZE ) != 0 ) {
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+      out.fields = want_fields;
+      out.format = want_format;
 
+      decode_count = 0;
       for ( i = optind; i < argc; i++ ) {
-         node = init_disk_info ( argv[i] );
-         if ( node == NULL ) {
-            fprintf ( stderr, "failed to open device '%s'\n", argv[i] );
-            retcode = EXIT_FAILURE;
-            goto main_exit;
-         } else if (
-            handle_device (
-               node, want_export, want_mdev_export, DISK_TYPE_ALL, node_count
+         if (
+            id_dump_decode_file (
+               argv[i], want_mdev_export, &out, &decode_count
             ) != 0
          ) {
             retcode = EXIT_FAILURE;
+         }
+      }
+
+   } else if ( want_daemon ) {
+      daemon_config = (struct daemon_config) {
+         .links_dir = links_dir,
+         .cache     = NULL,
+         .jobs      = want_jobs,
+         .source    = want_source,
+         .timeout_msec = want_timeout,
+         .stats     = want_stats,
+      };
+      if ( cache_dir != NULL && id_cache_open ( &cache, cache_dir ) == 0 ) {
+         daemon_config.cache = &cache;
+      }
+
+      if (
+         daemon_run (
+            &daemon_config, devices, device_count
+         ) != 0
+      ) {
+         retcode = EXIT_FAILURE;
+      }
+
+   } else if ( device_count > 0 ) {
+      node_count = (unsigned int)device_count;
+
+      /* one malloc() for all devices, unless they need more than that */
+      if (
+         arena_init (
+            &arena, node_count * ( sizeof *jobs + ARENA_DEVICE_SIZE )
+         ) != 0
+      ) {
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+
+      /* room for the disk of each partition */
+      jobs = arena_alloc ( &arena, 2 * node_count * sizeof *jobs );
+      if ( jobs == NULL ) {
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+      for ( i = 0; i < (int)node_count; i++ ) {
+         jobs[i] = (struct probe_job) { .device = devices[i] };
+      }
+
+      /*
+       * each disk is probed once, no matter how many partitions
+       * or (multipath) paths it has
+       */
+      job_count = probe_jobs_group ( jobs, node_count, &arena );
+
+      run = (struct diskid_run) {
+         .probe       = {
+            .disk_types = DISK_TYPE_ALL,
+            .cache      = NULL,
+            .source     = want_source,
+            /* owns the jobs and everything they reference */
+            .arena      = &arena,
+            .nvme_ctrls = &nvme_ctrls,
+            .caps       = &caps,
+            .ops        = NULL,
+            .timeout_msec = want_timeout,
+            .deadline     = ( want_deadline > 0 )
+               ? start_time + (uint64_t)want_deadline * 1000000 : 0,
+         },
+         .export      = want_export,
+         .mdev_export = want_mdev_export,
+         .node_count  = node_count,
+         .unordered   = want_unordered,
+         .ldir        = NULL,
+         .links_dir   = links_dir,
+         .list_links  = want_list_links,
+         .dump        = NULL,
+         .out         = &out,
+         .retcode     = EXIT_SUCCESS,
+      };
+
+      if ( out_buf_init ( &out, STDOUT_FILENO, OUT_BUF_DEFAULT_SIZE ) != 0 ) {
+         retcode = EXIT_FAILURE;
+         goto main_exit;
+      }
+      out.fields = want_fields;
+      out.format = want_format;
+
+      if ( want_links ) {
+         if ( links_dir_open ( &ldir, links_dir, want_pretend ) != 0 ) {
+            fprintf ( stderr, "failed to open '%s'\n", links_dir );
+            retcode = EXIT_FAILURE;
+            goto main_exit;
+         }
+         run.ldir = &ldir;
+      }
+
+      if ( dump_dir != NULL ) {
+         if ( id_dump_open ( &dump, dump_dir ) != 0 ) {
+            fprintf ( stderr, "failed to open '%s'\n", dump_dir );
+            retcode = EXIT_FAILURE;
             goto main_exit;
          }
+         run.dump = &dump;
+      }
+
+      /* the cache is optional, diskid works without it */
+      if ( cache_dir != NULL && id_cache_open ( &cache, cache_dir ) == 0 ) {
+         run.probe.cache = &cache;
+      }
+      pthread_mutex_init ( &(run.print_lock), NULL );
+
+      /*
+       * Probe all devices first if more than one job is allowed or
+       * --async has been requested. The output is printed in argument
+       * order unless --unordered has been given, in which case results get
+       * printed as soon as they are available.
+       * Otherwise, probe and print one device after another.
+       */
+      if ( want_async && (run.probe.disk_types & DISK_TYPE_ATA) ) {
+         sg_async_run (
+            jobs, node_count, &(run.probe),
+            ( want_unordered ? print_job : NULL ), &run
+         );
+      }
+
+      if ( want_jobs > 1 ) {
+         /* spread the probes over the host adapters */
+         limits.max_workers = want_jobs;
+         probe_jobs_locate ( jobs, job_count );
+         probe_run_hosts ( jobs, job_count, &limits, probe_device, &run );
+      }
+
+      for ( i = 0; i < (int)node_count; i++ ) {
+         if ( jobs[i].status == PROBE_PENDING ) {
+            run_job ( &jobs[i], &run );
+         }
+
+         if ( jobs[i].printed ) {
+            continue;
+
+         } else if ( want_unordered ) {
+            /*
+             * partitions and paths that share a result, and devices
+             * --async has failed to identify (those where sg_async_start()
+             * failed are still PENDING and have been probed above)
+             */
+            print_job ( &jobs[i], &run );
+
+         } else if ( output_job ( &jobs[i], &run ) != 0 ) {
+            retcode = EXIT_FAILURE;
+            /*
+             * --create-links processes all devices, and so does a run
+             * that is out of time (the devices that have been probed
+             * are still printed)
+             */
+            if ( run.ldir == NULL && jobs[i].status != PROBE_ERR_TIMEOUT ) {
+               goto main_exit;
+            }
+         }
+
+         if ( jobs[i].children == 0 ) {
+            probe_job_release ( &jobs[i] );
+         }
+      }
+
+      if ( run.retcode != EXIT_SUCCESS ) {
+         retcode = run.retcode;
       }
 
    } else {
@@ -247,13 +1022,36 @@ int main ( const int argc, char* const* argv ) {
 
 
 main_exit:
+   /* in ordered mode, this is the only write() of the run */
+   if ( out.data != NULL ) {
+      if ( out_buf_flush ( &out ) != 0 ) {
+         retcode = EXIT_FAILURE;
+      }
+      out_buf_free ( &out );
+   }
    fflush ( stdout );
+
+   /* the daemon prints its own */
+   if ( want_stats && !want_daemon && !want_decode ) {
+      fprintf ( stderr, "skipped %lu ioctls\n", caps.skipped );
+   }
    fflush ( stderr );
 
-   if ( node != NULL ) {
-      close_disk_info ( node );
-      node = NULL;
+   if ( jobs != NULL ) {
+      for ( i = 0; i < (int)job_count; i++ ) {
+         probe_job_release ( &jobs[i] );
+      }
+      jobs = NULL;
    }
+   nvme_ctrl_cache_free ( &nvme_ctrls );
+   arena_free ( &arena );
+
+   free ( block_devices );
+   block_list_free ( &blocks );
+
+   id_cache_close ( &cache );
+   id_dump_close ( &dump );
+   links_dir_close ( &ldir );
 
    return retcode;
 }
@@ -0,0 +1,416 @@
+/*
+ * nvme_id.c - reads model/serial number and namespace ids from NVMe drives
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <linux/nvme_ioctl.h>
+
+#include "udev_util.h"
+#include "disk_type.h"
+#include "sysfs.h"
+#include "nvme_id.h"
+
+/* NVMe base specification, Identify command */
+#define NVME_ADMIN_IDENTIFY     0x06
+#define NVME_ID_CNS_NS          0x00
+#define NVME_ID_CNS_CTRL        0x01
+#define NVME_ID_CNS_NS_ACTIVE   0x02
+#define NVME_ID_DATA_LEN        4096
+#define NVME_ID_NS_LIST_MAX     (NVME_ID_DATA_LEN / 4)
+
+
+enum nvme_ctrl_state {
+   /* a probe is sending Identify Controller, the others wait for it */
+   NVME_CTRL_PENDING,
+   NVME_CTRL_READY,
+   /* the next probe of the controller tries again */
+   NVME_CTRL_FAILED,
+};
+
+/* Identify Controller data of a controller, shared by its namespaces */
+struct nvme_ctrl {
+   struct nvme_ctrl* next;
+   /* "<major>:<minor>" of the controller's char device */
+   char              dev[32];
+   /* state and done are protected by the cache's lock */
+   enum nvme_ctrl_state state;
+   /* signaled when state leaves NVME_CTRL_PENDING */
+   pthread_cond_t    done;
+   char              model[41];
+   char              model_enc[256];
+   char              serial[21];
+   char              revision[9];
+   /* active namespace ids, unknown if ns_count is 0 */
+   size_t            ns_count;
+   uint32_t          ns_list[NVME_ID_NS_LIST_MAX];
+};
+
+
+void nvme_ctrl_cache_init ( struct nvme_ctrl_cache* const ctrls ) {
+   ctrls->head = NULL;
+   pthread_mutex_init ( &(ctrls->lock), NULL );
+}
+
+/* the entries are released with the arena */
+void nvme_ctrl_cache_free ( struct nvme_ctrl_cache* const ctrls ) {
+   struct nvme_ctrl* ctrl;
+
+   for ( ctrl = ctrls->head; ctrl != NULL; ctrl = ctrl->next ) {
+      pthread_cond_destroy ( &(ctrl->done) );
+   }
+   ctrls->head = NULL;
+   pthread_mutex_destroy ( &(ctrls->lock) );
+}
+
+
+/* the node's timeout, cut short by its deadline (see disk_cmd_timeout()) */
+static int nvme_identify (
+   const struct disk_info* const node, const uint32_t nsid,
+   const uint32_t cns, uint8_t buf[NVME_ID_DATA_LEN]
+) {
+   const unsigned int timeout = disk_cmd_timeout ( node, DISK_CMD_ONLY );
+   struct nvme_admin_cmd cmd;
+
+   if ( timeout == 0 ) {
+      errno = ETIMEDOUT;
+      return -1;
+   }
+
+   memzero ( &cmd, sizeof cmd );
+   cmd.opcode     = NVME_ADMIN_IDENTIFY;
+   cmd.nsid       = nsid;
+   cmd.addr       = (uint64_t)(uintptr_t) buf;
+   cmd.data_len   = NVME_ID_DATA_LEN;
+   cmd.cdw10      = cns;
+   cmd.timeout_ms = timeout;
+
+   return ( ioctl ( node->fd, NVME_IOCTL_ADMIN_CMD, &cmd ) == 0 ) ? 0 : -1;
+}
+
+static inline void transfer_id_data (
+   const uint8_t* const str, char* const to, size_t len
+) {
+   util_normalize_string ( (const char*) str, len, to, NULL, 0 );
+}
+
+/* reads the controller's dev number ("M:m") of a namespace from sysfs */
+static int nvme_ctrl_get_dev ( const int fd, char* const buf, const size_t len ) {
+   struct stat stat_info;
+
+   return (
+      fstat ( fd, &stat_info ) == 0 &&
+      sysfs_read_device_attr ( &stat_info, "dev", buf, len, 0 ) > 0
+   ) ? 0 : -1;
+}
+
+static int nvme_ctrl_identify (
+   const struct disk_info* const node, struct nvme_ctrl* const ctrl
+) {
+   uint8_t buf[NVME_ID_DATA_LEN];
+   size_t k;
+   uint32_t nsid;
+
+   if ( nvme_identify ( node, 0, NVME_ID_CNS_CTRL, buf ) != 0 ) {
+      return -1;
+   }
+
+   /* SN: bytes 4-23, MN: 24-63, FR: 64-71 (ASCII, space padded) */
+   util_normalize_string (
+      (const char*)(buf + 24), 40,
+      ctrl->model, ctrl->model_enc, sizeof ctrl->model_enc
+   );
+   transfer_id_data ( buf +  4, ctrl->serial,   20 );
+   transfer_id_data ( buf + 64, ctrl->revision,  8 );
+
+   /* NVMe 1.1+, ctrl->ns_count stays 0 if not supported */
+   ctrl->ns_count = 0;
+   if ( nvme_identify ( node, 0, NVME_ID_CNS_NS_ACTIVE, buf ) == 0 ) {
+      for ( k = 0; k < NVME_ID_NS_LIST_MAX; k++ ) {
+         nsid = (uint32_t)buf[4*k]
+            | ( (uint32_t)buf[4*k+1] << 8 )
+            | ( (uint32_t)buf[4*k+2] << 16 )
+            | ( (uint32_t)buf[4*k+3] << 24 );
+
+         /* the list ends with the first zero entry */
+         if ( nsid == 0 ) { break; }
+         ctrl->ns_list[ctrl->ns_count++] = nsid;
+      }
+   }
+
+   return 0;
+}
+
+static int nvme_ctrl_has_ns (
+   const struct nvme_ctrl* const ctrl, const uint32_t nsid
+) {
+   size_t k;
+
+   if ( ctrl->ns_count == 0 ) { return 1; }
+
+   for ( k = 0; k < ctrl->ns_count; k++ ) {
+      if ( ctrl->ns_list[k] == nsid ) { return 1; }
+   }
+   return 0;
+}
+
+/*
+ * Returns the cache entry of dev, locked by the caller. A new entry is
+ * added in state NVME_CTRL_PENDING and *owner is set: the caller has to
+ * identify the controller and set the entry's state. Otherwise, waits
+ * until the probe that owns the entry is done with it (a failed entry
+ * is taken over). Returns NULL if no entry could be allocated.
+ */
+static struct nvme_ctrl* nvme_ctrl_cache_get (
+   const struct disk_info* const node, struct nvme_ctrl_cache* const ctrls,
+   const char* const dev, int* const owner
+) {
+   struct nvme_ctrl* ctrl;
+
+   for ( ctrl = ctrls->head; ctrl != NULL; ctrl = ctrl->next ) {
+      if ( strcmp ( ctrl->dev, dev ) == 0 ) { break; }
+   }
+
+   if ( ctrl == NULL ) {
+      ctrl = arena_alloc ( node->arena, sizeof *ctrl );
+      if ( ctrl == NULL ) { return NULL; }
+
+      strcpy ( ctrl->dev, dev );
+      ctrl->state = NVME_CTRL_FAILED;
+      pthread_cond_init ( &(ctrl->done), NULL );
+      ctrl->next  = ctrls->head;
+      ctrls->head = ctrl;
+   }
+
+   while ( ctrl->state == NVME_CTRL_PENDING ) {
+      pthread_cond_wait ( &(ctrl->done), &(ctrls->lock) );
+   }
+
+   *owner = ( ctrl->state == NVME_CTRL_FAILED ) ? 1 : 0;
+   if ( *owner ) {
+      ctrl->state = NVME_CTRL_PENDING;
+   }
+   return ctrl;
+}
+
+/*
+ * Copies the controller data of a namespace to pinfo,
+ * sending Identify Controller only for the first namespace of a controller.
+ *
+ * The cache's lock is not held during the Identify commands: probes of
+ * the same controller wait on its entry, other controllers go ahead.
+ *
+ * Returns 0 on success, 1 if the namespace is not active and -1 on error.
+ */
+static int nvme_ctrl_get (
+   const struct disk_info* const node, const uint32_t nsid,
+   struct nvme_disk_info* const pinfo
+) {
+   struct nvme_ctrl_cache* const ctrls = node->nvme_ctrls;
+   struct nvme_ctrl tmp;
+   char dev[32];
+   struct nvme_ctrl* entry;
+   const struct nvme_ctrl* ctrl;
+   int owner;
+   int ret;
+
+   /* not remembered if there is no dev number to look it up */
+   entry = NULL;
+   owner = 1;
+   if (
+      ctrls != NULL && nvme_ctrl_get_dev ( node->fd, dev, sizeof dev ) == 0
+   ) {
+      pthread_mutex_lock ( &(ctrls->lock) );
+      entry = nvme_ctrl_cache_get ( node, ctrls, dev, &owner );
+      pthread_mutex_unlock ( &(ctrls->lock) );
+      if ( entry == NULL ) { owner = 1; }
+   }
+
+   ctrl = entry;
+   if ( owner ) {
+      ret  = nvme_ctrl_identify ( node, &tmp );
+      ctrl = ( ret == 0 ) ? &tmp : NULL;
+
+      if ( entry != NULL ) {
+         pthread_mutex_lock ( &(ctrls->lock) );
+         if ( ret == 0 ) {
+            memcpy ( entry->model,     tmp.model,     sizeof entry->model );
+            memcpy ( entry->model_enc, tmp.model_enc, sizeof entry->model_enc );
+            memcpy ( entry->serial,    tmp.serial,    sizeof entry->serial );
+            memcpy ( entry->revision,  tmp.revision,  sizeof entry->revision );
+            entry->ns_count = tmp.ns_count;
+            memcpy (
+               entry->ns_list, tmp.ns_list,
+               tmp.ns_count * sizeof *(tmp.ns_list)
+            );
+            entry->state = NVME_CTRL_READY;
+         } else {
+            entry->state = NVME_CTRL_FAILED;
+         }
+         pthread_cond_broadcast ( &(entry->done) );
+         pthread_mutex_unlock ( &(ctrls->lock) );
+      }
+   }
+
+   /* a ready entry does not change anymore, no lock needed to read it */
+   if ( ctrl == NULL ) {
+      ret = -1;
+
+   } else if ( nvme_ctrl_has_ns ( ctrl, nsid ) == 0 ) {
+      ret = 1;
+
+   } else {
+      memcpy ( pinfo->model,     ctrl->model,     sizeof pinfo->model );
+      memcpy ( pinfo->model_enc, ctrl->model_enc, sizeof pinfo->model_enc );
+      memcpy ( pinfo->serial,    ctrl->serial,    sizeof pinfo->serial );
+      memcpy ( pinfo->revision,  ctrl->revision,  sizeof pinfo->revision );
+      ret = 0;
+   }
+
+   return ret;
+}
+
+static int is_zero ( const uint8_t* const buf, const size_t len ) {
+   size_t k;
+
+   for ( k = 0; k < len; k++ ) {
+      if ( buf[k] != 0 ) { return 0; }
+   }
+   return 1;
+}
+
+/* same format as the kernel's "wwid" attribute */
+static void nvme_ns_set_wwn (
+   const uint8_t* const id, struct nvme_disk_info* const pinfo
+) {
+   /* NGUID: bytes 104-119, EUI64: 120-127 */
+   const uint8_t* src;
+   size_t len;
+   size_t k;
+   char* p;
+
+   if ( is_zero ( id + 104, 16 ) == 0 ) {
+      src = id + 104;
+      len = 16;
+   } else if ( is_zero ( id + 120, 8 ) == 0 ) {
+      src = id + 120;
+      len = 8;
+   } else {
+      pinfo->wwn[0] = '\0';
+      return;
+   }
+
+   p = pinfo->wwn + sprintf ( pinfo->wwn, "eui." );
+   for ( k = 0; k < len; k++ ) {
+      p += sprintf ( p, "%02x", src[k] );
+   }
+}
+
+
+int is_nvme_disk (
+   const struct disk_info* const node,
+   struct nvme_disk_info** const pinfo
+) {
+   struct nvme_disk_info info;
+   struct nvme_disk_info* my_info;
+   uint8_t buf[NVME_ID_DATA_LEN];
+   int nsid;
+
+   /* only NVMe namespaces know this ioctl */
+   nsid = ioctl ( node->fd, NVME_IOCTL_ID );
+   if ( nsid <= 0 ) {
+      return 0;
+   }
+
+   info = (struct nvme_disk_info) { .nsid = (uint32_t)nsid };
+
+   if (
+      nvme_ctrl_get ( node, info.nsid, &info ) != 0 ||
+      nvme_identify ( node, info.nsid, NVME_ID_CNS_NS, buf ) != 0
+   ) {
+      return 0;
+   }
+   nvme_ns_set_wwn ( buf, &info );
+
+   my_info = arena_alloc ( node->arena, sizeof *my_info );
+   if ( my_info == NULL ) {
+      return 0;
+   }
+   *my_info = info;
+
+   *pinfo = my_info;
+   return 1;
+}
+
+
+static inline int print_mdev_nvme_id_vars (
+   const struct nvme_disk_info* const pinfo, struct out_buf* const out
+) {
+   out_var_str ( out, "ID_BUS", "nvme" );
+   if ( out_var_begin ( out, "ID_SERIAL" ) ) {
+      out_val_puts ( out, pinfo->model );
+      if ( pinfo->serial[0] != '\0' ) {
+         out_val_putc ( out, '_' );
+         out_val_puts ( out, pinfo->serial );
+      }
+      out_var_end ( out );
+   }
+   if ( pinfo->wwn[0] != '\0' ) {
+      out_var_str ( out, "ID_WWN", pinfo->wwn );
+   }
+   return 0;
+}
+
+int print_nvme_id_vars (
+   const struct disk_info* const node,
+   const struct nvme_disk_info* const pinfo,
+   unsigned const int mdev_export,
+   struct out_buf* const out
+) {
+#if !(ENABLE_MINIMAL)
+   /* --export: --mdev variables and some more */
+   if ( mdev_export == 0 ) {
+      out_var_str  ( out, "ID_TYPE", "disk" );
+      out_var_str  ( out, "ID_MODEL", pinfo->model );
+      out_var_str  ( out, "ID_MODEL_ENC", pinfo->model_enc );
+      out_var_str  ( out, "ID_REVISION", pinfo->revision );
+      out_var_str  ( out, "ID_SERIAL_SHORT", pinfo->serial );
+      out_var_uint ( out, "ID_NSID", pinfo->nsid );
+   }
+#endif
+   return print_mdev_nvme_id_vars ( pinfo, out );
+}
+
+void nvme_id_get_record (
+   const struct nvme_disk_info* const pinfo, struct out_record* const rec
+) {
+   rec->type     = DISK_TYPE_NVME;
+   rec->flags    = 0;
+   rec->model    = pinfo->model;
+   rec->serial   = pinfo->serial;
+   rec->revision = pinfo->revision;
+   memcpy ( rec->wwn, pinfo->wwn, sizeof rec->wwn );
+   rec->wwn[sizeof rec->wwn - 1] = '\0';
+}
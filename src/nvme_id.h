@@ -0,0 +1,97 @@
+/*
+ * nvme_id.h - reads model/serial number and namespace ids from NVMe drives
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_NVME_ID_
+#define _DISKID_NVME_ID_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "disk_type.h"
+#include "out_buf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct nvme_disk_info {
+   char     model[41];
+   char     model_enc[256];
+   char     serial[21];
+   char     revision[9];
+   uint32_t nsid;
+   /* "eui.<NGUID or EUI64>", empty if the namespace has neither */
+   char     wwn[40];
+};
+
+struct nvme_ctrl;
+
+/*
+ * Identify Controller data of the controllers seen during a run,
+ * shared by all of their namespaces. Entries are allocated from the
+ * probed nodes' arena, so the cache must not outlive that arena.
+ */
+struct nvme_ctrl_cache {
+   struct nvme_ctrl* head;
+   pthread_mutex_t   lock;
+};
+
+void nvme_ctrl_cache_init ( struct nvme_ctrl_cache* const ctrls );
+void nvme_ctrl_cache_free ( struct nvme_ctrl_cache* const ctrls );
+
+/*
+ * Identifies an NVMe namespace (block device, e.g. /dev/nvme0n1)
+ * with Identify Controller and Identify Namespace.
+ *
+ * If node->nvme_ctrls is set, the controller data and its active namespace
+ * list are fetched only once per controller and shared by all of its
+ * namespaces (thread-safe).
+ *
+ * Returns 1 if node is an NVMe namespace (*pinfo is allocated from
+ * node->arena), else 0.
+ */
+int is_nvme_disk (
+   const struct disk_info* const node,
+   struct nvme_disk_info** const pinfo
+);
+
+int print_nvme_id_vars (
+   const struct disk_info* const node,
+   const struct nvme_disk_info* const pinfo,
+   unsigned const int mdev_export,
+   struct out_buf* const out
+);
+
+/* fills a --format=bin record, except for its device */
+void nvme_id_get_record (
+   const struct nvme_disk_info* const pinfo, struct out_record* const rec
+);
+
+static inline int set_nvme_id (
+   struct disk_info* const node, const struct nvme_disk_info* const pinfo
+) {
+   return (pinfo == NULL) ? -1 : set_disk_id (node, pinfo->model, pinfo->serial);
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ * out_buf.c - buffered output of environment variables
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "out_buf.h"
+
+
+int out_buf_init ( struct out_buf* const ob, const int fd, const size_t size ) {
+   ob->len        = 0;
+   ob->size       = ( size > 0 ) ? size : OUT_BUF_DEFAULT_SIZE;
+   ob->fd         = fd;
+   ob->error      = 0;
+   ob->prefix[0]  = '\0';
+   ob->prefix_len = 0;
+   ob->fields     = NULL;
+   ob->format     = OUT_FORMAT_ENV;
+   ob->nvars      = 0;
+   ob->data       = malloc ( ob->size );
+
+   return ( ob->data != NULL ) ? 0 : -1;
+}
+
+void out_buf_free ( struct out_buf* const ob ) {
+   if ( ob->data != NULL ) {
+      free ( ob->data );
+      ob->data = NULL;
+   }
+   ob->len  = 0;
+   ob->size = 0;
+}
+
+static int out_buf_write (
+   const int fd, const char* const data, const size_t len
+) {
+   size_t written;
+   ssize_t ret;
+
+   written = 0;
+   while ( written < len ) {
+      ret = write ( fd, data + written, len - written );
+      if ( ret < 0 ) {
+         if ( errno == EINTR ) { continue; }
+         return -1;
+      }
+      written += (size_t)ret;
+   }
+
+   return 0;
+}
+
+int out_buf_flush ( struct out_buf* const ob ) {
+   if ( ob->len > 0 ) {
+      if ( out_buf_write ( ob->fd, ob->data, ob->len ) != 0 ) {
+         ob->error = 1;
+      }
+      ob->len = 0;
+   }
+
+   return ( ob->error == 0 ) ? 0 : -1;
+}
+
+void out_buf_put_slow (
+   struct out_buf* const ob, const char* const s, size_t len
+) {
+   out_buf_flush ( ob );
+
+   if ( len <= ob->size ) {
+      memcpy ( ob->data, s, len );
+      ob->len = len;
+
+   } else if ( out_buf_write ( ob->fd, s, len ) != 0 ) {
+      ob->error = 1;
+   }
+}
+
+int out_buf_set_prefix (
+   struct out_buf* const ob, const char* const name, const char* const sep
+) {
+   const size_t name_len = ( name == NULL ) ? 0 : strlen ( name );
+   const size_t sep_len  = ( sep  == NULL ) ? 0 : strlen ( sep );
+
+   ob->prefix[0]  = '\0';
+   ob->prefix_len = 0;
+
+   if ( name == NULL ) {
+      return 0;
+
+   } else if ( name_len + sep_len >= sizeof ob->prefix ) {
+      return -1;
+   }
+
+   memcpy ( ob->prefix, name, name_len );
+   memcpy ( ob->prefix + name_len, sep, sep_len );
+   ob->prefix_len = name_len + sep_len;
+   ob->prefix[ob->prefix_len] = '\0';
+
+   return 0;
+}
+
+void out_buf_put_uint ( struct out_buf* const ob, uint64_t value ) {
+   char buf[20];
+   size_t k;
+
+   /* digits are written back to front */
+   k = sizeof buf;
+   do {
+      buf[--k] = (char)( '0' + (value % 10) );
+      value   /= 10;
+   } while ( value != 0 );
+
+   out_buf_put ( ob, buf + k, sizeof buf - k );
+}
+
+void out_buf_put_hex ( struct out_buf* const ob, uint64_t value ) {
+   static const char hex_digits[] = "0123456789abcdef";
+   char buf[16];
+   size_t k;
+
+   k = sizeof buf;
+   do {
+      buf[--k] = hex_digits[value & 0xf];
+      value  >>= 4;
+   } while ( value != 0 );
+
+   out_buf_put ( ob, buf + k, sizeof buf - k );
+}
+
+int out_fields_parse ( struct out_fields* const fields, const char* const str ) {
+   char* name;
+   char* end;
+
+   fields->count = 0;
+   if ( strlen ( str ) >= sizeof fields->buf ) {
+      return -1;
+   }
+   strcpy ( fields->buf, str );
+
+   for ( name = fields->buf; ; name = end + 1 ) {
+      end = strchr ( name, ',' );
+      if ( end != NULL ) { *end = '\0'; }
+
+      if ( name[0] == '\0' || fields->count >= OUT_FIELDS_MAX ) {
+         return -1;
+      }
+      fields->name[fields->count++] = name;
+
+      if ( end == NULL ) { break; }
+   }
+
+   return 0;
+}
+
+void out_val_put_json ( struct out_buf* const ob, const char* const s ) {
+   static const char hex_digits[] = "0123456789abcdef";
+   const char* run;
+   const char* p;
+   char esc[6];
+   unsigned char c;
+
+   /* copy runs of characters that need no escaping in one go */
+   for ( run = p = s; *p != '\0'; p++ ) {
+      c = (unsigned char)*p;
+      /* UTF-8 sequences (bytes >= 0x80) are passed through as they are */
+      if ( c >= 0x20 && c != 0x7f && c != '"' && c != '\\' ) { continue; }
+
+      out_buf_put ( ob, run, (size_t)(p - run) );
+      run = p + 1;
+
+      if ( c == '"' || c == '\\' ) {
+         esc[0] = '\\';
+         esc[1] = (char)c;
+         out_buf_put ( ob, esc, 2 );
+      } else {
+         /* control chars */
+         esc[0] = '\\';
+         esc[1] = 'u';
+         esc[2] = '0';
+         esc[3] = '0';
+         esc[4] = hex_digits[c >> 4];
+         esc[5] = hex_digits[c & 0xf];
+         out_buf_put ( ob, esc, 6 );
+      }
+   }
+   out_buf_put ( ob, run, (size_t)(p - run) );
+}
+
+void out_record_begin ( struct out_buf* const ob, const char* const device ) {
+   if ( ob->format == OUT_FORMAT_JSON ) {
+      out_buf_put      ( ob, "{\"device\":\"", 11 );
+      out_val_put_json ( ob, device );
+      out_buf_putc     ( ob, '"' );
+      ob->nvars = 1;
+   }
+}
+
+void out_record_end ( struct out_buf* const ob ) {
+   if ( ob->format == OUT_FORMAT_JSON ) {
+      out_buf_put ( ob, "}\n", 2 );
+      ob->nvars = 0;
+   }
+}
+
+static void out_bin_put_str (
+   uint8_t* const rec, const size_t offset, const size_t len,
+   const char* const s
+) {
+   size_t slen;
+
+   if ( s != NULL ) {
+      slen = strlen ( s );
+      memcpy ( rec + offset, s, ( slen < len ) ? slen : len - 1 );
+   }
+}
+
+void out_buf_put_record (
+   struct out_buf* const ob, const struct out_record* const rec
+) {
+   uint8_t buf[OUT_BIN_RECORD_LEN];
+
+   memset ( buf, 0, OUT_BIN_OFF_IDENTIFY );
+
+   buf[OUT_BIN_OFF_LENGTH]     = (uint8_t)( OUT_BIN_RECORD_LEN & 0xff );
+   buf[OUT_BIN_OFF_LENGTH + 1] = (uint8_t)( OUT_BIN_RECORD_LEN >> 8 );
+   buf[OUT_BIN_OFF_VERSION]    = OUT_BIN_VERSION;
+   buf[OUT_BIN_OFF_TYPE]       = (uint8_t)rec->type;
+   buf[OUT_BIN_OFF_FLAGS]      = (uint8_t)rec->flags;
+
+   out_bin_put_str ( buf, OUT_BIN_OFF_DEVICE,   64, rec->device );
+   out_bin_put_str ( buf, OUT_BIN_OFF_MODEL,    64, rec->model );
+   out_bin_put_str ( buf, OUT_BIN_OFF_SERIAL,   64, rec->serial );
+   out_bin_put_str ( buf, OUT_BIN_OFF_REVISION, 16, rec->revision );
+   out_bin_put_str ( buf, OUT_BIN_OFF_WWN,      40, rec->wwn );
+
+   if ( rec->flags & OUT_BIN_FLAG_IDENTIFY ) {
+      memcpy ( buf + OUT_BIN_OFF_IDENTIFY, rec->identify, 512 );
+   } else {
+      memset ( buf + OUT_BIN_OFF_IDENTIFY, 0, 512 );
+   }
+
+   out_buf_put ( ob, (const char*) buf, sizeof buf );
+}
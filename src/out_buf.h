@@ -0,0 +1,275 @@
+/*
+ * out_buf.h - buffered output of environment variables
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_OUT_BUF_
+#define _DISKID_OUT_BUF_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OUT_BUF_DEFAULT_SIZE (64 * 1024)
+#define OUT_PREFIX_MAX       256
+#define OUT_FIELDS_MAX       64
+#define OUT_FIELDS_STR_MAX   1024
+
+enum out_format {
+   OUT_FORMAT_ENV  = 0, /* <prefix><name>=<value> lines */
+   OUT_FORMAT_JSON = 1, /* one JSON object per device and line */
+   OUT_FORMAT_BIN  = 2, /* one fixed-layout record per device */
+};
+
+/*
+ * --format=bin record layout, all integers are little endian and
+ * strings are NUL-padded (and always NUL-terminated).
+ * length allows to skip records of a later version with a bigger size.
+ */
+#define OUT_BIN_VERSION        1
+#define OUT_BIN_OFF_LENGTH     0   /* uint32, record length, this included */
+#define OUT_BIN_OFF_VERSION    4   /* uint16 */
+#define OUT_BIN_OFF_TYPE       6   /* uint8, enum disk_type */
+#define OUT_BIN_OFF_FLAGS      7   /* uint8, OUT_BIN_FLAG_* */
+#define OUT_BIN_OFF_DEVICE     8   /* char[64] */
+#define OUT_BIN_OFF_MODEL      72  /* char[64] */
+#define OUT_BIN_OFF_SERIAL     136 /* char[64], ID_SERIAL_SHORT */
+#define OUT_BIN_OFF_REVISION   200 /* char[16] */
+#define OUT_BIN_OFF_WWN        216 /* char[40], ID_WWN_WITH_EXTENSION */
+#define OUT_BIN_OFF_IDENTIFY   256 /* uint8[512], as sent by the disk */
+#define OUT_BIN_RECORD_LEN     768
+
+/* the IDENTIFY block is valid */
+#define OUT_BIN_FLAG_IDENTIFY  0x1
+
+/* what a --format=bin record is made of */
+struct out_record {
+   unsigned int type;
+   unsigned int flags;
+   const char*  device;
+   const char*  model;
+   const char*  serial;
+   const char*  revision;
+   char         wwn[40];
+   uint8_t      identify[512];
+};
+
+/* names of the variables that should be printed (--fields) */
+struct out_fields {
+   size_t      count;
+   const char* name[OUT_FIELDS_MAX];
+   char        buf[OUT_FIELDS_STR_MAX];
+};
+
+/*
+ * All output of a run is appended to one buffer, which is written
+ * with a single write() when flushed (or when it is full).
+ *
+ * Variables are printed as "<prefix><name>=<value>\n", the prefix is
+ * formatted once per device with out_buf_set_prefix().
+ * In OUT_FORMAT_JSON mode, they are printed as "<name>":"<value>" members
+ * of the object started by out_record_begin().
+ */
+struct out_buf {
+   char*  data;
+   size_t len;
+   size_t size;
+   int    fd;
+   /* set if a write() failed, the output is incomplete */
+   int    error;
+   char   prefix[OUT_PREFIX_MAX];
+   size_t prefix_len;
+   /* NULL: print all variables */
+   const struct out_fields* fields;
+   enum out_format format;
+   /* number of members of the current JSON object */
+   unsigned int    nvars;
+};
+
+/* Returns 0 on success. */
+int  out_buf_init  ( struct out_buf* const ob, const int fd, const size_t size );
+/* frees the buffer, without flushing it */
+void out_buf_free  ( struct out_buf* const ob );
+/* writes the buffer to ob->fd, returns 0 on success */
+int  out_buf_flush ( struct out_buf* const ob );
+
+/*
+ * Sets the variable prefix to "<name><sep>", or clears it if name is NULL.
+ *
+ * Returns 0 on success, else non-zero (prefix too long).
+ */
+int out_buf_set_prefix (
+   struct out_buf* const ob, const char* const name, const char* const sep
+);
+
+void out_buf_put_slow ( struct out_buf* const ob, const char* const s, size_t len );
+
+/*
+ * Parses a comma-separated list of variable names, e.g. "ID_SERIAL,ID_WWN".
+ * Returns 0 on success, else non-zero (empty name, too many names).
+ */
+int out_fields_parse ( struct out_fields* const fields, const char* const str );
+
+/* whether name is in fields, which may be NULL (= all names) */
+static inline int out_fields_has (
+   const struct out_fields* const fields, const char* const name
+) {
+   size_t k;
+
+   if ( fields == NULL ) { return 1; }
+
+   for ( k = 0; k < fields->count; k++ ) {
+      if ( strcmp ( fields->name[k], name ) == 0 ) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/* whether the variable name should be printed */
+static inline int out_var_wanted (
+   const struct out_buf* const ob, const char* const name
+) {
+   return out_fields_has ( ob->fields, name );
+}
+
+static inline void out_buf_put (
+   struct out_buf* const ob, const char* const s, const size_t len
+) {
+   if ( ob->len + len <= ob->size ) {
+      memcpy ( ob->data + ob->len, s, len );
+      ob->len += len;
+   } else {
+      out_buf_put_slow ( ob, s, len );
+   }
+}
+
+static inline void out_buf_puts ( struct out_buf* const ob, const char* const s ) {
+   out_buf_put ( ob, s, strlen ( s ) );
+}
+
+static inline void out_buf_putc ( struct out_buf* const ob, const char c ) {
+   out_buf_put ( ob, &c, 1 );
+}
+
+/*
+ * value of a variable, JSON-escaped if necessary: '"', '\\' and control
+ * chars are, everything else (UTF-8 included) is copied unchanged
+ */
+void out_val_put_json ( struct out_buf* const ob, const char* const s );
+
+static inline void out_val_puts ( struct out_buf* const ob, const char* const s ) {
+   if ( ob->format == OUT_FORMAT_JSON ) {
+      out_val_put_json ( ob, s );
+   } else {
+      out_buf_puts ( ob, s );
+   }
+}
+
+static inline void out_val_putc ( struct out_buf* const ob, const char c ) {
+   const char s[2] = { c, '\0' };
+   out_val_puts ( ob, s );
+}
+
+/*
+ * Starts/ends the output of a device, "{"device":"<device>"" and "}\n"
+ * in JSON mode, nothing otherwise.
+ */
+void out_record_begin ( struct out_buf* const ob, const char* const device );
+void out_record_end   ( struct out_buf* const ob );
+
+/* writes rec in the --format=bin layout */
+void out_buf_put_record (
+   struct out_buf* const ob, const struct out_record* const rec
+);
+
+/* decimal / lowercase hex (without "0x") */
+void out_buf_put_uint ( struct out_buf* const ob, const uint64_t value );
+void out_buf_put_hex  ( struct out_buf* const ob, const uint64_t value );
+
+/* "<prefix><name>=" or ","<name>":" */
+static inline void out_var_key ( struct out_buf* const ob, const char* const name ) {
+   if ( ob->format == OUT_FORMAT_JSON ) {
+      if ( ob->nvars++ > 0 ) { out_buf_putc ( ob, ',' ); }
+      out_buf_putc ( ob, '"' );
+      out_buf_puts ( ob, name );
+      out_buf_put  ( ob, "\":", 2 );
+   } else {
+      out_buf_put  ( ob, ob->prefix, ob->prefix_len );
+      out_buf_puts ( ob, name );
+      out_buf_putc ( ob, '=' );
+   }
+}
+
+/*
+ * Starts a string variable, the value has to be written with out_val_puts()
+ * and finished with out_var_end().
+ * Returns 0 (and prints nothing) if the variable has not been selected.
+ */
+static inline int out_var_begin ( struct out_buf* const ob, const char* const name ) {
+   if ( !out_var_wanted ( ob, name ) ) { return 0; }
+
+   out_var_key ( ob, name );
+   if ( ob->format == OUT_FORMAT_JSON ) { out_buf_putc ( ob, '"' ); }
+   return 1;
+}
+
+static inline void out_var_end ( struct out_buf* const ob ) {
+   out_buf_putc ( ob, ( ob->format == OUT_FORMAT_JSON ) ? '"' : '\n' );
+}
+
+static inline void out_var_str (
+   struct out_buf* const ob, const char* const name, const char* const value
+) {
+   if ( out_var_begin ( ob, name ) ) {
+      out_val_puts ( ob, value );
+      out_var_end  ( ob );
+   }
+}
+
+/* a JSON number in JSON mode */
+static inline void out_var_uint (
+   struct out_buf* const ob, const char* const name, const uint64_t value
+) {
+   if ( out_var_wanted ( ob, name ) ) {
+      out_var_key      ( ob, name );
+      out_buf_put_uint ( ob, value );
+      if ( ob->format != OUT_FORMAT_JSON ) { out_buf_putc ( ob, '\n' ); }
+   }
+}
+
+/* "0x<hex>" */
+static inline void out_var_hex (
+   struct out_buf* const ob, const char* const name, const uint64_t value
+) {
+   if ( out_var_begin ( ob, name ) ) {
+      out_buf_put     ( ob, "0x", 2 );
+      out_buf_put_hex ( ob, value );
+      out_var_end     ( ob );
+   }
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
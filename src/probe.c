@@ -0,0 +1,691 @@
+/*
+ * probe.c - probe several devices concurrently
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "util.h"
+#include "sysfs.h"
+#include "probe.h"
+
+/* what probe_jobs_group() knows about a job's device */
+struct probe_job_dev {
+   /* 0 if not a block device */
+   dev_t       devnum;
+   /* partitions only: device number and node of the disk */
+   dev_t       disk;
+   const char* disk_device;
+   /* whole disks only: globally unique wwid of the LUN, or NULL */
+   const char* wwid;
+};
+
+
+void probe_job_run (
+   struct probe_job* const job, const struct probe_ctx* const ctx
+) {
+   const unsigned int disk_type_mask = ctx->disk_types;
+
+   if ( ctx->deadline != 0 && util_now_ns() >= ctx->deadline ) {
+      job->status = PROBE_ERR_TIMEOUT;
+      return;
+   }
+
+   job->node = init_disk_info ( job->device, ctx->arena, ctx->ops );
+   if ( job->node == NULL ) {
+      job->status = PROBE_ERR_OPEN;
+      return;
+   }
+   probe_ctx_set_node ( ctx, job->node );
+
+   if (
+      (disk_type_mask & DISK_TYPE_ATA) &&
+      is_ata_disk ( job->node, (struct ata_disk_info** const)&(job->info) )
+   ) {
+      set_disk_type_ata ( job->node );
+      job->status = PROBE_OK;
+   } else if (
+      (disk_type_mask & DISK_TYPE_NVME) &&
+      is_nvme_disk ( job->node, (struct nvme_disk_info** const)&(job->info) )
+   ) {
+      set_disk_type_nvme ( job->node );
+      job->status = PROBE_OK;
+   } else if (
+      (disk_type_mask & DISK_TYPE_SCSI) &&
+      is_scsi_disk ( job->node, (struct scsi_disk_info** const)&(job->info) )
+   ) {
+      set_disk_type_scsi ( job->node );
+      job->status = PROBE_OK;
+   } else {
+      set_disk_type_none ( job->node );
+      /* also set if the deadline cut a command short */
+      job->status = ( job->node->timed_out )
+         ? PROBE_ERR_TIMEOUT : PROBE_ERR_DETECT;
+   }
+
+   /* the fd is not needed anymore, free it up for other devices */
+   close_disk_info_fd ( job->node );
+}
+
+
+/*
+ * Reads device number and name of a partition's disk from the disk's
+ * uevent file. Returns 0 if stat_info is a partition, else non-zero.
+ */
+static int probe_get_partition_disk (
+   const struct stat* const stat_info, struct arena* const arena,
+   struct probe_job_dev* const jdev
+) {
+   char path[SYSFS_PATH_MAX];
+   char buf[512];
+   char devname[SYSFS_PATH_MAX];
+   char* line;
+   char* save;
+   unsigned int maj;
+   unsigned int min;
+
+   if (
+      sysfs_dev_path ( path, sizeof path, stat_info, "partition" ) != 0 ||
+      access ( path, F_OK ) != 0 ||
+      sysfs_dev_path ( path, sizeof path, stat_info, "../uevent" ) != 0 ||
+      sysfs_read_attr ( path, buf, sizeof buf ) < 1
+   ) {
+      return -1;
+   }
+
+   /* MAJOR=8, MINOR=0, DEVNAME=sda, DEVTYPE=disk, ... */
+   maj        = 0;
+   min        = 0;
+   devname[0] = '\0';
+   for (
+      line = strtok_r ( buf, "\n", &save ); line != NULL;
+      line = strtok_r ( NULL, "\n", &save )
+   ) {
+      if ( strncmp ( line, "MAJOR=", 6 ) == 0 ) {
+         maj = (unsigned int)strtoul ( line + 6, NULL, 10 );
+      } else if ( strncmp ( line, "MINOR=", 6 ) == 0 ) {
+         min = (unsigned int)strtoul ( line + 6, NULL, 10 );
+      } else if ( strncmp ( line, "DEVNAME=", 8 ) == 0 ) {
+         snprintf ( devname, sizeof devname, "/dev/%s", line + 8 );
+      }
+   }
+
+   if ( maj == 0 || devname[0] == '\0' ) { return -1; }
+
+   jdev->disk        = makedev ( maj, min );
+   jdev->disk_device = arena_strdup ( arena, devname );
+   return ( jdev->disk_device != NULL ) ? 0 : -1;
+}
+
+/*
+ * Reads the LUN's wwid attribute (SCSI device or NVMe namespace).
+ * Only NAA and EUI-64 identifiers are used, T10 vendor ids are made up
+ * of vendor, model and serial strings and not unique for all devices.
+ */
+static const char* probe_get_wwid (
+   const dev_t devnum, struct arena* const arena
+) {
+   static const char* const wwid_attrs[] = { "device/wwid", "wwid", NULL };
+   struct stat stat_info;
+   char path[SYSFS_PATH_MAX];
+   char wwid[256];
+   size_t k;
+
+   memset ( &stat_info, 0, sizeof stat_info );
+   stat_info.st_mode = S_IFBLK;
+   stat_info.st_rdev = devnum;
+
+   for ( k = 0; wwid_attrs[k] != NULL; k++ ) {
+      if (
+         sysfs_dev_path ( path, sizeof path, &stat_info, wwid_attrs[k] ) == 0 &&
+         sysfs_read_attr ( path, wwid, sizeof wwid ) > 4
+      ) {
+         if (
+            strncmp ( wwid, "naa.", 4 ) == 0 || strncmp ( wwid, "eui.", 4 ) == 0
+         ) {
+            return arena_strdup ( arena, wwid );
+         }
+         return NULL;
+      }
+   }
+
+   return NULL;
+}
+
+/* partitions share the job of their disk, which is added if necessary */
+static size_t probe_jobs_share_partitions (
+   struct probe_job* const jobs, struct probe_job_dev* const jdev,
+   const size_t count
+) {
+   size_t total;
+   size_t last;
+   size_t j;
+   size_t k;
+
+   total = count;
+   last  = 0;
+   for ( k = 0; k < count; k++ ) {
+      if ( jdev[k].disk_device == NULL ) { continue; }
+
+      /* partitions are usually listed right after their disk */
+      if ( jdev[last].devnum == jdev[k].disk ) {
+         j = last;
+      } else {
+         for ( j = 0; j < total && jdev[j].devnum != jdev[k].disk; j++ ) { ; }
+      }
+
+      if ( j == total ) {
+         /* probed, but not printed */
+         jobs[total] = (struct probe_job) {
+            .device  = jdev[k].disk_device,
+            .printed = 1,
+         };
+         jdev[total] = (struct probe_job_dev) {
+            .devnum = jdev[k].disk, .disk_device = NULL, .wwid = NULL
+         };
+         total++;
+      }
+
+      jobs[k].parent = &jobs[j];
+      jobs[j].children++;
+      last = j;
+   }
+
+   return total;
+}
+
+/*
+ * Paths of the same LUN share the job of the first one,
+ * all of them get the list of paths.
+ */
+static void probe_jobs_share_paths (
+   struct probe_job* const jobs, struct probe_job_dev* const jdev,
+   const size_t count, struct arena* const arena
+) {
+   char* lun_paths;
+   size_t len;
+   size_t j;
+   size_t k;
+
+   for ( k = 0; k < count; k++ ) {
+      if ( jdev[k].devnum != 0 && jdev[k].disk_device == NULL ) {
+         jdev[k].wwid = probe_get_wwid ( jdev[k].devnum, arena );
+      }
+   }
+
+   for ( k = 0; k < count; k++ ) {
+      if ( jdev[k].wwid == NULL || jobs[k].parent != NULL ) { continue; }
+
+      len = strlen ( jobs[k].device ) + 1;
+      for ( j = k + 1; j < count; j++ ) {
+         if (
+            jdev[j].wwid != NULL && jobs[j].parent == NULL &&
+            jdev[j].devnum != jdev[k].devnum &&
+            strcmp ( jdev[j].wwid, jdev[k].wwid ) == 0
+         ) {
+            jobs[j].parent = &jobs[k];
+            jobs[k].children++;
+            len += strlen ( jobs[j].device ) + 1;
+         }
+      }
+
+      if ( len == strlen ( jobs[k].device ) + 1 ) { continue; }
+
+      /* "<device> <device>..." */
+      lun_paths = arena_alloc ( arena, len );
+      if ( lun_paths == NULL ) { continue; }
+
+      strcpy ( lun_paths, jobs[k].device );
+      jobs[k].lun_paths = lun_paths;
+      for ( j = k + 1; j < count; j++ ) {
+         if ( jdev[j].wwid != NULL && jobs[j].parent == &jobs[k] ) {
+            strcat ( lun_paths, " " );
+            strcat ( lun_paths, jobs[j].device );
+            jobs[j].lun_paths = lun_paths;
+         }
+      }
+   }
+}
+
+size_t probe_jobs_group (
+   struct probe_job* const jobs, const size_t count, struct arena* const arena
+) {
+   struct probe_job_dev* jdev;
+   struct stat stat_info;
+   size_t total;
+   size_t k;
+
+   jdev = arena_alloc ( arena, 2 * count * sizeof *jdev );
+   if ( jdev == NULL ) { return count; }
+
+   for ( k = 0; k < count; k++ ) {
+      jdev[k] = (struct probe_job_dev) {
+         .devnum = 0, .disk_device = NULL, .wwid = NULL
+      };
+
+      if (
+         stat ( jobs[k].device, &stat_info ) == 0 &&
+         S_ISBLK ( stat_info.st_mode )
+      ) {
+         jdev[k].devnum = stat_info.st_rdev;
+         probe_get_partition_disk ( &stat_info, arena, &jdev[k] );
+      }
+   }
+
+   total = probe_jobs_share_partitions ( jobs, jdev, count );
+   probe_jobs_share_paths ( jobs, jdev, total, arena );
+
+   return total;
+}
+
+void probe_job_share (
+   struct probe_job* const job, const struct probe_ctx* const ctx
+) {
+   const struct probe_job* const parent = job->parent;
+   struct disk_info* node;
+
+   if (
+      parent->status == PROBE_OK && parent->node != NULL &&
+      parent->info != NULL
+   ) {
+      node = arena_alloc ( ctx->arena, sizeof *node );
+      if ( node != NULL ) {
+         *node          = *(parent->node);
+         node->device   = job->device;
+         node->name     = basename ( (char*)job->device );
+         node->var_name = arena_strdup_upper ( ctx->arena, node->name );
+         node->fd       = -1;
+         node->disk_id  = NULL;
+
+         if ( node->var_name != NULL ) {
+            job->node   = node;
+            job->info   = parent->info;
+            job->status = PROBE_OK;
+            return;
+         }
+      }
+   }
+
+   /*
+    * A disk that did not answer will not do so for its partitions. The
+    * other paths of a LUN (lun_paths) may well answer, and get probed
+    * unless the run is out of time (see probe_job_run()).
+    */
+   if ( parent->status == PROBE_ERR_TIMEOUT && job->lun_paths == NULL ) {
+      job->status = PROBE_ERR_TIMEOUT;
+      return;
+   }
+
+   /* the disk or path could not be identified, maybe this one can */
+   probe_job_run ( job, ctx );
+}
+
+
+struct probe_pool {
+   struct probe_job* jobs;
+   size_t            count;
+   size_t            next;
+   probe_job_func    func;
+   void*             data;
+};
+
+static void* probe_worker ( void* const arg ) {
+   struct probe_pool* const pool = arg;
+   size_t k;
+
+   /* each worker claims the next unprocessed job until none are left */
+   for (;;) {
+      k = __sync_fetch_and_add ( &(pool->next), 1 );
+      if ( k >= pool->count ) { break; }
+
+      pool->func ( &(pool->jobs[k]), pool->data );
+   }
+
+   return NULL;
+}
+
+
+/*
+ * Runs worker(arg) in up to thread_count new threads and in the calling
+ * thread, and waits for all of them.
+ * Returns non-zero if threads were requested but none could be created.
+ */
+static int probe_run_workers (
+   void* (*worker) ( void* const arg ), void* const arg,
+   const size_t thread_count
+) {
+   pthread_t* threads;
+   size_t started;
+   size_t k;
+
+   threads = NULL;
+   started = 0;
+
+   if ( thread_count > 0 ) {
+      threads = malloc ( thread_count * sizeof *threads );
+   }
+
+   if ( threads != NULL ) {
+      for ( k = 0; k < thread_count; k++ ) {
+         if ( pthread_create ( &threads[k], NULL, worker, arg ) != 0 ) {
+            break;
+         }
+         started++;
+      }
+   }
+
+   worker ( arg );
+
+   for ( k = 0; k < started; k++ ) {
+      pthread_join ( threads[k], NULL );
+   }
+
+   if ( threads != NULL ) {
+      free ( threads );
+   }
+
+   return ( thread_count > 0 && started == 0 ) ? 1 : 0;
+}
+
+int probe_run (
+   struct probe_job* const jobs, const size_t count,
+   const unsigned int max_workers,
+   probe_job_func func, void* const data
+) {
+   struct probe_pool pool;
+   size_t thread_count;
+
+   pool = (struct probe_pool) {
+      .jobs  = jobs,
+      .count = count,
+      .next  = 0,
+      .func  = func,
+      .data  = data,
+   };
+
+   /* the calling thread is a worker, too */
+   thread_count = ( max_workers < count ) ? max_workers : count;
+   thread_count = ( thread_count > 1 ) ? thread_count - 1 : 0;
+
+   return probe_run_workers ( probe_worker, &pool, thread_count );
+}
+
+
+/*
+ * "/sys/devices/.../host0/port-0:0/expander-0:0/.../target0:0:1/0:0:1:0"
+ * (the device link of a SCSI disk): host 0, expander 0:0
+ */
+static void probe_parse_scsi_path (
+   const char* const path, unsigned int* const host,
+   unsigned int* const expander
+) {
+   const char* p;
+   const char* name;
+   unsigned int hctl[4];
+   unsigned int exp[2];
+
+   name = strrchr ( path, '/' );
+   name = ( name != NULL ) ? name + 1 : path;
+
+   if (
+      sscanf ( name, "%u:%u:%u:%u", &hctl[0], &hctl[1], &hctl[2], &hctl[3] ) == 4
+   ) {
+      *host = hctl[0] + 1;
+   }
+
+   /* the expander closest to the disk */
+   name = NULL;
+   for ( p = path; ( p = strstr ( p, "/expander-" ) ) != NULL; p++ ) {
+      name = p + 10;
+   }
+   if ( name != NULL && sscanf ( name, "%u:%u", &exp[0], &exp[1] ) == 2 ) {
+      *expander = ( ( exp[0] & 0xffff ) << 16 | ( exp[1] & 0xffff ) ) + 1;
+   }
+}
+
+void probe_jobs_locate ( struct probe_job* const jobs, const size_t count ) {
+   struct stat stat_info;
+   char path[SYSFS_PATH_MAX];
+   char real_path[PATH_MAX];
+   size_t k;
+
+   for ( k = 0; k < count; k++ ) {
+      jobs[k].host     = 0;
+      jobs[k].expander = 0;
+
+      /* shared jobs do not send any commands */
+      if (
+         jobs[k].parent == NULL &&
+         stat ( jobs[k].device, &stat_info ) == 0 &&
+         S_ISBLK ( stat_info.st_mode ) &&
+         sysfs_dev_path ( path, sizeof path, &stat_info, "device" ) == 0 &&
+         realpath ( path, real_path ) != NULL
+      ) {
+         probe_parse_scsi_path (
+            real_path, &(jobs[k].host), &(jobs[k].expander)
+         );
+      }
+   }
+}
+
+
+/* the jobs of one SCSI host behind one expander (or none) */
+struct probe_queue {
+   unsigned int  host;
+   unsigned int  expander;
+   /* index of the host's entry in probe_sched.host_busy */
+   size_t        host_slot;
+   /* jobs in flight */
+   unsigned int  busy;
+   /* job indexes, next one at order[head] */
+   size_t*       order;
+   size_t        head;
+   size_t        len;
+};
+
+struct probe_sched {
+   pthread_mutex_t     lock;
+   pthread_cond_t      cond;
+   struct probe_job*   jobs;
+   probe_job_func      func;
+   void*               data;
+   struct probe_queue* queues;
+   size_t              queue_count;
+   /* jobs in flight per host */
+   unsigned int*       host_busy;
+   /* jobs that have not been started yet */
+   size_t              queued;
+   unsigned int        host_jobs;
+   unsigned int        expander_jobs;
+   /* hands out the home queues of the workers */
+   size_t              next_home;
+};
+
+/* whether q has a job that may be started now */
+static inline int probe_queue_ready (
+   const struct probe_sched* const s, const struct probe_queue* const q
+) {
+   if ( q->head >= q->len ) {
+      return 0;
+   } else if ( q->host == 0 ) {
+      /* not a SCSI device, nothing to limit */
+      return 1;
+   } else if (
+      s->host_jobs > 0 && s->host_busy[q->host_slot] >= s->host_jobs
+   ) {
+      return 0;
+   } else if (
+      q->expander != 0 && s->expander_jobs > 0 && q->busy >= s->expander_jobs
+   ) {
+      return 0;
+   }
+   return 1;
+}
+
+static void* probe_sched_worker ( void* const arg ) {
+   struct probe_sched* const s = arg;
+   struct probe_queue* q;
+   size_t home;
+   size_t k;
+   size_t i;
+
+   pthread_mutex_lock ( &(s->lock) );
+   home = s->next_home++ % s->queue_count;
+
+   for (;;) {
+      /* the worker's own queue first, then steal from the others */
+      for ( i = 0; i < s->queue_count; i++ ) {
+         q = &(s->queues[( home + i ) % s->queue_count]);
+         if ( probe_queue_ready ( s, q ) ) { break; }
+      }
+
+      if ( i == s->queue_count ) {
+         if ( s->queued == 0 ) { break; }
+
+         /* every queue with jobs left is at its limit */
+         pthread_cond_wait ( &(s->cond), &(s->lock) );
+         continue;
+      }
+
+      k = q->order[q->head++];
+      s->queued--;
+      q->busy++;
+      s->host_busy[q->host_slot]++;
+      pthread_mutex_unlock ( &(s->lock) );
+
+      s->func ( &(s->jobs[k]), s->data );
+
+      pthread_mutex_lock ( &(s->lock) );
+      q->busy--;
+      s->host_busy[q->host_slot]--;
+      pthread_cond_broadcast ( &(s->cond) );
+   }
+
+   pthread_mutex_unlock ( &(s->lock) );
+   return NULL;
+}
+
+int probe_run_hosts (
+   struct probe_job* const jobs, const size_t count,
+   const struct probe_limits* const limits,
+   probe_job_func func, void* const data
+) {
+   struct probe_sched s;
+   struct probe_queue* q;
+   size_t* order;
+   size_t* fill;
+   size_t host_count;
+   size_t thread_count;
+   size_t k;
+   size_t j;
+   int ret;
+
+   if ( count == 0 ) { return 0; }
+
+   s = (struct probe_sched) {
+      .jobs          = jobs,
+      .func          = func,
+      .data          = data,
+      .queue_count   = 0,
+      .queued        = count,
+      .host_jobs     = limits->host_jobs,
+      .expander_jobs = limits->expander_jobs,
+      .next_home     = 0,
+   };
+
+   /* at most one queue and one host per job */
+   s.queues    = malloc ( count * sizeof *(s.queues) );
+   s.host_busy = calloc ( count, sizeof *(s.host_busy) );
+   order       = malloc ( 2 * count * sizeof *order );
+   if ( s.queues == NULL || s.host_busy == NULL || order == NULL ) {
+      free ( s.queues );
+      free ( s.host_busy );
+      free ( order );
+      return probe_run ( jobs, count, limits->max_workers, func, data );
+   }
+   /* each job's queue, then the write position of each queue */
+   fill = order + count;
+
+   host_count = 0;
+   for ( k = 0; k < count; k++ ) {
+      for (
+         j = 0;
+         j < s.queue_count && (
+            s.queues[j].host != jobs[k].host ||
+            s.queues[j].expander != jobs[k].expander
+         );
+         j++
+      ) { ; }
+
+      if ( j == s.queue_count ) {
+         s.queues[j] = (struct probe_queue) {
+            .host      = jobs[k].host,
+            .expander  = jobs[k].expander,
+            .host_slot = host_count,
+            .len       = 0,
+         };
+         /* queues of the same host share its counter */
+         for ( q = s.queues; q < &(s.queues[j]); q++ ) {
+            if ( q->host == jobs[k].host ) {
+               s.queues[j].host_slot = q->host_slot;
+               break;
+            }
+         }
+         if ( s.queues[j].host_slot == host_count ) { host_count++; }
+         s.queue_count++;
+      }
+
+      s.queues[j].len++;
+      fill[k] = j;
+   }
+
+   /* job indexes of each queue, in the original order */
+   for ( j = 0, k = 0; j < s.queue_count; j++ ) {
+      s.queues[j].order = order + k;
+      s.queues[j].head  = 0;
+      k                += s.queues[j].len;
+      s.queues[j].len   = 0;
+   }
+   for ( k = 0; k < count; k++ ) {
+      q = &(s.queues[fill[k]]);
+      q->order[q->len++] = k;
+   }
+
+   pthread_mutex_init ( &(s.lock), NULL );
+   pthread_cond_init ( &(s.cond), NULL );
+
+   thread_count = ( limits->max_workers < count ) ? limits->max_workers : count;
+   thread_count = ( thread_count > 1 ) ? thread_count - 1 : 0;
+
+   ret = probe_run_workers ( probe_sched_worker, &s, thread_count );
+
+   pthread_cond_destroy ( &(s.cond) );
+   pthread_mutex_destroy ( &(s.lock) );
+   free ( s.queues );
+   free ( s.host_busy );
+   free ( order );
+
+   return ret;
+}
@@ -0,0 +1,220 @@
+/*
+ * probe.h - probe several devices concurrently
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_PROBE_
+#define _DISKID_PROBE_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "disk_type.h"
+#include "ata_id.h"
+#include "nvme_id.h"
+#include "scsi_id.h"
+#include "id_cache.h"
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+union u_specific_device_info {
+   struct ata_disk_info  ata;
+   struct nvme_disk_info nvme;
+   struct scsi_disk_info scsi;
+};
+
+/* state shared by all probes of a run */
+struct probe_ctx {
+   /* enum disk_type mask of the backends to try */
+   unsigned int            disk_types;
+   /* optional, may be NULL */
+   const struct id_cache*  cache;
+   enum id_source          source;
+   /* nodes and infos get allocated from here */
+   struct arena*           arena;
+   /* optional, may be NULL */
+   struct nvme_ctrl_cache* nvme_ctrls;
+   /* optional, may be NULL: what the drivers support */
+   struct disk_caps*       caps;
+   /* device access of the ATA and SCSI backends, NULL: disk_ops_sg */
+   const struct disk_ops*  ops;
+   /*
+    * timeout of a command (0: COMMAND_TIMEOUT_MSEC) and deadline of the
+    * run (util_now_ns() time base, 0: none), see disk_cmd_timeout()
+    */
+   unsigned int            timeout_msec;
+   uint64_t                deadline;
+};
+
+enum probe_status {
+   PROBE_PENDING    = 0,
+   PROBE_OK         = 1,
+   PROBE_ERR_OPEN   = 2,
+   PROBE_ERR_DETECT = 3,
+   /* the device did not answer in time, or the deadline has passed */
+   PROBE_ERR_TIMEOUT = 4,
+};
+
+/*
+ * A probe job holds everything that is needed to print a device's info
+ * after it has been probed, so that probing and printing can be separated
+ * (the output order does not depend on the order in which probes finish).
+ * node and info are allocated from the run's arena.
+ */
+struct probe_job {
+   const char*                   device;
+   struct disk_info*             node;
+   union u_specific_device_info* info;
+   enum probe_status             status;
+   int                           printed;
+   /*
+    * partitions: the job of their disk, whose result they share instead
+    * of being probed themselves (NULL: probed as usual)
+    */
+   struct probe_job*             parent;
+   /* number of partitions and paths sharing the result of this job */
+   unsigned int                  children;
+   /* all paths of a multipath LUN, "<device> <device>...", or NULL */
+   const char*                   lun_paths;
+   /*
+    * SCSI host number + 1 and SAS expander + 1 the device is attached to,
+    * 0 if unknown / none (see probe_jobs_locate())
+    */
+   unsigned int                  host;
+   unsigned int                  expander;
+};
+
+/* settings of probe_run_hosts() */
+struct probe_limits {
+   unsigned int max_workers;
+   /* jobs in flight per SCSI host and per SAS expander, 0: no limit */
+   unsigned int host_jobs;
+   unsigned int expander_jobs;
+};
+
+/* passes the run's settings on to a freshly opened node */
+static inline void probe_ctx_set_node (
+   const struct probe_ctx* const ctx, struct disk_info* const node
+) {
+   node->cache        = ctx->cache;
+   node->source       = ctx->source;
+   node->nvme_ctrls   = ctx->nvme_ctrls;
+   node->caps         = ctx->caps;
+   node->timeout_msec = ctx->timeout_msec;
+   node->deadline     = ctx->deadline;
+}
+
+/*
+ * Opens the job's device and detects its type (one of ctx->disk_types),
+ * the result is stored in the job.
+ * Disk identities are looked up in / stored to ctx->cache (may be NULL)
+ * and read from ctx->source.
+ * Jobs are not started once ctx->deadline has passed, they fail with
+ * PROBE_ERR_TIMEOUT (as do jobs whose device timed out), and job->node
+ * keeps whatever has been read until then.
+ */
+void probe_job_run (
+   struct probe_job* const job, const struct probe_ctx* const ctx
+);
+
+/*
+ * Groups the jobs that refer to the same disk, so that it is probed
+ * only once:
+ *
+ * - partitions in jobs[0..count) are resolved to their disk through
+ *   /sys/dev/block/<major>:<minor>/partition and the parent directory,
+ *   and share the disk's job (job->parent). A disk that is not in
+ *   jobs[0..count) gets a job of its own, appended to jobs and marked
+ *   as printed
+ * - paths of a multipath LUN (disks with the same NAA or EUI-64 wwid
+ *   in sysfs) share the job of the first path, job->lun_paths lists
+ *   all of them
+ *
+ * jobs must have room for 2 * count jobs, temporary data is allocated
+ * from arena. Returns the new number of jobs.
+ */
+size_t probe_jobs_group (
+   struct probe_job* const jobs, const size_t count, struct arena* const arena
+);
+
+/*
+ * Copies the result of the (already probed) job->parent, with a node of
+ * the job's own name. Jobs whose parent could not be identified are
+ * probed with probe_job_run() instead, unless the parent timed out.
+ */
+void probe_job_share (
+   struct probe_job* const job, const struct probe_ctx* const ctx
+);
+
+typedef void (*probe_job_func) (
+   struct probe_job* const job, void* const data
+);
+
+/*
+ * Runs func(job, data) for each job in jobs[0..count),
+ * using up to max_workers threads (including the calling thread).
+ *
+ * Jobs are handed out in order, so that low-index jobs finish first
+ * (more or less). Returns 0 on success, and non-zero if no worker thread
+ * could be created, in which case all jobs have been processed by
+ * the calling thread.
+ */
+int probe_run (
+   struct probe_job* const jobs, const size_t count,
+   const unsigned int max_workers,
+   probe_job_func func, void* const data
+);
+
+/*
+ * Sets host and expander of each job in jobs[0..count) that sends
+ * commands itself, from the host:channel:target:lun path in sysfs.
+ */
+void probe_jobs_locate ( struct probe_job* const jobs, const size_t count );
+
+/*
+ * Same as probe_run(), but the jobs are queued per SCSI host and expander
+ * (job->host, job->expander), and no more than limits->host_jobs /
+ * limits->expander_jobs jobs of a host / an expander run at once.
+ * Each worker takes jobs from a queue of its own (they are spread over
+ * the queues) and steals from the other queues when its queue is empty
+ * or at its limit, so that all adapters are kept busy.
+ * Jobs of a queue are started in their original order.
+ */
+int probe_run_hosts (
+   struct probe_job* const jobs, const size_t count,
+   const struct probe_limits* const limits,
+   probe_job_func func, void* const data
+);
+
+/* closes the job's device, its memory is released with the arena */
+static inline void probe_job_release ( struct probe_job* const job ) {
+   job->info = NULL;
+   if ( job->node != NULL ) {
+      close_disk_info_fd ( job->node );
+      job->node = NULL;
+   }
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,454 @@
+/*
+ * scsi_id.c - reads vendor/model/serial number and WWN from SCSI devices
+ *
+ * The output follows udev's scsi_id program.
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "udev_util.h"
+#include "disk_type.h"
+#include "sysfs.h"
+#include "ata_id.h"
+#include "scsi_id.h"
+
+#define SCSI_ID_VPD_MAX 512
+
+
+/* INQUIRY data as returned by the device (or sysfs) */
+struct scsi_id_pages {
+   unsigned int type;
+   char         vendor[9];
+   char         model[17];
+   char         revision[5];
+   uint8_t      vpd80[SCSI_ID_VPD_MAX];
+   size_t       vpd80_len;
+   uint8_t      vpd83[SCSI_ID_VPD_MAX];
+   size_t       vpd83_len;
+};
+
+
+static void scsi_id_copy_str (
+   char* const dest, const uint8_t* const src, const size_t len
+) {
+   memcpy ( dest, src, len );
+   dest[len] = '\0';
+}
+
+static inline void transfer_id_data (
+   const char* const str, char* const to, size_t len
+) {
+   util_normalize_string ( str, len, to, NULL, 0 );
+}
+
+static size_t scsi_id_vpd_len (
+   const uint8_t* const vpd, const size_t len, const int page
+) {
+   size_t page_len;
+
+   if ( len < 4 || vpd[1] != page ) {
+      return 0;
+   }
+
+   page_len = 4 + (size_t)( (vpd[2] << 8) | vpd[3] );
+   return ( page_len < len ) ? page_len : len;
+}
+
+static int scsi_id_read_sysfs (
+   const struct disk_info* const node, struct scsi_id_pages* const pages
+) {
+   struct stat stat_info;
+   char buf[16];
+   ssize_t ret;
+
+   if (
+      fstat ( node->fd, &stat_info ) != 0 ||
+      sysfs_read_device_attr ( &stat_info, "type", buf, sizeof buf, 0 ) < 1 ||
+      sysfs_read_device_attr (
+         &stat_info, "vendor", pages->vendor, sizeof pages->vendor, 0
+      ) < 0 ||
+      sysfs_read_device_attr (
+         &stat_info, "model", pages->model, sizeof pages->model, 0
+      ) < 0
+   ) {
+      return -1;
+   }
+   pages->type = (unsigned int) strtoul ( buf, NULL, 10 ) & 0x1f;
+
+   if (
+      sysfs_read_device_attr (
+         &stat_info, "rev", pages->revision, sizeof pages->revision, 0
+      ) < 0
+   ) {
+      pages->revision[0] = '\0';
+   }
+
+   /* either of the VPD pages may be missing */
+   ret = sysfs_read_device_attr (
+      &stat_info, "vpd_pg80", pages->vpd80, sizeof pages->vpd80, 1
+   );
+   pages->vpd80_len = ( ret > 0 )
+      ? scsi_id_vpd_len ( pages->vpd80, (size_t)ret, 0x80 ) : 0;
+
+   ret = sysfs_read_device_attr (
+      &stat_info, "vpd_pg83", pages->vpd83, sizeof pages->vpd83, 1
+   );
+   pages->vpd83_len = ( ret > 0 )
+      ? scsi_id_vpd_len ( pages->vpd83, (size_t)ret, 0x83 ) : 0;
+
+   return 0;
+}
+
+static size_t scsi_id_inquiry_vpd (
+   struct disk_info* const node, const int page,
+   uint8_t* const buf, const size_t len
+) {
+   memzero ( buf, len );
+   if ( disk_cmd_inquiry ( node, page, buf, len ) != 0 ) {
+      return 0;
+   }
+   return scsi_id_vpd_len ( buf, len, page );
+}
+
+static int scsi_id_read_ioctl (
+   struct disk_info* const node, struct scsi_id_pages* const pages
+) {
+   /* the ATA backend has usually sent the INQUIRY already */
+   if ( node->inquiry_len == 0 ) {
+      if (
+         disk_cmd_inquiry (
+            node, -1, node->inquiry, sizeof node->inquiry
+         ) != 0
+      ) {
+         return -1;
+      }
+      node->inquiry_len = sizeof node->inquiry;
+   }
+
+   /* SPC-4, section 6.4.2: Standard INQUIRY data */
+   pages->type = node->inquiry[0] & 0x1f;
+   scsi_id_copy_str ( pages->vendor,   node->inquiry +  8,  8 );
+   scsi_id_copy_str ( pages->model,    node->inquiry + 16, 16 );
+   scsi_id_copy_str ( pages->revision, node->inquiry + 32,  4 );
+
+   pages->vpd80_len = scsi_id_inquiry_vpd (
+      node, 0x80, pages->vpd80, sizeof pages->vpd80
+   );
+   pages->vpd83_len = scsi_id_inquiry_vpd (
+      node, 0x83, pages->vpd83, sizeof pages->vpd83
+   );
+
+   return 0;
+}
+
+/*
+ * Ranks a designation descriptor of VPD page 0x83, in the same order as
+ * scsi_id: NAA (IEEE Registered Extended first), EUI-64, T10 vendor ID,
+ * vendor specific. Only descriptors of the logical unit are considered.
+ *
+ * Returns 0 if the descriptor is not usable.
+ */
+static int scsi_id_desc_rank ( const uint8_t* const desc ) {
+   if ( ((desc[1] >> 4) & 0x3) != 0 || desc[3] == 0 ) {
+      return 0;
+   }
+
+   switch ( desc[1] & 0x0f ) {
+      case 0x3:
+         switch ( desc[4] >> 4 ) {
+            case 0x6: return 10;
+            case 0x5: return 9;
+            case 0x2: return 8;
+            case 0x3: return 7;
+            default:  return 0;
+         }
+      case 0x2: return 6;
+      case 0x1: return 5;
+      case 0x0: return 4;
+      default:  return 0;
+   }
+}
+
+static void scsi_id_decode_vpd83 (
+   const struct scsi_id_pages* const pages, struct scsi_disk_info* const pinfo
+) {
+   char id[SCSI_ID_SERIAL_MAX];
+   const uint8_t* best;
+   const uint8_t* desc;
+   size_t dlen;
+   size_t k;
+   char* p;
+   int rank;
+   int best_rank;
+
+   best      = NULL;
+   best_rank = 0;
+
+   /* SPC-4, section 7.8.6: Device Identification VPD page */
+   for ( k = 4; k + 4 <= pages->vpd83_len; k += 4 + dlen ) {
+      desc = pages->vpd83 + k;
+      dlen = desc[3];
+      if ( k + 4 + dlen > pages->vpd83_len ) { break; }
+
+      rank = scsi_id_desc_rank ( desc );
+      if ( rank > best_rank ) {
+         best      = desc;
+         best_rank = rank;
+      }
+   }
+
+   if ( best == NULL ) { return; }
+
+   /* "<designator type><id>", binary ids are hex-encoded */
+   dlen = best[3];
+   p    = id;
+   *p++ = "0123456789abcdef"[best[1] & 0x0f];
+
+   if ( (best[0] & 0x0f) == 0x1 ) {
+      for ( k = 0; k < dlen && (size_t)(p - id) + 3 <= sizeof id; k++ ) {
+         p += sprintf ( p, "%02x", best[4+k] );
+      }
+   } else {
+      for ( k = 0; k < dlen && (size_t)(p - id) + 2 <= sizeof id; k++ ) {
+         *p++ = (char) best[4+k];
+      }
+      *p = '\0';
+   }
+   transfer_id_data ( id, pinfo->serial, sizeof pinfo->serial - 1 );
+
+   /* ID_WWN and ID_WWN_VENDOR_EXTENSION are set for NAA ids only */
+   if ( (best[1] & 0x0f) == 0x3 && (best[0] & 0x0f) == 0x1 ) {
+      if ( dlen >= 8 ) {
+         memcpy ( pinfo->wwn, id + 1, 16 );
+         pinfo->wwn[16] = '\0';
+      }
+      if ( dlen >= 16 ) {
+         memcpy ( pinfo->wwn_vendor_ext, id + 17, 16 );
+         pinfo->wwn_vendor_ext[16] = '\0';
+      }
+   }
+}
+
+static int scsi_id_decode (
+   const struct scsi_id_pages* const pages, struct scsi_disk_info* const pinfo
+) {
+   /* "S" + vendor + model + serial */
+   char id[1 + 8 + 16 + SCSI_ID_SERIAL_MAX];
+   size_t len;
+
+   *pinfo = (struct scsi_disk_info) { .type = pages->type };
+
+   transfer_id_data ( pages->vendor,   pinfo->vendor,   8 );
+   transfer_id_data ( pages->revision, pinfo->revision, 4 );
+   util_normalize_string (
+      pages->model, 16, pinfo->model, pinfo->model_enc, sizeof pinfo->model_enc
+   );
+
+   /* SPC-4, section 7.8.15: Unit Serial Number VPD page */
+   if ( pages->vpd80_len > 4 ) {
+      len = pages->vpd80_len - 4;
+      if ( len >= sizeof pinfo->serial_short ) {
+         len = sizeof pinfo->serial_short - 1;
+      }
+      transfer_id_data (
+         (const char*)(pages->vpd80 + 4), pinfo->serial_short, len
+      );
+   }
+
+   scsi_id_decode_vpd83 ( pages, pinfo );
+
+   if ( pinfo->serial[0] == '\0' && pinfo->serial_short[0] != '\0' ) {
+      /* no usable page 0x83 id, "S<vendor><model><serial>" */
+      snprintf (
+         id, sizeof id, "S%-8.8s%-16.16s%s",
+         pages->vendor, pages->model, pinfo->serial_short
+      );
+      transfer_id_data ( id, pinfo->serial, sizeof pinfo->serial - 1 );
+
+   } else if ( pinfo->serial_short[0] == '\0' && pinfo->serial[0] != '\0' ) {
+      memcpy (
+         pinfo->serial_short, pinfo->serial + 1, sizeof pinfo->serial - 1
+      );
+   }
+
+   return ( pinfo->serial[0] != '\0' ) ? 0 : -1;
+}
+
+
+int is_scsi_disk (
+   struct disk_info* const node,
+   struct scsi_disk_info** const pinfo
+) {
+   struct scsi_id_pages pages;
+   struct scsi_disk_info info;
+   struct scsi_disk_info* my_info;
+   int ret;
+
+   ret = -1;
+   if (
+      node->source != ID_SOURCE_IOCTL &&
+      scsi_id_read_sysfs ( node, &pages ) == 0
+   ) {
+      ret = scsi_id_decode ( &pages, &info );
+   }
+
+   if (
+      ret != 0 && node->source != ID_SOURCE_SYSFS &&
+      scsi_id_read_ioctl ( node, &pages ) == 0
+   ) {
+      ret = scsi_id_decode ( &pages, &info );
+   }
+
+   if ( ret != 0 ) {
+      return 0;
+   }
+
+   my_info = arena_alloc ( node->arena, sizeof *my_info );
+   if ( my_info == NULL ) {
+      return 0;
+   }
+   *my_info = info;
+
+   *pinfo = my_info;
+   return 1;
+}
+
+int scsi_disk_info_get_wwn (
+   const struct scsi_disk_info* const pinfo, char* const buf, const size_t len
+) {
+   int ret;
+
+   if ( pinfo->wwn[0] == '\0' ) {
+      return -1;
+   }
+
+   ret = snprintf ( buf, len, "0x%s%s", pinfo->wwn, pinfo->wwn_vendor_ext );
+   return ( ret > 0 && (size_t)ret < len ) ? 0 : -1;
+}
+
+
+#if !(ENABLE_MINIMAL)
+static const char* scsi_id_type_str ( const unsigned int type ) {
+   switch ( type ) {
+      case 0x00:
+      case 0x0e:
+         return "disk";
+      case 0x01:
+         return "tape";
+      case 0x04:
+      case 0x07:
+      case 0x0f:
+         return "optical";
+      case 0x05:
+         return "cd";
+      default:
+         return "generic";
+   }
+}
+#endif
+
+int print_scsi_id_vars (
+   const struct disk_info* const node,
+   const struct scsi_disk_info* const pinfo,
+   unsigned const int mdev_export,
+   struct out_buf* const out
+) {
+   char wwn[40];
+
+#if !(ENABLE_MINIMAL)
+   /* --export: --mdev variables and some more */
+   if ( mdev_export == 0 ) {
+      out_var_str ( out, "ID_SCSI", "1" );
+      out_var_str ( out, "ID_VENDOR", pinfo->vendor );
+      out_var_str ( out, "ID_MODEL", pinfo->model );
+      out_var_str ( out, "ID_MODEL_ENC", pinfo->model_enc );
+      out_var_str ( out, "ID_REVISION", pinfo->revision );
+      out_var_str ( out, "ID_TYPE", scsi_id_type_str ( pinfo->type ) );
+      out_var_str ( out, "ID_SERIAL_SHORT", pinfo->serial_short );
+      if (
+         pinfo->wwn[0] != '\0' && out_var_begin ( out, "ID_WWN" )
+      ) {
+         out_val_puts ( out, "0x" );
+         out_val_puts ( out, pinfo->wwn );
+         out_var_end  ( out );
+      }
+      if (
+         pinfo->wwn_vendor_ext[0] != '\0' &&
+         out_var_begin ( out, "ID_WWN_VENDOR_EXTENSION" )
+      ) {
+         out_val_puts ( out, "0x" );
+         out_val_puts ( out, pinfo->wwn_vendor_ext );
+         out_var_end  ( out );
+      }
+   }
+#endif
+
+   out_var_str ( out, "ID_BUS", "scsi" );
+   out_var_str ( out, "ID_SERIAL", pinfo->serial );
+   if ( scsi_disk_info_get_wwn ( pinfo, wwn, sizeof wwn ) == 0 ) {
+      out_var_str ( out, "ID_WWN_WITH_EXTENSION", wwn );
+   }
+   return 0;
+}
+
+#if !(ENABLE_MINIMAL)
+int print_scsi_inquiry_vars (
+   const struct disk_info* const node, struct out_buf* const out
+) {
+   char vendor[9];
+   char model[17];
+   char model_enc[256];
+   char revision[5];
+
+   if ( node->inquiry_len == 0 ) {
+      return -1;
+   }
+
+   /* SPC-4, section 6.4.2: Standard INQUIRY data */
+   transfer_id_data ( (const char*)(node->inquiry +  8), vendor,   8 );
+   transfer_id_data ( (const char*)(node->inquiry + 32), revision, 4 );
+   util_normalize_string (
+      (const char*)(node->inquiry + 16), 16, model, model_enc, sizeof model_enc
+   );
+
+   out_var_str ( out, "ID_VENDOR", vendor );
+   out_var_str ( out, "ID_MODEL", model );
+   out_var_str ( out, "ID_MODEL_ENC", model_enc );
+   out_var_str ( out, "ID_REVISION", revision );
+   out_var_str ( out, "ID_TYPE", scsi_id_type_str ( node->inquiry[0] & 0x1f ) );
+   return 0;
+}
+#endif
+
+void scsi_id_get_record (
+   const struct scsi_disk_info* const pinfo, struct out_record* const rec
+) {
+   rec->type     = DISK_TYPE_SCSI;
+   rec->flags    = 0;
+   rec->model    = pinfo->model;
+   rec->serial   = pinfo->serial_short;
+   rec->revision = pinfo->revision;
+   if ( scsi_disk_info_get_wwn ( pinfo, rec->wwn, sizeof rec->wwn ) != 0 ) {
+      rec->wwn[0] = '\0';
+   }
+}
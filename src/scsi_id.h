@@ -0,0 +1,103 @@
+/*
+ * scsi_id.h - reads vendor/model/serial number and WWN from SCSI devices
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_SCSI_ID_
+#define _DISKID_SCSI_ID_
+
+#include <stdint.h>
+
+#include "disk_type.h"
+#include "out_buf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCSI_ID_SERIAL_MAX 256
+
+struct scsi_disk_info {
+   /* peripheral device type */
+   unsigned int type;
+   char         vendor[9];
+   char         model[17];
+   char         model_enc[256];
+   char         revision[5];
+   /* ID_SERIAL, from VPD page 0x83 (or 0x80) */
+   char         serial[SCSI_ID_SERIAL_MAX];
+   /* ID_SERIAL_SHORT, from VPD page 0x80 */
+   char         serial_short[SCSI_ID_SERIAL_MAX];
+   /* NAA designator as hex digits, empty if not available */
+   char         wwn[17];
+   char         wwn_vendor_ext[17];
+};
+
+/*
+ * Identifies a SCSI device with the standard INQUIRY data and
+ * VPD pages 0x80 (unit serial number) and 0x83 (device identification),
+ * read from sysfs or requested with SG_IO, depending on node->source.
+ *
+ * The standard INQUIRY data of a previous backend (node->inquiry)
+ * is reused.
+ *
+ * Returns 1 if the device reports a serial number (*pinfo is allocated
+ * from node->arena), else 0.
+ */
+int is_scsi_disk (
+   struct disk_info* const node,
+   struct scsi_disk_info** const pinfo
+);
+
+int print_scsi_id_vars (
+   const struct disk_info* const node,
+   const struct scsi_disk_info* const pinfo,
+   unsigned const int mdev_export,
+   struct out_buf* const out
+);
+
+/*
+ * --export variables of the standard INQUIRY data in node->inquiry,
+ * for devices that timed out before they could be identified.
+ * Returns -1 if there is no INQUIRY data. Not available with ENABLE_MINIMAL.
+ */
+int print_scsi_inquiry_vars (
+   const struct disk_info* const node, struct out_buf* const out
+);
+
+/* ID_WWN_WITH_EXTENSION, returns 0 if the device has a WWN */
+int scsi_disk_info_get_wwn (
+   const struct scsi_disk_info* const pinfo, char* const buf, const size_t len
+);
+
+/* fills a --format=bin record, except for its device */
+void scsi_id_get_record (
+   const struct scsi_disk_info* const pinfo, struct out_record* const rec
+);
+
+static inline int set_scsi_id (
+   struct disk_info* const node, const struct scsi_disk_info* const pinfo
+) {
+   return (pinfo == NULL) ? -1 : set_disk_id (node, pinfo->serial, NULL);
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
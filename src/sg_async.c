@@ -0,0 +1,438 @@
+/*
+ * sg_async.c - probe SCSI generic (/dev/sg*) nodes without blocking
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <scsi/sg.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/hdreg.h>
+
+#include "util.h"
+#include "udev_util.h"
+#include "disk_type.h"
+#include "ata_id.h"
+#include "ata_sysfs.h"
+#include "probe.h"
+#include "sg_async.h"
+
+/* from linux/major.h */
+#define SG_ASYNC_SCSI_GENERIC_MAJOR 21
+
+/* host byte / driver byte of a command that timed out, from scsi/scsi.h */
+#define SG_ASYNC_DID_TIME_OUT   0x03
+#define SG_ASYNC_DRIVER_TIMEOUT 0x06
+
+
+enum sg_async_state {
+   SG_ASYNC_IDLE = 0,
+   SG_ASYNC_INQUIRY,
+   SG_ASYNC_IDENTIFY,
+   SG_ASYNC_IDENTIFY_PACKET,
+};
+
+/*
+ * per-device state,
+ * the buffers must stay valid while a command is in flight
+ */
+struct sg_async_dev {
+   struct probe_job*     job;
+   struct ata_disk_info* info;
+   enum sg_async_state   state;
+   uint8_t               cdb[16];
+   uint8_t               sense[32];
+   uint8_t               inquiry[36];
+};
+
+
+static int sg_async_is_sg_node ( const int fd ) {
+   struct stat stat_info;
+
+   if ( fstat ( fd, &stat_info ) != 0 ) {
+      return 0;
+   }
+
+   return (
+      S_ISCHR ( stat_info.st_mode ) &&
+      major ( stat_info.st_rdev ) == SG_ASYNC_SCSI_GENERIC_MAJOR
+   ) ? 1 : 0;
+}
+
+/*
+ * Commands are not retried here, each one gets the node's whole timeout
+ * (cut short by the deadline).
+ */
+static int sg_async_submit (
+   struct sg_async_dev* const dev, const enum ata_id_command cmd
+) {
+   const unsigned int timeout = disk_cmd_timeout (
+      dev->job->node, DISK_CMD_ONLY
+   );
+   struct sg_io_hdr io_hdr;
+   uint8_t* buf;
+   size_t buf_len;
+   size_t cdb_len;
+   ssize_t ret;
+
+   if ( timeout == 0 ) {
+      dev->job->node->timed_out = 1;
+      errno = ETIMEDOUT;
+      return -1;
+   }
+
+   if ( cmd == ATA_ID_CMD_INQUIRY ) {
+      buf     = dev->inquiry;
+      buf_len = sizeof dev->inquiry;
+      dev->state = SG_ASYNC_INQUIRY;
+   } else {
+      buf     = dev->info->identify;
+      buf_len = sizeof dev->info->identify;
+      dev->state = ( cmd == ATA_ID_CMD_IDENTIFY_PACKET )
+         ? SG_ASYNC_IDENTIFY_PACKET : SG_ASYNC_IDENTIFY;
+   }
+
+   memzero ( buf, buf_len );
+   memzero ( dev->sense, sizeof dev->sense );
+   cdb_len = ata_id_init_cdb ( cmd, dev->cdb, buf_len );
+
+   io_hdr = (struct sg_io_hdr) {
+      .interface_id    = 'S',
+      .cmdp            = dev->cdb,
+      .cmd_len         = cdb_len,
+      .dxferp          = buf,
+      .dxfer_len       = buf_len,
+      .sbp             = dev->sense,
+      .mx_sb_len       = sizeof dev->sense,
+      .dxfer_direction = SG_DXFER_FROM_DEV,
+      .timeout         = timeout,
+      .usr_ptr         = dev,
+   };
+
+   do {
+      ret = write ( dev->job->node->fd, &io_hdr, sizeof io_hdr );
+   } while ( ret < 0 && errno == EINTR );
+
+   return ( ret == (ssize_t)(sizeof io_hdr) ) ? 0 : -1;
+}
+
+static void sg_async_release ( struct sg_async_dev* const dev ) {
+   dev->state = SG_ASYNC_IDLE;
+   dev->info  = NULL;
+
+   if ( dev->job->node != NULL ) {
+      close_disk_info_fd ( dev->job->node );
+      dev->job->node = NULL;
+   }
+}
+
+/*
+ * Opens the job's device and submits the first command.
+ *
+ * Returns 0 if a command is in flight, 1 if the disk info has been
+ * found in the cache or in sysfs and -1 if the job cannot be handled here.
+ */
+static int sg_async_start (
+   struct sg_async_dev* const dev, struct probe_job* const job,
+   const struct probe_ctx* const ctx
+) {
+   const struct id_cache* const cache = ctx->cache;
+   const enum id_source source        = ctx->source;
+   struct arena* const arena          = ctx->arena;
+
+   *dev = (struct sg_async_dev) { .job = job, .state = SG_ASYNC_IDLE };
+
+   /*
+    * the sg driver needs write access for submitting commands,
+    * which are written to the device directly (not through disk_ops)
+    */
+   job->node = init_disk_info_flags (
+      job->device, O_RDWR|O_NONBLOCK, arena, &disk_ops_sg
+   );
+   if ( job->node == NULL ) {
+      return -1;
+   }
+   probe_ctx_set_node ( ctx, job->node );
+
+   if ( sg_async_is_sg_node ( job->node->fd ) ) {
+      dev->info = arena_alloc ( arena, sizeof *(dev->info) );
+
+      if ( dev->info != NULL ) {
+         *(dev->info) = (struct ata_disk_info){ .is_packet_device = 0 };
+
+         if ( id_cache_lookup ( cache, job->node->fd, dev->info ) == 0 ) {
+            return 1;
+
+         } else if ( ata_sysfs_probe ( job->node, dev->info ) == 0 ) {
+            return 1;
+
+         } else if ( source == ID_SOURCE_SYSFS ) {
+            /* left pending, is_ata_disk() reports the failure */
+
+         } else if ( sg_async_submit ( dev, ATA_ID_CMD_INQUIRY ) == 0 ) {
+            return 0;
+         }
+      }
+   }
+
+   sg_async_release ( dev );
+   return -1;
+}
+
+/*
+ * Processes the result of dev's current command and submits the next one.
+ *
+ * Returns 1 if more commands are in flight, 0 if dev has been probed
+ * successfully and -1 if not.
+ */
+static int sg_async_advance ( struct sg_async_dev* const dev ) {
+   struct sg_io_hdr io_hdr;
+   struct ata_disk_info* const pinfo = dev->info;
+   const int fd = dev->job->node->fd;
+   ssize_t ret;
+   int peripheral_device_type;
+
+   io_hdr = (struct sg_io_hdr) { .interface_id = 'S', .pack_id = -1 };
+
+   do {
+      ret = read ( fd, &io_hdr, sizeof io_hdr );
+   } while ( ret < 0 && errno == EINTR );
+
+   if ( ret < 0 && errno == EAGAIN ) {
+      return 1;
+
+   } else if ( ret != (ssize_t)(sizeof io_hdr) ) {
+      return -1;
+   }
+
+   /* not worth another command, not even HDIO_GET_IDENTITY */
+   if (
+      io_hdr.host_status == SG_ASYNC_DID_TIME_OUT ||
+      ( io_hdr.driver_status & 0x0f ) == SG_ASYNC_DRIVER_TIMEOUT
+   ) {
+      dev->state = SG_ASYNC_IDLE;
+      dev->job->node->timed_out = 1;
+      return -1;
+   }
+
+   switch ( dev->state ) {
+      case SG_ASYNC_INQUIRY:
+         if ( !(
+            io_hdr.status        == 0 &&
+            io_hdr.host_status   == 0 &&
+            io_hdr.driver_status == 0
+         ) ) {
+            break;
+         }
+
+         /* SPC-4, section 6.4.2: Standard INQUIRY data */
+         peripheral_device_type = dev->inquiry[0] & 0x1f;
+         if ( peripheral_device_type == 0x05 ) {
+            pinfo->is_packet_device = 1;
+            return (
+               sg_async_submit ( dev, ATA_ID_CMD_IDENTIFY_PACKET ) == 0
+            ) ? 1 : -1;
+
+         } else if ( peripheral_device_type == 0x00 ) {
+            return (
+               sg_async_submit ( dev, ATA_ID_CMD_IDENTIFY ) == 0
+            ) ? 1 : -1;
+         }
+         break;
+
+      case SG_ASYNC_IDENTIFY:
+      case SG_ASYNC_IDENTIFY_PACKET:
+         if (
+            ata_id_sense_ok ( dev->sense ) &&
+            !ata_identify_is_empty ( pinfo->identify )
+         ) {
+            dev->state = SG_ASYNC_IDLE;
+            ata_disk_info_fixup_identify ( pinfo );
+            ata_disk_info_set_strings ( pinfo );
+            id_cache_store ( dev->job->node->cache, fd, pinfo );
+            return 0;
+         }
+         break;
+
+      default:
+         return -1;
+   }
+
+   /* same as is_ata_disk(): if this fails, then try HDIO_GET_IDENTITY */
+   dev->state = SG_ASYNC_IDLE;
+   memzero ( pinfo->identify, sizeof pinfo->identify );
+   if ( ioctl ( fd, HDIO_GET_IDENTITY, &(pinfo->id) ) == 0 ) {
+      ata_disk_info_set_strings ( pinfo );
+      id_cache_store ( dev->job->node->cache, fd, pinfo );
+      return 0;
+   }
+
+   return -1;
+}
+
+static void sg_async_finish (
+   struct sg_async_dev* const dev, const int ret,
+   sg_async_done_func done, void* const data
+) {
+   struct probe_job* const job = dev->job;
+
+   if ( ret == 0 ) {
+      /* the fd is not needed anymore, free it up for other devices */
+      close_disk_info_fd ( job->node );
+      set_disk_type_ata ( job->node );
+      job->info   = (union u_specific_device_info*) dev->info;
+      job->status = PROBE_OK;
+      dev->info   = NULL;
+      dev->state  = SG_ASYNC_IDLE;
+
+      if ( done != NULL ) {
+         done ( job, data );
+      }
+
+   } else {
+      /* keep the node, so that the error can be reported */
+      close_disk_info_fd ( job->node );
+      set_disk_type_none ( job->node );
+      job->status = ( job->node->timed_out )
+         ? PROBE_ERR_TIMEOUT : PROBE_ERR_DETECT;
+      dev->info   = NULL;
+      dev->state  = SG_ASYNC_IDLE;
+   }
+}
+
+
+/* milliseconds until ctx->deadline for poll(), -1: no deadline */
+static int sg_async_poll_timeout ( const struct probe_ctx* const ctx ) {
+   uint64_t now;
+   uint64_t left;
+
+   if ( ctx->deadline == 0 ) {
+      return -1;
+   }
+
+   now = util_now_ns();
+   if ( now >= ctx->deadline ) {
+      return 0;
+   }
+
+   /* rounded up, poll() would wake up just before the deadline otherwise */
+   left = ( ctx->deadline - now + 999999 ) / 1000000;
+   return ( left > INT_MAX ) ? INT_MAX : (int)left;
+}
+
+
+size_t sg_async_run (
+   struct probe_job* const jobs, const size_t count,
+   const struct probe_ctx* const ctx,
+   sg_async_done_func done, void* const data
+) {
+   struct sg_async_dev* devs;
+   struct pollfd* pfds;
+   size_t in_flight;
+   size_t probed;
+   size_t k;
+   int ret;
+
+   devs  = arena_alloc ( ctx->arena, count * sizeof *devs );
+   pfds  = arena_alloc ( ctx->arena, count * sizeof *pfds );
+   in_flight = 0;
+   probed    = 0;
+
+   if ( devs == NULL || pfds == NULL ) {
+      return 0;
+   }
+
+   for ( k = 0; k < count; k++ ) {
+      pfds[k] = (struct pollfd) { .fd = -1, .events = POLLIN };
+
+      /* partitions share the result of their disk */
+      if ( jobs[k].status != PROBE_PENDING || jobs[k].parent != NULL ) {
+         continue;
+      }
+
+      switch ( sg_async_start ( &devs[k], &jobs[k], ctx ) ) {
+         case 0:
+            pfds[k].fd = jobs[k].node->fd;
+            in_flight++;
+            break;
+
+         case 1:
+            sg_async_finish ( &devs[k], 0, done, data );
+            probed++;
+            break;
+
+         default:
+            break;
+      }
+   }
+
+   while ( in_flight > 0 ) {
+      ret = poll ( pfds, count, sg_async_poll_timeout ( ctx ) );
+      if ( ret < 0 ) {
+         if ( errno == EINTR ) { continue; }
+
+         /* should not happen - let the blocking path handle the rest */
+         for ( k = 0; k < count; k++ ) {
+            if ( pfds[k].fd >= 0 ) {
+               sg_async_release ( &devs[k] );
+               pfds[k].fd = -1;
+            }
+         }
+         break;
+
+      } else if ( ret == 0 ) {
+         /*
+          * out of time, the devices still in flight have failed
+          * (the sg driver drops the commands' results when the fd is closed)
+          */
+         for ( k = 0; k < count; k++ ) {
+            if ( pfds[k].fd >= 0 ) {
+               jobs[k].node->timed_out = 1;
+               sg_async_finish ( &devs[k], -1, done, data );
+               pfds[k].fd = -1;
+               probed++;
+            }
+         }
+         break;
+      }
+
+      for ( k = 0; k < count; k++ ) {
+         if ( pfds[k].fd < 0 || pfds[k].revents == 0 ) {
+            continue;
+         }
+
+         ret = ( pfds[k].revents & POLLIN ) ? sg_async_advance ( &devs[k] ) : -1;
+         if ( ret <= 0 ) {
+            sg_async_finish ( &devs[k], ret, done, data );
+            pfds[k].fd = -1;
+            in_flight--;
+            probed++;
+         }
+      }
+   }
+
+   return probed;
+}
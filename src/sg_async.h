@@ -0,0 +1,69 @@
+/*
+ * sg_async.h - probe SCSI generic (/dev/sg*) nodes without blocking
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_SG_ASYNC_
+#define _DISKID_SG_ASYNC_
+
+#include <stdlib.h>
+
+#include "probe.h"
+#include "id_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*sg_async_done_func) (
+   struct probe_job* const job, void* const data
+);
+
+/*
+ * Probes all pending jobs whose device is a sg node by means of the
+ * sg driver's asynchronous write()/read() interface, keeping one command
+ * per device in flight:
+ *
+ *   INQUIRY -> IDENTIFY [PACKET] DEVICE -> decode
+ *
+ * done(job, data) gets called as soon as a job has been probed
+ * (may be NULL).
+ *
+ * Jobs that cannot be handled here (not a sg node, open() or write()
+ * failed, ...) are left in PROBE_PENDING state, so that they can be
+ * probed with is_ata_disk() afterwards. Jobs still in flight when
+ * ctx->deadline passes fail with PROBE_ERR_TIMEOUT.
+ *
+ * Disk identities are looked up in / stored to ctx->cache (may be NULL).
+ * Unless ctx->source is ID_SOURCE_IOCTL, sysfs is tried before sending
+ * any command. Nodes, disk infos and the per-run state are allocated
+ * from ctx->arena.
+ *
+ * Returns the number of jobs that have been probed.
+ */
+size_t sg_async_run (
+   struct probe_job* const jobs, const size_t count,
+   const struct probe_ctx* const ctx,
+   sg_async_done_func done, void* const data
+);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
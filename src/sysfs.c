@@ -0,0 +1,135 @@
+/*
+ * sysfs.c - read device attributes from /sys
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "sysfs.h"
+
+
+int sysfs_dev_path (
+   char* const buf, const size_t buf_len,
+   const struct stat* const stat_info, const char* const attr
+) {
+   const char* dev_kind;
+   int ret;
+
+   if ( S_ISBLK ( stat_info->st_mode ) ) {
+      dev_kind = "block";
+   } else if ( S_ISCHR ( stat_info->st_mode ) ) {
+      dev_kind = "char";
+   } else {
+      return -1;
+   }
+
+   ret = snprintf (
+      buf, buf_len, "/sys/dev/%s/%u:%u%s%s", dev_kind,
+      major ( stat_info->st_rdev ), minor ( stat_info->st_rdev ),
+      ( attr == NULL ? "" : "/" ), ( attr == NULL ? "" : attr )
+   );
+
+   return ( ret > 0 && (size_t)ret < buf_len ) ? 0 : -1;
+}
+
+ssize_t sysfs_read_file (
+   const char* const path, void* const buf, const size_t buf_len
+) {
+   int fd;
+   ssize_t ret;
+
+   fd = open ( path, O_RDONLY|O_CLOEXEC );
+   if ( fd < 0 ) { return -1; }
+
+   do {
+      ret = read ( fd, buf, buf_len );
+   } while ( ret < 0 && errno == EINTR );
+   close ( fd );
+
+   return ret;
+}
+
+ssize_t sysfs_read_attr (
+   const char* const path, char* const buf, const size_t buf_len
+) {
+   ssize_t ret;
+
+   if ( buf_len < 1 ) { return -1; }
+
+   ret = sysfs_read_file ( path, buf, buf_len - 1 );
+   if ( ret < 0 ) { return -1; }
+
+   while ( ret > 0 && isspace ( (unsigned char)buf[ret-1] ) ) {
+      ret--;
+   }
+   buf[ret] = '\0';
+
+   return ret;
+}
+
+ssize_t sysfs_read_device_attr (
+   const struct stat* const stat_info, const char* const attr,
+   void* const buf, const size_t buf_len, const int raw
+) {
+   static const char* const device_dirs[] = { "device", "../device", NULL };
+   char attr_rel[64];
+   char path[SYSFS_PATH_MAX];
+   ssize_t ret;
+   size_t k;
+
+   ret = -1;
+   for ( k = 0; ret < 0 && device_dirs[k] != NULL; k++ ) {
+      snprintf ( attr_rel, sizeof attr_rel, "%s/%s", device_dirs[k], attr );
+
+      if ( sysfs_dev_path ( path, sizeof path, stat_info, attr_rel ) == 0 ) {
+         ret = ( raw )
+            ? sysfs_read_file ( path, buf, buf_len )
+            : sysfs_read_attr ( path, (char*)buf, buf_len );
+      }
+   }
+
+   return ret;
+}
+
+int sysfs_read_uint64 ( const char* const path, uint64_t* const value ) {
+   char buf[32];
+   char* endptr;
+   unsigned long long int ret;
+
+   if ( sysfs_read_attr ( path, buf, sizeof buf ) < 1 ) {
+      return -1;
+   }
+
+   errno = 0;
+   ret   = strtoull ( buf, &endptr, 10 );
+   if ( errno != 0 || *endptr != '\0' ) {
+      return -1;
+   }
+
+   *value = (uint64_t)ret;
+   return 0;
+}
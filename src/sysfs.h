@@ -0,0 +1,83 @@
+/*
+ * sysfs.h - read device attributes from /sys
+ *
+ * Copyright (C) 2013 Andre Erdmann <dywi@mailerd.de>
+ *
+ * diskid is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _DISKID_SYSFS_
+#define _DISKID_SYSFS_
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYSFS_PATH_MAX 256
+
+/*
+ * Writes the sysfs path of a device node's attribute to buf,
+ * e.g. "/sys/dev/block/8:0/<attr>" (attr may be NULL).
+ *
+ * Returns 0 on success, else non-zero.
+ */
+int sysfs_dev_path (
+   char* const buf, const size_t buf_len,
+   const struct stat* const stat_info, const char* const attr
+);
+
+/*
+ * Reads a binary sysfs attribute file (e.g. vpd_pg83) into buf.
+ *
+ * Returns the number of bytes read, else -1.
+ */
+ssize_t sysfs_read_file (
+   const char* const path, void* const buf, const size_t buf_len
+);
+
+/*
+ * Reads a sysfs attribute file into buf (at most buf_len - 1 chars),
+ * strips trailing whitespace and terminates the string.
+ *
+ * Returns the length of the string on success, else -1.
+ */
+ssize_t sysfs_read_attr (
+   const char* const path, char* const buf, const size_t buf_len
+);
+
+/*
+ * Reads an attribute of a device node's parent device, e.g. the
+ * scsi_device of a disk, partition or sg node:
+ * ".../device/<attr>", or ".../../device/<attr>" for partitions.
+ * raw: see sysfs_read_file(), else sysfs_read_attr().
+ */
+ssize_t sysfs_read_device_attr (
+   const struct stat* const stat_info, const char* const attr,
+   void* const buf, const size_t buf_len, const int raw
+);
+
+/* Reads a sysfs attribute and converts it to an unsigned integer. */
+int sysfs_read_uint64 ( const char* const path, uint64_t* const value );
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -64,29 +64,90 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+/*
+ * UDEV_UTIL_SCALAR builds the char-by-char code only, with the public
+ * functions renamed to scalar_*. It is the reference diskid_bench_strings
+ * checks the run-at-a-time code against.
+ */
+#if defined(UDEV_UTIL_SCALAR)
+#define util_replace_whitespace scalar_util_replace_whitespace
+#define util_replace_chars      scalar_util_replace_chars
+#define encode_devnode_name     scalar_encode_devnode_name
+#define util_normalize_string   scalar_util_normalize_string
+#endif
+
 #include "udev_util.h"
 #include "util.h"
 
 
-static inline int char_in_range (
-   const char c, const char low, const char high
-) {
-   return ( c >= low && c <= high ) ? 0 : 1;
-}
+/* whitelisted_char_for_devnode ( c, NULL ), indexed by (unsigned char) c */
+static const uint8_t devnode_whitelist[256] = {
+   ['0' ... '9'] = 1, ['A' ... 'Z'] = 1, ['a' ... 'z'] = 1,
+   ['#'] = 1, ['+'] = 1, ['-'] = 1, ['.'] = 1, [':'] = 1, ['='] = 1,
+   ['@'] = 1, ['_'] = 1,
+};
 
 /* from src/shared/device-nodes.c */
 static inline int whitelisted_char_for_devnode (
    const char c, const char* const white
 ) {
    return (
-      char_in_range ( c, '0', '9' ) ||
-      char_in_range ( c, 'A', 'Z' ) ||
-      char_in_range ( c, 'a', 'z' ) ||
-      strchr("#+-.:=@_", c) ||
+      devnode_whitelist[(unsigned char)c] ||
       ( white != NULL && strchr(white, c) != NULL )
    ) ? 1 : 0;
 }
 
+/*
+ * Returns the number of whitelisted chars at the start of str[0..len).
+ * Such chars are plain ASCII and neither whitespace nor '\0'.
+ *
+ * Runs shorter than two chars are left to the callers' char-by-char
+ * loops (0), a run of one costs more than it saves there.
+ */
+static inline size_t devnode_whitelist_span (
+   const char* const str, const size_t len
+) {
+#if defined(UDEV_UTIL_SCALAR)
+   /* the callers' char-by-char loops do all the work */
+   return 0;
+#else
+   size_t i;
+
+   if (
+      len < 2 ||
+      !devnode_whitelist[(unsigned char)str[0]] ||
+      !devnode_whitelist[(unsigned char)str[1]]
+   ) {
+      return 0;
+   }
+
+   i = 2;
+   while ( i < len && devnode_whitelist[(unsigned char)str[i]] ) {
+      i++;
+   }
+   return i;
+#endif
+}
+
+/* the same for runs of ' ', e.g. the padding of ATA strings */
+static inline size_t space_span ( const char* const str, const size_t len ) {
+#if defined(UDEV_UTIL_SCALAR)
+   return 0;
+#else
+   size_t i;
+
+   if ( len < 2 || str[0] != ' ' || str[1] != ' ' ) {
+      return 0;
+   }
+
+   i = 2;
+   while ( i < len && str[i] == ' ' ) {
+      i++;
+   }
+   return i;
+#endif
+}
+
 /* from src/shared/utf8.c */
 static inline int is_unicode_valid(const uint32_t ch) {
 
@@ -178,6 +239,11 @@ static int utf8_encoded_to_unichar(const char* const str) {
         return unichar;
 }
 
+/* isspace() in the C locale, for chars that may be negative */
+static inline int is_space_char ( const char c ) {
+   return ( c == ' ' || ( c >= '\t' && c <= '\r' ) ) ? 1 : 0;
+}
+
 /* from src/shared/utf8.c */
 /* validate one encoded unicode char and return its length */
 static int utf8_encoded_valid_unichar(const char* const str) {
@@ -246,12 +312,19 @@ int util_replace_whitespace (
 /* from src/libudev/libudev.c */
 /* allow chars in whitelist, plain ascii, hex-escaping and valid utf8 */
 int util_replace_chars ( char* const str, const char* const white ) {
+        /* chars are only ever replaced by non-NUL chars */
+        const size_t str_len = strlen(str);
         size_t i = 0;
         int replaced = 0;
 
         while (str[i] != '\0') {
                 int len;
 
+                /* skip plain ascii quickly, the loop handles the rest */
+                i += devnode_whitelist_span(&str[i], str_len - i);
+                if (str[i] == '\0')
+                        break;
+
                 if (whitelisted_char_for_devnode(str[i], white)) {
                         i++;
                         continue;
@@ -290,14 +363,27 @@ int util_replace_chars ( char* const str, const char* const white ) {
 int encode_devnode_name (
    const char* const str, char* const str_enc, const size_t len
 ) {
-        size_t i, j;
+        size_t i, j, span, str_len;
 
         if (str == NULL || str_enc == NULL)
                 return -1;
 
+        str_len = strlen(str);
         for (i = 0, j = 0; str[i] != '\0'; i++) {
                 int seqlen;
 
+                /* copy plain ascii quickly, the loop handles the rest */
+                span = devnode_whitelist_span(&str[i], str_len - i);
+                if (span > 0) {
+                        if (len-j < span)
+                                goto err;
+                        memcpy(&str_enc[j], &str[i], span);
+                        j += span;
+                        i += span;
+                        if (str[i] == '\0')
+                                break;
+                }
+
                 seqlen = utf8_encoded_valid_unichar(&str[i]);
                 if (seqlen > 1) {
                         if (len-j < (size_t)seqlen)
@@ -325,4 +411,180 @@ err:
         return -1;
 }
 
+/* encode_devnode_name() for n spaces */
+static inline int encode_devnode_spaces (
+   size_t n, char* const enc, const size_t enc_len, size_t* const e
+) {
+   static const char spaces_enc[] =
+      "\\x20\\x20\\x20\\x20\\x20\\x20\\x20\\x20"
+      "\\x20\\x20\\x20\\x20\\x20\\x20\\x20\\x20";
+   size_t k;
+
+   if ( enc_len - *e < 4 * n ) { return -1; }
+
+   while ( n > 0 ) {
+      k = ( n < 16 ) ? n : 16;
+      memcpy ( &enc[*e], spaces_enc, 4 * k );
+      *e += 4 * k;
+      n  -= k;
+   }
+   return 0;
+}
+
+/* encode_devnode_name() for a single-byte char */
+static inline int encode_devnode_char (
+   const char c, char* const enc, const size_t enc_len, size_t* const e
+) {
+   static const char hex[] = "0123456789abcdef";
+
+   if ( c == '\\' || !whitelisted_char_for_devnode ( c, NULL ) ) {
+      if ( enc_len - *e < 4 ) { return -1; }
+      enc[(*e)++] = '\\';
+      enc[(*e)++] = 'x';
+      enc[(*e)++] = hex[(unsigned char)c >> 4];
+      enc[(*e)++] = hex[(unsigned char)c & 0xf];
+
+   } else {
+      if ( enc_len - *e < 1 ) { return -1; }
+      enc[(*e)++] = c;
+   }
+
+   return 0;
+}
+
+/*
+ * Not from systemd: util_replace_whitespace(), util_replace_chars(to, NULL)
+ * and encode_devnode_name() in one pass.
+ *
+ * Whitespace is only written (as '_') once the next non-whitespace char
+ * shows up, which strips leading/trailing whitespace without looking ahead.
+ * A multibyte char can neither contain whitespace nor cross len, so the
+ * UTF-8 checks give the same results as on the trimmed/collapsed string.
+ */
+int util_normalize_string (
+   const char* const str, const size_t len, char* const to,
+   char* const enc, const size_t enc_len
+) {
+   size_t i, j, e, span;
+   int have_space;
+   int enc_ok;
+   int runs;
+   int seqlen;
+   char c;
+
+   i = j = e  = 0;
+   have_space = 0;
+   enc_ok     = ( enc != NULL ) ? 1 : 0;
+   runs       = 1;
+
+   while ( i < len && str[i] != '\0' ) {
+      /* plain ascii goes to both to and enc unchanged */
+      span = ( runs ) ? devnode_whitelist_span ( &str[i], len - i ) : 0;
+      if ( span > 0 ) {
+         if ( have_space ) {
+            to[j++]    = '_';
+            have_space = 0;
+         }
+         memcpy ( &to[j], &str[i], span );
+         j += span;
+
+         if ( enc_ok ) {
+            if ( enc_len - e < span ) {
+               enc_ok = 0;
+            } else {
+               memcpy ( &enc[e], &str[i], span );
+               e += span;
+            }
+         }
+
+         i += span;
+         continue;
+      }
+
+      span = ( runs ) ? space_span ( &str[i], len - i ) : 0;
+      if ( span > 0 ) {
+         /* leading whitespace is dropped */
+         have_space = ( j > 0 ) ? 1 : 0;
+         if ( enc_ok ) {
+            enc_ok = ( encode_devnode_spaces ( span, enc, enc_len, &e ) == 0 )
+               ? 1 : 0;
+         }
+         i += span;
+         continue;
+      }
+
+      c = str[i];
+
+      if ( (unsigned char)c >= 0x80 ) {
+         /* a multibyte char must fit in str[i..len), which has no '\0' */
+         seqlen = utf8_encoded_expected_len ( &str[i] );
+         if ( seqlen > 1 && (size_t)seqlen <= len - i ) {
+            seqlen = utf8_encoded_valid_unichar ( &str[i] );
+         } else {
+            seqlen = -1;
+         }
+
+         if ( seqlen > 1 ) {
+            if ( have_space ) {
+               to[j++]    = '_';
+               have_space = 0;
+            }
+            memcpy ( &to[j], &str[i], (size_t)seqlen );
+            j += (size_t)seqlen;
+
+            if ( enc_ok ) {
+               if ( enc_len - e < (size_t)seqlen ) {
+                  enc_ok = 0;
+               } else {
+                  memcpy ( &enc[e], &str[i], (size_t)seqlen );
+                  e += (size_t)seqlen;
+               }
+            }
+
+            i += (size_t)seqlen;
+            continue;
+         }
+      }
+
+      if ( is_space_char ( c ) ) {
+         /* leading whitespace is dropped */
+         have_space = ( j > 0 ) ? 1 : 0;
+
+      } else {
+         if ( have_space ) {
+            to[j++]    = '_';
+            have_space = 0;
+         }
+         if ( whitelisted_char_for_devnode ( c, NULL ) ) {
+            to[j++] = c;
+         } else {
+            /*
+             * not a plain ASCII string (e.g. garbage sent by a broken
+             * disk), the runs above would not pay off for the rest of it
+             */
+            runs = 0;
+            /* util_replace_chars() accepts hex encoding, "\x" */
+            to[j++] = ( c == '\\' && i + 1 < len && str[i+1] == 'x' )
+               ? c : '_';
+         }
+      }
+
+      if ( enc_ok ) {
+         enc_ok = ( encode_devnode_char ( c, enc, enc_len, &e ) == 0 ) ? 1 : 0;
+      }
+
+      i++;
+   }
+
+   to[j] = '\0';
+
+   if ( enc == NULL ) {
+      return 0;
+   } else if ( !enc_ok || enc_len - e < 1 ) {
+      return -1;
+   }
+   enc[e] = '\0';
+   return 0;
+}
+
 /* functions taken from other systemd/udev files */
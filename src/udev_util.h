@@ -35,7 +35,7 @@
      not claiming copyright on this file (minor changes only)
 ***/
 
-#ifndef _DISKID_UDEV_UTIL
+#ifndef _DISKID_UDEV_UTIL_
 #define _DISKID_UDEV_UTIL_
 
 #include <string.h>
@@ -53,6 +53,19 @@ int util_replace_whitespace (const char* const, char* const, size_t);
 int util_replace_chars      (char* const, const char* const);
 int encode_devnode_name     (const char* const, char* const, const size_t);
 
+/*
+ * util_replace_whitespace ( str, to, len ), util_replace_chars ( to, NULL )
+ * and, unless enc is NULL, encode_devnode_name ( str, enc, enc_len ) with
+ * str cut off at len, in a single pass over str and without a temporary
+ * buffer. str does not need to be terminated, but all of str[0..len) must
+ * be readable (it is scanned in blocks). to needs len + 1 chars.
+ * Returns 0 on success and -1 if enc is too small.
+ */
+int util_normalize_string (
+   const char* const str, const size_t len, char* const to,
+   char* const enc, const size_t enc_len
+);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
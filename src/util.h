@@ -21,8 +21,10 @@
 #define _DISKID_UTIL_
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -60,71 +62,15 @@ static inline void convert_to_uppercase (
    }
 }
 
-static inline char* get_uppercase ( const char* const str ) {
-   char* upstr;
-   upstr = strdup ( str );
-   /* strlen()+1 not needed here */
-   convert_to_uppercase ( upstr, 0, strlen ( str ) );
-   return upstr;
-}
-
-static inline char* join_str_double (
-   const char* const left, const char* const right
-) {
-   if ( left == NULL ) {
-      if ( right == NULL ) {
-         return NULL;
-      } else {
-         return strdup ( right );
-      }
-   } else if ( right == NULL ) {
-      return strdup ( left );
-   } else {
-      size_t size_left;
-      size_t size_right;
-      size_t i;
-
-      char* out_str = NULL;
-
-      size_left  = strlen ( left );
-      size_right = strlen ( right );
-      out_str    = malloc ( size_left + size_right + 1 );
-
-      if ( out_str != NULL ) {
-         for ( i = 0; i < size_left; i++ ) {
-            out_str[i] = left[i];
-         }
-         for ( i = 0; i < size_right; i++ ) {
-            out_str[size_left+i] = right[i];
-         }
-         out_str [size_left+size_right] = '\0';
-      }
-
-      return out_str;
-   }
-}
-
-static inline char* join_str_triple (
-   const char* const left, const char* const middle, const char* const right
-) {
-   char* tmp_str = NULL;
-   char* out_str = NULL;
+/* CLOCK_MONOTONIC in ns, deadlines are given in this time base */
+static inline uint64_t util_now_ns ( void ) {
+   struct timespec ts;
 
-   tmp_str = join_str_double ( left, middle );
-   if ( right == NULL ) {
-      out_str = tmp_str;
-   } else {
-      out_str = join_str_double ( tmp_str, right );
-      if ( tmp_str != NULL ) {
-         free ( tmp_str );
-      }
-   }
-
-   return out_str;
+   clock_gettime ( CLOCK_MONOTONIC, &ts );
+   return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 }
 
 
-
 #ifdef __cplusplus
 } /* extern "C" */
 #endif